@@ -0,0 +1,582 @@
+#include <benchmark/benchmark.h>
+
+#include "AvlTree.hpp"
+#include "ConcurrentAvlTree.hpp"
+#include "FrozenAvlTree.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <span>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+namespace {
+
+using Key = std::int64_t;
+using Value = std::int64_t;
+
+// Bytes currently handed out by every TrackingAllocator, used to report memory per element.
+std::int64_t liveBytes{0};
+
+template<typename T>
+struct TrackingAllocator {
+    using value_type = T;
+    TrackingAllocator() = default;
+    template<typename U>
+    TrackingAllocator(const TrackingAllocator<U>& /*unused*/) {}
+    T* allocate(size_t n) {
+        liveBytes += static_cast<std::int64_t>(n * sizeof(T));
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* ptr, size_t n) {
+        liveBytes -= static_cast<std::int64_t>(n * sizeof(T));
+        std::allocator<T>{}.deallocate(ptr, n);
+    }
+    template<typename U>
+    bool operator==(const TrackingAllocator<U>& /*unused*/) const {
+        return true;
+    }
+};
+
+// Every container is driven through the same small interface so each workload is written once.
+
+struct CompactNodes : algos::AvlTreeOptions {
+    static constexpr bool compactNodes{true};
+};
+
+struct LinkedNodes : algos::AvlTreeOptions {
+    static constexpr bool linkedNodes{true};
+};
+
+template<typename Options>
+struct AvlTreeAdapter {
+    static constexpr const char* name{Options::compactNodes  ? "AvlTree(compact)"
+                                      : Options::linkedNodes ? "AvlTree(linked)"
+                                                             : "AvlTree"};
+    static constexpr size_t maxShiftingSize{SIZE_MAX};
+    algos::AvlTree<Key, Value, std::less<Key>, TrackingAllocator<std::pair<Key, Value>>, Options> tree;
+    void insert(Key key) {
+        (void) tree.insert(key, key);
+    }
+    [[nodiscard]]
+    bool contains(Key key) const {
+        return tree.find(key) != tree.cend();
+    }
+    void erase(Key key) {
+        (void) tree.erase(key);
+    }
+    size_t containsBatch(std::span<const Key> keys, std::span<bool> found) const {
+        return tree.contains_batch(keys, found);
+    }
+    [[nodiscard]]
+    Value sum() {
+        Value total(0);
+        for(const auto& [key, value] : tree) {
+            total += value;
+        }
+        return total;
+    }
+};
+
+// Read-only, so it is only registered for the lookup and iteration workloads.
+struct FrozenAvlTreeAdapter {
+    static constexpr const char* name{"FrozenAvlTree"};
+    static constexpr size_t maxShiftingSize{SIZE_MAX};
+    algos::FrozenAvlTree<Key, Value, std::less<Key>, TrackingAllocator<std::pair<Key, Value>>> tree;
+    void load(const std::vector<Key>& keys) {
+        algos::AvlTree<Key, Value, std::less<Key>, TrackingAllocator<std::pair<Key, Value>>> source;
+        for(const auto key : keys) {
+            (void) source.insert(key, key);
+        }
+        tree = decltype(tree)(source);
+    }
+    [[nodiscard]]
+    bool contains(Key key) const {
+        return tree.find(key) != tree.cend();
+    }
+    size_t containsBatch(std::span<const Key> keys, std::span<bool> found) const {
+        return tree.contains_batch(keys, found);
+    }
+    [[nodiscard]]
+    Value sum() {
+        Value total(0);
+        for(const auto& [key, value] : tree) {
+            total += value;
+        }
+        return total;
+    }
+};
+
+// Readers take a snapshot per lookup, as a worker thread handling one request at a time would.
+struct ConcurrentAvlTreeAdapter {
+    static constexpr const char* name{"ConcurrentAvlTree"};
+    static constexpr size_t maxShiftingSize{SIZE_MAX};
+    algos::ConcurrentAvlTree<Key, Value, std::less<Key>, TrackingAllocator<std::pair<Key, Value>>> tree;
+    void insert(Key key) {
+        (void) tree.insert(key, key);
+    }
+    [[nodiscard]]
+    bool contains(Key key) const {
+        const auto snapshot(tree.snapshot());
+        return snapshot.find(key) != snapshot.cend();
+    }
+};
+
+// The baseline for sharing a tree between threads, a reader-writer lock around every call.
+struct SharedMutexAvlTreeAdapter {
+    static constexpr const char* name{"AvlTree+shared_mutex"};
+    static constexpr size_t maxShiftingSize{SIZE_MAX};
+    algos::AvlTree<Key, Value, std::less<Key>, TrackingAllocator<std::pair<Key, Value>>> tree;
+    mutable std::shared_mutex mutex;
+    void insert(Key key) {
+        const std::unique_lock lock(mutex);
+        (void) tree.insert(key, key);
+    }
+    [[nodiscard]]
+    bool contains(Key key) const {
+        const std::shared_lock lock(mutex);
+        return tree.find(key) != tree.cend();
+    }
+};
+
+struct MapAdapter {
+    static constexpr const char* name{"std::map"};
+    static constexpr size_t maxShiftingSize{SIZE_MAX};
+    std::map<Key, Value, std::less<Key>, TrackingAllocator<std::pair<const Key, Value>>> map;
+    void insert(Key key) {
+        map.emplace(key, key);
+    }
+    [[nodiscard]]
+    bool contains(Key key) const {
+        return map.find(key) != map.cend();
+    }
+    void erase(Key key) {
+        map.erase(key);
+    }
+    [[nodiscard]]
+    Value sum() {
+        Value total(0);
+        for(const auto& [key, value] : map) {
+            total += value;
+        }
+        return total;
+    }
+};
+
+struct SetAdapter {
+    static constexpr const char* name{"std::set"};
+    static constexpr size_t maxShiftingSize{SIZE_MAX};
+    std::set<Key, std::less<Key>, TrackingAllocator<Key>> set;
+    void insert(Key key) {
+        set.insert(key);
+    }
+    [[nodiscard]]
+    bool contains(Key key) const {
+        return set.find(key) != set.cend();
+    }
+    void erase(Key key) {
+        set.erase(key);
+    }
+    [[nodiscard]]
+    Value sum() {
+        return std::accumulate(set.begin(), set.end(), Value{0});
+    }
+};
+
+struct SortedVectorAdapter {
+    static constexpr const char* name{"SortedVector"};
+    // Inserting and erasing shift O(n) elements, which makes larger sizes impractical.
+    static constexpr size_t maxShiftingSize{100'000};
+    std::vector<std::pair<Key, Value>, TrackingAllocator<std::pair<Key, Value>>> vec;
+    // Containers that are only read from are loaded in bulk, inserting one at a time would take O(n^2).
+    void load(const std::vector<Key>& keys) {
+        vec.reserve(keys.size());
+        for(const auto key : keys) {
+            vec.emplace_back(key, key);
+        }
+        std::sort(vec.begin(), vec.end());
+    }
+    void insert(Key key) {
+        const auto pos(std::lower_bound(vec.begin(), vec.end(), key, [](const auto& elem, Key k) { return elem.first < k; }));
+        if(pos == vec.end() || pos->first != key) {
+            vec.emplace(pos, key, key);
+        }
+    }
+    [[nodiscard]]
+    bool contains(Key key) const {
+        const auto pos(std::lower_bound(vec.begin(), vec.end(), key, [](const auto& elem, Key k) { return elem.first < k; }));
+        return pos != vec.end() && pos->first == key;
+    }
+    void erase(Key key) {
+        const auto pos(std::lower_bound(vec.begin(), vec.end(), key, [](const auto& elem, Key k) { return elem.first < k; }));
+        if(pos != vec.end() && pos->first == key) {
+            vec.erase(pos);
+        }
+    }
+    [[nodiscard]]
+    Value sum() {
+        Value total(0);
+        for(const auto& [key, value] : vec) {
+            total += value;
+        }
+        return total;
+    }
+};
+
+enum class Order { Random, Ascending, Descending };
+
+/**
+ * @brief The even keys 0, 2, ..., 2 * (count - 1) in the requested order. Odd keys never
+ *        appear in a container built from them, which makes them lookup misses.
+ */
+const std::vector<Key>& keysFor(size_t count, Order order) {
+    static std::map<std::pair<size_t, Order>, std::vector<Key>> cache;
+    auto& keys(cache[{count, order}]);
+    if(keys.empty()) {
+        keys.resize(count);
+        for(size_t i = 0; i < count; ++i) {
+            keys[i] = static_cast<Key>(2 * i);
+        }
+        if(order == Order::Random) {
+            std::shuffle(keys.begin(), keys.end(), std::mt19937_64(count));
+        } else if(order == Order::Descending) {
+            std::reverse(keys.begin(), keys.end());
+        }
+    }
+    return keys;
+}
+
+template<typename Container>
+std::unique_ptr<Container> build(const std::vector<Key>& keys) {
+    auto container(std::make_unique<Container>());
+    for(const auto key : keys) {
+        container->insert(key);
+    }
+    return container;
+}
+
+/**
+ * @brief Fill a container the fastest way it allows, for workloads that don't measure inserts.
+ */
+template<typename Container>
+std::unique_ptr<Container> load(const std::vector<Key>& keys) {
+    if constexpr(requires(Container& container) { container.load(keys); }) {
+        auto container(std::make_unique<Container>());
+        container->load(keys);
+        return container;
+    } else {
+        return build<Container>(keys);
+    }
+}
+
+/**
+ * @brief Report the time per operation when one iteration performs @p opsPerIteration operations.
+ */
+void reportPerOp(benchmark::State& state, size_t opsPerIteration) {
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * opsPerIteration));
+    // Inverted into seconds per operation, which is printed with an SI prefix such as 25.3ns.
+    state.counters["time/op"] = benchmark::Counter(static_cast<double>(opsPerIteration),
+        benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+void reportBytesPerElement(benchmark::State& state, std::int64_t bytes, size_t count) {
+    state.counters["bytes/elem"] = static_cast<double>(bytes) / static_cast<double>(count);
+}
+
+template<typename Container, Order order>
+void insertBench(benchmark::State& state) {
+    const auto count(static_cast<size_t>(state.range(0)));
+    const auto& keys(keysFor(count, order));
+    std::int64_t bytes(0);
+    for(auto _ : state) {
+        const auto bytesBefore(liveBytes);
+        auto container(build<Container>(keys));
+        bytes = liveBytes - bytesBefore;
+        state.PauseTiming();
+        container.reset();
+        state.ResumeTiming();
+    }
+    reportPerOp(state, count);
+    reportBytesPerElement(state, bytes, count);
+}
+
+template<typename Container, bool hit>
+void findBench(benchmark::State& state) {
+    const auto count(static_cast<size_t>(state.range(0)));
+    const auto container(load<Container>(keysFor(count, Order::Random)));
+    // Probe in an order unrelated to the insertion order, cycling through a bounded set of keys.
+    std::vector<Key> probes(keysFor(std::min<size_t>(count, 1 << 20), Order::Random));
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64(42));
+    if constexpr(!hit) {
+        for(auto& probe : probes) {
+            probe += 1;
+        }
+    }
+    size_t next(0);
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(container->contains(probes[next]));
+        next = next + 1 == probes.size() ? 0 : next + 1;
+    }
+    reportPerOp(state, 1);
+}
+
+/**
+ * @brief Hits probed in batches, which lets a container overlap the misses of many descents.
+ */
+template<typename Container>
+void findBatchBench(benchmark::State& state) {
+    constexpr size_t batchSize(4096);
+    const auto count(static_cast<size_t>(state.range(0)));
+    const auto container(load<Container>(keysFor(count, Order::Random)));
+    const auto& keys(keysFor(std::min<size_t>(count, 1 << 20), Order::Random));
+    std::vector<Key> probes;
+    while(probes.size() < std::max(keys.size(), batchSize)) {
+        probes.insert(probes.end(), keys.begin(), keys.end());
+    }
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64(42));
+    const auto found(std::make_unique<bool[]>(batchSize));
+    size_t next(0);
+    for(auto _ : state) {
+        if(next + batchSize > probes.size()) {
+            next = 0;
+        }
+        benchmark::DoNotOptimize(container->containsBatch({probes.data() + next, batchSize}, {found.get(), batchSize}));
+        next += batchSize;
+    }
+    reportPerOp(state, batchSize);
+}
+
+/**
+ * @brief Hits looked up by every thread at once in a container they share.
+ */
+template<typename Container>
+void concurrentFindBench(benchmark::State& state) {
+    static std::unique_ptr<Container> container;
+    const auto count(static_cast<size_t>(state.range(0)));
+    // The first thread sets up before the threads line up to start the loop together.
+    if(state.thread_index() == 0) {
+        container = load<Container>(keysFor(count, Order::Random));
+    }
+    std::vector<Key> probes(keysFor(std::min<size_t>(count, 1 << 20), Order::Random));
+    std::shuffle(probes.begin(), probes.end(), std::mt19937_64(static_cast<std::uint64_t>(state.thread_index())));
+    size_t next(0);
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(container->contains(probes[next]));
+        next = next + 1 == probes.size() ? 0 : next + 1;
+    }
+    reportPerOp(state, 1);
+    if(state.thread_index() == 0) {
+        container.reset();
+    }
+}
+
+template<typename Container>
+void eraseBench(benchmark::State& state) {
+    const auto count(static_cast<size_t>(state.range(0)));
+    const auto& keys(keysFor(count, Order::Random));
+    std::vector<Key> eraseOrder(keys);
+    std::shuffle(eraseOrder.begin(), eraseOrder.end(), std::mt19937_64(7));
+    for(auto _ : state) {
+        state.PauseTiming();
+        auto container(load<Container>(keys));
+        state.ResumeTiming();
+        for(const auto key : eraseOrder) {
+            container->erase(key);
+        }
+        state.PauseTiming();
+        container.reset();
+        state.ResumeTiming();
+    }
+    reportPerOp(state, count);
+}
+
+template<typename Container>
+void iterateBench(benchmark::State& state) {
+    const auto count(static_cast<size_t>(state.range(0)));
+    const auto bytesBefore(liveBytes);
+    const auto container(load<Container>(keysFor(count, Order::Random)));
+    const auto bytes(liveBytes - bytesBefore);
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(container->sum());
+    }
+    reportPerOp(state, count);
+    reportBytesPerElement(state, bytes, count);
+}
+
+/**
+ * @brief Half lookups, a quarter inserts and a quarter erases of uniformly random keys
+ *        on a container that hovers around its initial size.
+ */
+template<typename Container>
+void mixedBench(benchmark::State& state) {
+    const auto count(static_cast<size_t>(state.range(0)));
+    auto container(load<Container>(keysFor(count, Order::Random)));
+    struct Op {
+        int kind;
+        Key key;
+    };
+    std::vector<Op> ops(1 << 20);
+    std::mt19937_64 rng(count);
+    std::uniform_int_distribution<Key> keyDist(0, static_cast<Key>(2 * count - 1));
+    for(auto& op : ops) {
+        op = {static_cast<int>(rng() % 4), keyDist(rng)};
+    }
+    size_t next(0);
+    for(auto _ : state) {
+        const auto& op(ops[next]);
+        if(op.kind < 2) {
+            benchmark::DoNotOptimize(container->contains(op.key));
+        } else if(op.kind == 2) {
+            container->insert(op.key);
+        } else {
+            container->erase(op.key);
+        }
+        next = next + 1 == ops.size() ? 0 : next + 1;
+    }
+    reportPerOp(state, 1);
+}
+
+/**
+ * @brief The union of the even keys and the keys that are multiples of three, computed by
+ *        state.range(1) threads, which rebuilds both inputs between iterations.
+ */
+template<typename Container>
+void setUnionBench(benchmark::State& state) {
+    const auto count(static_cast<size_t>(state.range(0)));
+    const auto threads(static_cast<unsigned>(state.range(1)));
+    std::vector<Key> multiples(keysFor(count, Order::Ascending));
+    for(auto& key : multiples) {
+        key = key / 2 * 3;
+    }
+    for(auto _ : state) {
+        state.PauseTiming();
+        auto first(load<Container>(keysFor(count, Order::Ascending)));
+        auto second(load<Container>(multiples));
+        state.ResumeTiming();
+        first->tree = decltype(first->tree)::set_union(std::move(first->tree), std::move(second->tree), threads);
+        state.PauseTiming();
+        first.reset();
+        second.reset();
+        state.ResumeTiming();
+    }
+    reportPerOp(state, 2 * count);
+}
+
+/**
+ * @brief Register @p bench for every size up to @p maxSize.
+ *
+ * @param shifts Whether the workload inserts into or erases from the middle of the
+ *               container, which limits the sizes a sorted vector can manage.
+ * @param wholeContainer Whether one iteration processes the whole container rather than one key.
+ */
+template<typename Container>
+void registerWorkload(const char* workload, void (*bench)(benchmark::State&), size_t maxSize, bool shifts,
+                      bool wholeContainer) {
+    const std::string name(std::string(workload) + "/" + Container::name);
+    auto* const registered(benchmark::RegisterBenchmark(name.c_str(), bench));
+    if(wholeContainer) {
+        registered->Unit(benchmark::kMillisecond);
+    }
+    const auto limit(shifts ? std::min(maxSize, Container::maxShiftingSize) : maxSize);
+    for(size_t count = 1000; count <= limit; count *= 10) {
+        registered->Arg(static_cast<std::int64_t>(count));
+    }
+}
+
+template<typename Container>
+void registerFindBatch(size_t maxSize) {
+    if constexpr(requires(const Container& container, std::span<const Key> keys, std::span<bool> found) {
+                     container.containsBatch(keys, found);
+                 }) {
+        registerWorkload<Container>("FindBatch", findBatchBench<Container>, maxSize, false, false);
+    }
+}
+
+template<typename... Containers>
+void registerAll(size_t maxSize) {
+    (registerWorkload<Containers>("InsertRandom", insertBench<Containers, Order::Random>, maxSize, true, true), ...);
+    (registerWorkload<Containers>("InsertAscending", insertBench<Containers, Order::Ascending>, maxSize, false, true), ...);
+    (registerWorkload<Containers>("InsertDescending", insertBench<Containers, Order::Descending>, maxSize, true, true), ...);
+    (registerWorkload<Containers>("FindHit", findBench<Containers, true>, maxSize, false, false), ...);
+    (registerWorkload<Containers>("FindMiss", findBench<Containers, false>, maxSize, false, false), ...);
+    (registerFindBatch<Containers>(maxSize), ...);
+    (registerWorkload<Containers>("Erase", eraseBench<Containers>, maxSize, true, true), ...);
+    (registerWorkload<Containers>("Iterate", iterateBench<Containers>, maxSize, false, true), ...);
+    (registerWorkload<Containers>("Mixed", mixedBench<Containers>, maxSize, true, false), ...);
+}
+
+template<typename... Containers>
+void registerSetOperations(size_t maxSize) {
+    const auto threads(static_cast<std::int64_t>(std::max(2U, std::thread::hardware_concurrency())));
+    for(size_t count = 1000; count <= maxSize; count *= 10) {
+        (benchmark::RegisterBenchmark((std::string("SetUnion/") + Containers::name).c_str(), setUnionBench<Containers>)
+             ->Args({static_cast<std::int64_t>(count), 1})
+             ->Args({static_cast<std::int64_t>(count), threads})
+             ->Unit(benchmark::kMillisecond)
+             ->UseRealTime(), ...);
+    }
+}
+
+template<typename... Containers>
+void registerConcurrentReads(size_t maxSize) {
+    const auto threads(static_cast<int>(std::max(2U, std::thread::hardware_concurrency())));
+    (benchmark::RegisterBenchmark((std::string("ConcurrentFind/") + Containers::name).c_str(), concurrentFindBench<Containers>)
+         ->Arg(static_cast<std::int64_t>(std::min<size_t>(maxSize, 1'000'000)))
+         ->ThreadRange(1, threads)
+         ->UseRealTime(), ...);
+}
+
+template<typename... Containers>
+void registerReads(size_t maxSize) {
+    (registerWorkload<Containers>("FindHit", findBench<Containers, true>, maxSize, false, false), ...);
+    (registerWorkload<Containers>("FindMiss", findBench<Containers, false>, maxSize, false, false), ...);
+    (registerFindBatch<Containers>(maxSize), ...);
+    (registerWorkload<Containers>("Iterate", iterateBench<Containers>, maxSize, false, true), ...);
+}
+
+}
+
+/**
+ * Accepts every Google Benchmark flag, plus --max_size=N to bound the number of elements
+ * (default 1000000). Sizes grow by factors of ten from 1000, so --max_size=100000000 covers
+ * the full range up to 1e8 given enough memory.
+ */
+int main(int argc, char** argv) {
+    size_t maxSize(1'000'000);
+    constexpr std::string_view maxSizeFlag("--max_size=");
+    std::vector<char*> args;
+    for(int i = 0; i < argc; ++i) {
+        const std::string_view arg(argv[i]);
+        if(arg.starts_with(maxSizeFlag)) {
+            maxSize = std::strtoull(argv[i] + maxSizeFlag.size(), nullptr, 10);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    int remaining(static_cast<int>(args.size()));
+    benchmark::Initialize(&remaining, args.data());
+    if(benchmark::ReportUnrecognizedArguments(remaining, args.data())) {
+        return 1;
+    }
+    registerAll<AvlTreeAdapter<algos::AvlTreeOptions>, AvlTreeAdapter<CompactNodes>, AvlTreeAdapter<LinkedNodes>, MapAdapter, SetAdapter, SortedVectorAdapter>(maxSize);
+    registerReads<FrozenAvlTreeAdapter>(maxSize);
+    registerSetOperations<AvlTreeAdapter<algos::AvlTreeOptions>, AvlTreeAdapter<LinkedNodes>>(maxSize);
+    registerConcurrentReads<SharedMutexAvlTreeAdapter, ConcurrentAvlTreeAdapter>(maxSize);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
+
+// NOLINTEND(readability-magic-numbers)
@@ -1,48 +1,308 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <future>
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
+#include "NodePool.hpp"
+#include "Prefetch.hpp"
+
 namespace algos {
 
+/**
+ * @brief Optional features of an AvlTree, all disabled by default.
+ *
+ * Derive from this and override the members of interest to opt in, features
+ * that are left disabled cost neither memory nor time.
+ */
+struct AvlTreeOptions {
+    /**
+     * Keep the number of elements of every subtree in its root, which
+     * enables select(), rank() and count_range() in O(log n), and is what
+     * lets split() know the sizes of its halves without counting either.
+     */
+    static constexpr bool orderStatistics{false};
+    /**
+     * Pack the balance factor of every node into the low bits of its parent
+     * pointer, which saves a word per node at the cost of masking the pointer
+     * whenever the tree is walked upwards.
+     */
+    static constexpr bool compactNodes{false};
+    /**
+     * Thread every node onto a doubly linked list in key order, kept in step with
+     * inserts and erases, so stepping an iterator is a single pointer load rather
+     * than a walk through the tree. This costs two words per node.
+     */
+    static constexpr bool linkedNodes{false};
+    /**
+     * Count comparisons, rotations, node allocations and frees, and record how deep
+     * every descent goes and how many links every iterator step follows, all of
+     * which stats() reports. The counters are atomic, so this slows every operation.
+     * Iterator steps are counted for every tree of the same type together, as an
+     * iterator may outlive the tree it came from.
+     */
+    static constexpr bool collectStats{false};
+    /**
+     * Cache the first eight bytes of every std::string key in its node, so most
+     * comparisons on the way down are settled by comparing two integers without
+     * loading the characters of the key. This costs a word per node and requires
+     * the default ordering of the keys.
+     */
+    static constexpr bool cacheKeyPrefix{false};
+    /**
+     * A monoid whose combination over the elements of every subtree is kept in
+     * its root, which enables aggregate() over a range of keys in O(log n), or
+     * void for none. It provides a default constructible value_type, identity(),
+     * lift(key, value) for a single element and an associative combine(lhs, rhs),
+     * all static. Values must then only be changed through the tree, as modifying
+     * one through an iterator leaves the aggregates above it stale.
+     */
+    using Monoid = void;
+};
+
+/**
+ * @brief What an AvlTree collecting stats has done since it was constructed, see AvlTreeOptions::collectStats.
+ */
+struct AvlTreeStats {
+    static constexpr size_t depthBuckets{64};
+    static constexpr size_t stepBuckets{16};
+
+    std::uint64_t comparisons{0};
+    std::uint64_t rotations{0};
+    std::uint64_t allocations{0};
+    std::uint64_t frees{0};
+    // The number of searches and insert positions found after visiting each number of nodes,
+    // descents at least as deep as the last bucket are counted in it.
+    std::array<std::uint64_t, depthBuckets> descentDepths{};
+    // The number of iterator steps that followed from 2^i up to 2^(i + 1) - 1 links, taken by the
+    // iterators of every tree of the same type since the program started.
+    std::array<std::uint64_t, stepBuckets> stepLengths{};
+};
+
+/**
+ * @brief A pair of iterators delimiting a run of elements, usable in a range-based for loop.
+ */
+template<typename Iter>
+struct IteratorRange {
+    [[nodiscard]]
+    Iter begin() const {
+        return first;
+    }
+    [[nodiscard]]
+    Iter end() const {
+        return last;
+    }
+    [[nodiscard]]
+    bool empty() const {
+        return first == last;
+    }
+    Iter first;
+    Iter last;
+};
+
 /**
  * @brief Implementation of an AVL tree https://en.wikipedia.org/wiki/AVL_tree
  *
+ * join() and merge() of disjoint key ranges take O(log n). split() only does with
+ * AvlTreeOptions::orderStatistics enabled, without it split() counts the smaller half,
+ * which takes time linear in that half.
+ *
  * @tparam K The type of keys used to identifty elements in the tree.
  * @tparam V The type of value associated with each key.
- * @tparam Compare A function used for ordering keys.
+ * @tparam Compare A function used for ordering keys, it is stored in the tree and may carry state.
+ * @tparam Allocator The allocator used to obtain the chunks nodes are carved from.
+ * @tparam Options The optional features enabled for the tree, see AvlTreeOptions.
  */
-template<typename K, typename V, typename Compare=std::less<K>>
+template<typename K, typename V, typename Compare=std::less<K>, typename Allocator=std::allocator<std::pair<K, V>>,
+         typename Options=AvlTreeOptions>
 class AvlTree {
 public:
     using value_type = std::pair<K, V>;
+    using allocator_type = Allocator;
 private:
-    struct Node {
-        value_type value;
+    struct Disabled {};
+    static constexpr bool orderStatistics{Options::orderStatistics};
+    static constexpr bool linkedNodes{Options::linkedNodes};
+    static constexpr bool collectStats{Options::collectStats};
+    static constexpr bool cacheKeyPrefix{Options::cacheKeyPrefix};
+    static constexpr bool augmented{!std::is_void_v<typename Options::Monoid>};
+    static constexpr bool isDefaultOrder{std::is_same_v<Compare, std::less<K>> || std::is_same_v<Compare, std::less<>>};
+    static_assert(!cacheKeyPrefix || (std::is_same_v<K, std::string> && isDefaultOrder),
+                  "Key prefixes can only be cached for std::string keys in their default order");
+    // Lookups accept any type the comparator can order against K without converting it first.
+    static constexpr bool isTransparent{requires { typename Compare::is_transparent; }};
+    template<typename T>
+    static constexpr bool isKey{std::is_same_v<std::remove_cvref_t<T>, K>};
+    // The default order is that of operator<=>, which tells both ways apart with one comparison.
+    template<typename Key>
+    static constexpr bool isThreeWay{isDefaultOrder && std::three_way_comparable_with<Key, K, std::weak_ordering>};
+    // A prefix is only worth taking of keys that can be viewed without allocating.
+    template<typename Key>
+    static constexpr bool hasPrefix{cacheKeyPrefix && std::is_convertible_v<const Key&, std::string_view>};
+
+    struct Node;
+
+    // The balance factor of a node is the height of its left subtree minus the height of its right subtree.
+    struct ParentLink {
+        [[nodiscard]]
+        Node* getParent() const {
+            return parent;
+        }
+        void setParent(Node* const node) {
+            parent = node;
+        }
+        [[nodiscard]]
+        int getBalance() const {
+            return balance;
+        }
+        void setBalance(const int value) {
+            balance = static_cast<std::int8_t>(value);
+        }
+
         Node* parent{nullptr};
-        int height{0};
-        std::unique_ptr<Node> left, right;
+        std::int8_t balance{0};
+    };
+
+    // Nodes are at least pointer aligned, so the two low bits of the parent pointer
+    // are free to hold the balance factor, offset by one to make it unsigned.
+    struct PackedParentLink {
+        static constexpr std::uintptr_t balanceMask{3};
+
+        [[nodiscard]]
+        Node* getParent() const {
+            return reinterpret_cast<Node*>(bits & ~balanceMask);
+        }
+        void setParent(Node* const node) {
+            bits = reinterpret_cast<std::uintptr_t>(node) | (bits & balanceMask);
+        }
+        [[nodiscard]]
+        int getBalance() const {
+            return static_cast<int>(bits & balanceMask) - 1;
+        }
+        void setBalance(const int value) {
+            bits = (bits & ~balanceMask) | static_cast<std::uintptr_t>(value + 1);
+        }
+
+        std::uintptr_t bits{1};
+    };
+
+    // The neighbours of a node in key order, see AvlTreeOptions::linkedNodes.
+    struct OrderLinks {
+        Node* prev{nullptr};
+        Node* next{nullptr};
+    };
+
+    // A second empty type, as two members of the same type may not share an address.
+    struct Unlinked {};
+    // And a third, see AvlTreeOptions::cacheKeyPrefix.
+    struct Unprefixed {};
+    using Prefix = std::conditional_t<cacheKeyPrefix, std::uint64_t, Unprefixed>;
+
+    // Stands in for the monoid of a tree without one, with a fourth empty type as its aggregate.
+    struct NoMonoid {
+        struct value_type {};
+    };
+    using Monoid = std::conditional_t<augmented, typename Options::Monoid, NoMonoid>;
+
+    struct Node {
+        template<typename... Args>
+        explicit Node(Node* parent, Args&&... args) : value(std::forward<Args>(args)...) {
+            up.setParent(parent);
+            if constexpr(cacheKeyPrefix) {
+                prefix = prefixOf(value.first);
+            }
+        }
+        // The header of a tree is a node without a value, see AvlTree::header.
+        Node() : left(this) {
+            if constexpr(linkedNodes) {
+                order = {this, this};
+            }
+        }
+        // Values are destroyed by the tree, which knows which nodes hold one.
+        ~Node() {}
+
+        /**
+         * @brief End the lifetime of the element and of what is kept about it, before
+         *        the storage of the node goes back to the pool without being destroyed.
+         */
+        void destroyElement() noexcept {
+            std::destroy_at(&value);
+            std::destroy_at(&aggregate);
+        }
+
+        union {
+            value_type value;
+        };
+        // Next to the links, so the descent that loads them usually needs nothing else.
+        [[no_unique_address]] Prefix prefix{};
+        std::conditional_t<Options::compactNodes, PackedParentLink, ParentLink> up;
+        Node* left{nullptr};
+        Node* right{nullptr};
+        [[no_unique_address]] std::conditional_t<orderStatistics, size_t, Disabled> size{};
+        // The combination of the elements of the subtree, see AvlTreeOptions::Monoid.
+        [[no_unique_address]] typename Monoid::value_type aggregate{};
+        // The list runs through the header, which ends up both before the first node and after the last.
+        [[no_unique_address]] std::conditional_t<linkedNodes, OrderLinks, Unlinked> order{};
     };
+    static_assert(!Options::compactNodes || alignof(Node) > PackedParentLink::balanceMask);
+
+    [[nodiscard]]
+    static Node* parentOf(const Node* const node) {
+        return node->up.getParent();
+    }
+
+    static void setParent(Node* const node, Node* const parent) {
+        node->up.setParent(parent);
+    }
+
+    [[nodiscard]]
+    static int balanceOf(const Node* const node) {
+        return node->up.getBalance();
+    }
+
+    static void setBalance(Node* const node, const int balance) {
+        node->up.setBalance(balance);
+    }
 public:
+    /**
+     * @brief The bytes of storage every element takes up, including the links of its node.
+     */
+    static constexpr size_t node_size{sizeof(Node)};
+
     template<typename N=Node>
     struct Iterator {
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::pair<K, V>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<std::is_const_v<N>, const value_type*, value_type*>;
+        using reference = std::conditional_t<std::is_const_v<N>, const value_type&, value_type&>;
+
+        Iterator() = default;
+        // Like the standard containers an iterator converts to a const_iterator, which hints take.
+        template<typename U>
+        requires std::is_same_v<N, const U>
+        Iterator(const Iterator<U>& other) : node(other.node) {}
         Iterator& operator++() {
-            if(node->right) {
-                node = node->right.get();
-                while(node->left) {
-                    node = node->left.get();
-                }
-                return *this;
-            }
-            bool done(false);
-            while(!done) {
-                auto* const parent(node->parent);
-                done = (parent == nullptr || node == parent->left.get());
-                node = parent;
-            }
+            advance<true>();
             return *this;
         }
         Iterator operator++(int) {
@@ -50,11 +310,20 @@ public:
             ++(*this);
             return old;
         }
+        Iterator& operator--() {
+            advance<false>();
+            return *this;
+        }
+        Iterator operator--(int) {
+            const Iterator old(*this);
+            --(*this);
+            return old;
+        }
         [[nodiscard]]
-        auto& operator*() const {
+        reference operator*() const {
             return node->value;
         }
-        auto* operator->() const {
+        pointer operator->() const {
             return &node->value;
         }
         // Allow comparing iterator with const_iterator
@@ -64,246 +333,2607 @@ public:
             return node == rhs.node;
         }
         friend std::ostream& operator<<(std::ostream& out, const Iterator& iter) {
-            if(iter.node == nullptr) {
-                return out << "nullptr";
+            // The header is the only node of a tree without a parent.
+            if(iter.node == nullptr || iter.node->up.getParent() == nullptr) {
+                return out << "end";
             }
             return out << "(" << iter->first << ", " << iter->second << ")";
         }
     private:
-        friend class AvlTree<K, V, Compare>;
+        friend class AvlTree<K, V, Compare, Allocator, Options>;
+        template<typename U>
+        friend struct Iterator;
         explicit Iterator(N* node) : node(node) {}
+        template<bool forward>
+        void advance() {
+            if constexpr(collectStats) {
+                unsigned links(0);
+                node = step<forward>(node, links);
+                recordStep(links);
+            } else {
+                node = step<forward>(node);
+            }
+        }
         N* node{nullptr};
     };
 
     using iterator = Iterator<>;
     using const_iterator = Iterator<const Node>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    template<typename Iter>
+    using Range = IteratorRange<Iter>;
+
+    /**
+     * @brief Owns the node of an element taken out of a tree with extract(), until insert()
+     *        links it into a tree again or the handle destroys it.
+     *
+     * The handle holds on to the chunk the node was carved from, so it may outlive the tree
+     * it came from.
+     */
+    class NodeHandle {
+    public:
+        using key_type = K;
+        using mapped_type = V;
+        using allocator_type = Allocator;
+
+        NodeHandle() = default;
+
+        NodeHandle(const NodeHandle&) = delete;
+        NodeHandle& operator=(const NodeHandle&) = delete;
+
+        NodeHandle(NodeHandle&& other) noexcept
+            : node(std::exchange(other.node, nullptr)), pool(std::move(other.pool)) {}
+
+        NodeHandle& operator=(NodeHandle&& other) noexcept {
+            if(this != &other) {
+                reset();
+                node = std::exchange(other.node, nullptr);
+                pool = std::move(other.pool);
+            }
+            return *this;
+        }
+
+        ~NodeHandle() {
+            reset();
+        }
+
+        [[nodiscard]]
+        bool empty() const {
+            return node == nullptr;
+        }
+
+        explicit operator bool() const {
+            return node != nullptr;
+        }
+
+        /**
+         * @brief The key of the element, which may be changed before the node is inserted again.
+         */
+        [[nodiscard]]
+        K& key() const {
+            return node->value.first;
+        }
+
+        [[nodiscard]]
+        V& mapped() const {
+            return node->value.second;
+        }
+
+        [[nodiscard]]
+        allocator_type get_allocator() const {
+            return pool.get_allocator();
+        }
+
+        friend void swap(NodeHandle& lhs, NodeHandle& rhs) noexcept {
+            using std::swap;
+            swap(lhs.node, rhs.node);
+            swap(lhs.pool, rhs.pool);
+        }
+
+    private:
+        friend class AvlTree;
+
+        NodeHandle(Node* const node, NodePool<Node, Allocator>&& pool) noexcept : node(node), pool(std::move(pool)) {}
+
+        void reset() noexcept {
+            if(node != nullptr) {
+                node->destroyElement();
+                pool.deallocate(std::exchange(node, nullptr));
+            }
+        }
+
+        Node* node{nullptr};
+        NodePool<Node, Allocator> pool;
+    };
+    using node_type = NodeHandle;
+
+    /**
+     * @brief What inserting a node handle did, the handle keeps the node if it was not inserted.
+     */
+    struct insert_return_type {
+        iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+    AvlTree() = default;
+
+    explicit AvlTree(const Compare& comp, const Allocator& alloc = Allocator()) : pool(alloc), comp(comp) {}
+
+    explicit AvlTree(const Allocator& alloc) : pool(alloc) {}
+
+    AvlTree(const AvlTree&) = delete;
+    AvlTree& operator=(const AvlTree&) = delete;
+
+    // The comparator is copied rather than moved so the moved-from tree remains usable.
+    AvlTree(AvlTree&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare>)
+        : root(std::exchange(other.root, nullptr)),
+          numElems(std::exchange(other.numElems, 0)),
+          pool(std::move(other.pool)),
+          comp(other.comp) {
+        takeEnds(other);
+    }
+
+    AvlTree& operator=(AvlTree&& other) noexcept(std::is_nothrow_copy_assignable_v<Compare>) {
+        if(this != &other) {
+            clear();
+            root = std::exchange(other.root, nullptr);
+            numElems = std::exchange(other.numElems, 0);
+            pool = std::move(other.pool);
+            comp = other.comp;
+            takeEnds(other);
+        }
+        return *this;
+    }
+
+    ~AvlTree() {
+        clear();
+    }
 
     [[nodiscard]]
     std::pair<iterator, bool> insert(const K& key, const V& value) {
-        return insertHelper(key, value, root);
+        return try_emplace(key, value);
     }
 
     [[nodiscard]]
-    bool erase(const K& key) {
-        return eraseHelper(key, root);
+    std::pair<iterator, bool> insert(const value_type& value) {
+        return emplace(value);
     }
 
     [[nodiscard]]
-    bool erase(iterator i) {
-        return eraseHelper(i.node->value.first, root);
+    std::pair<iterator, bool> insert(value_type&& value) {
+        return emplace(std::move(value));
     }
 
-    [[nodiscard]]
-    auto cbegin() const {
-        return beginHelper<const_iterator>();
+    /**
+     * @brief Insert @p value unless its key is present, searching from @p hint.
+     *
+     * See emplace_hint().
+     */
+    iterator insert(const_iterator hint, const value_type& value) {
+        return emplace_hint(hint, value);
     }
 
-    [[nodiscard]]
-    auto begin() {
-        return beginHelper<iterator>();
+    iterator insert(const_iterator hint, value_type&& value) {
+        return emplace_hint(hint, std::move(value));
     }
 
-    [[nodiscard]]
-    auto end() {
-        return iterator{nullptr};
+    /**
+     * @brief Link the node owned by @p handle into the tree, unless its key is present already.
+     *
+     * Nothing is copied, moved or allocated for the element. The node may come from another
+     * tree whose allocator compares equal, which the tree then shares its chunks with, see
+     * NodePool::adopt(). Trees passing nodes back and forth soon share all of their chunks,
+     * so only the first few nodes moved between them may allocate the bookkeeping for that.
+     *
+     * @return The element with the key of the node, whether the node was inserted, and the
+     *         node if it was not.
+     */
+    insert_return_type insert(node_type&& handle) {
+        const auto [position, inserted](insertNode(nullptr, handle));
+        return {position, inserted, std::move(handle)};
     }
 
-    [[nodiscard]]
-    auto cend() const {
-        return const_iterator{nullptr};
+    /**
+     * @brief Link the node owned by @p handle into the tree, searching from @p hint.
+     *
+     * See insert(node_type&&), the node stays with @p handle if it was not inserted.
+     */
+    iterator insert(const_iterator hint, node_type&& handle) {
+        return insertNode(hint.node, handle).first;
     }
 
+    /**
+     * @brief Insert a value constructed from @p args if its key is not already present.
+     *
+     * When the key can be picked out of @p args directly, that is a key and a value or
+     * a single pair, nothing is constructed unless the key is absent. Otherwise
+     * the value has to be built first to learn its key.
+     */
+    template<typename... Args>
     [[nodiscard]]
-    iterator find(const K& key) {
-        return findHelper<iterator>(key, root.get());
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return emplaceNear(nullptr, std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Insert a value constructed from @p args if its key is not already present,
+     *        searching from @p hint rather than from the root.
+     *
+     * A key that belongs right before or right after @p hint takes amortized constant time
+     * to place, one further away is found by a finger search, see find(const_iterator, const K&).
+     *
+     * @return The element with the key of the value, whether it was inserted or not.
+     */
+    template<typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args) {
+        return emplaceNear(hint.node, std::forward<Args>(args)...).first;
     }
 
+    /**
+     * @brief Insert @p key with a value constructed from @p args, leaving @p key and
+     *        @p args untouched when @p key is already present.
+     */
+    template<typename... Args>
     [[nodiscard]]
-    const_iterator find(const K& key) const {
-        return findHelper<const_iterator>(key, root.get());
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+        return emplaceHelper(nullptr, key, std::forward<Args>(args)...);
     }
 
+    template<typename... Args>
     [[nodiscard]]
-    bool empty() const {
-        return root == nullptr;
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        return emplaceHelper(nullptr, std::move(key), std::forward<Args>(args)...);
     }
 
+    /**
+     * @brief Insert with a key that is only converted to K once it is known to be absent.
+     */
+    template<typename Key, typename... Args>
+    requires (isTransparent && !isKey<Key> && std::is_constructible_v<K, Key&&> &&
+              !std::is_convertible_v<Key&&, const_iterator>)
     [[nodiscard]]
-    auto size() const {
-        return numElems;
+    std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+        return emplaceHelper(nullptr, std::forward<Key>(key), std::forward<Args>(args)...);
     }
 
-    void clear() {
-        root.reset();
-        numElems = 0;
+    /**
+     * @brief Insert @p key with @p value, or assign @p value to the existing element.
+     *
+     * @return The element for @p key, and true if it was newly inserted.
+     */
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(const K& key, M&& value) {
+        return insertOrAssignHelper(key, std::forward<M>(value));
     }
 
-private:
-    std::unique_ptr<Node> root;
-    size_t numElems{0};
+    template<typename M>
+    std::pair<iterator, bool> insert_or_assign(K&& key, M&& value) {
+        return insertOrAssignHelper(std::move(key), std::forward<M>(value));
+    }
 
-    template<typename Iter>
     [[nodiscard]]
-    auto beginHelper() const {
-        if(!root) {
-            return Iter{nullptr};
-        }
-        auto* tmp(root.get());
-        while(tmp->left) {
-            tmp = tmp->left.get();
-        }
-        return Iter{tmp};
+    bool erase(const K& key) {
+        return eraseHelper(key);
     }
 
+    template<typename Key>
+    requires (isTransparent && !std::is_convertible_v<Key, const_iterator>)
     [[nodiscard]]
-    std::pair<iterator, bool> insertHelper(const K& key, const V& value, std::unique_ptr<Node>& root, Node* parent = nullptr) {
-        if(root == nullptr) {
-            ++numElems;
-            root = std::make_unique<Node>(value_type{key, value}, parent);
-            return {iterator{root.get()}, true};
-        }
-        bool left;
-        if(Compare{}(key, root->value.first)) {
-            left = true;
-        } else if(Compare{}(root->value.first, key)) {
-            left = false;
-        } else {
-            // Values are equal
-            return {iterator{root.get()}, false};
-        }
-        const auto ret(insertHelper(key, value, left ? root->left : root->right, root.get()));
-        updateHeight(root.get());
-        rotate(root);
-        return ret;
+    bool erase(const Key& key) {
+        return eraseHelper(key);
     }
 
-    [[nodiscard]]
-    static int getHeight(const Node* const node) {
-        return node == nullptr ? -1 : node->height;
+    /**
+     * @brief Remove the element at @p i by unlinking its node in place.
+     *
+     * @return An iterator to the element that followed the erased one.
+     */
+    iterator erase(iterator i) {
+        return iteratorTo<iterator>(eraseNode(i.node));
+    }
+
+    iterator erase(const_iterator i) {
+        return iteratorTo<iterator>(eraseNode(const_cast<Node*>(i.node)));
     }
 
-    static void updateHeight(Node* const node) {
-        node->height = std::max(getHeight(node->left.get()), getHeight(node->right.get())) + 1;
+    /**
+     * @brief Take the element with @p key out of the tree, unlinking its node like erase()
+     *        does but handing it over instead of freeing it.
+     *
+     * @return A handle owning the node, which is empty if no element has @p key.
+     */
+    [[nodiscard]]
+    node_type extract(const K& key) {
+        return extractHelper(key);
     }
 
+    template<typename Key>
+    requires (isTransparent && !std::is_convertible_v<Key, const_iterator>)
     [[nodiscard]]
-    static int getBalanceFactor(const Node* const node) {
-        return node == nullptr ? 0 : getHeight(node->left.get()) - getHeight(node->right.get());
+    node_type extract(const Key& key) {
+        return extractHelper(key);
     }
 
     /**
-     * @brief Right rotate a left leaning tree rooted at @p oldRoot.
-     *
-     * @param oldRoot The root of a left leaning tree.
+     * @brief Take the element at @p i out of the tree, see extract(const K&).
      */
-    static void rotateRight(std::unique_ptr<Node>& oldRoot) {
-        auto newRoot(std::move(oldRoot->left));
-        auto* const parent(oldRoot->parent);
-        oldRoot->left = std::move(newRoot->right);
-        oldRoot->parent = newRoot.get();
-        newRoot->right = std::move(oldRoot);
-        newRoot->parent = parent;
-        updateHeight(newRoot->right.get());
-        updateHeight(newRoot.get());
-        oldRoot = std::move(newRoot);
+    [[nodiscard]]
+    node_type extract(const_iterator i) {
+        return extractNode(const_cast<Node*>(i.node));
     }
 
     /**
-     * @brief Left rotate a right leaning tree rooted at @p oldRoot.
-     *
-     * @param oldRoot The root of a right leaning tree.
+     * @brief The first element in key order, which the tree keeps track of so this takes
+     *        constant time.
      */
-    static void rotateLeft(std::unique_ptr<Node>& oldRoot) {
-        auto newRoot(std::move(oldRoot->right));
-        auto* const parent(oldRoot->parent);
-        oldRoot->right = std::move(newRoot->left);
-        oldRoot->parent = newRoot.get();
-        newRoot->left = std::move(oldRoot);
-        newRoot->parent = parent;
-        updateHeight(newRoot->left.get());
-        updateHeight(newRoot.get());
-        oldRoot = std::move(newRoot);
+    [[nodiscard]]
+    auto cbegin() const {
+        return iteratorTo<const_iterator>(leftmost);
+    }
+
+    [[nodiscard]]
+    auto begin() {
+        return iteratorTo<iterator>(leftmost);
+    }
+
+    [[nodiscard]]
+    auto begin() const {
+        return cbegin();
     }
 
     /**
-     * @brief Determine if a tree rooted at @p node is left
-     *        leaning or right leaning, and rotate as-needed.
-     *
-     * @param node The root of a tree that may require rotation.
+     * @brief Past the last element, decrementing it gives the last element in constant time.
      */
-    static void rotate(std::unique_ptr<Node>& node) {
-        const auto balanceFactor(getBalanceFactor(node.get()));
-        if(balanceFactor > 1) {
-            // Left leaning tree
-            if(getBalanceFactor(node->left.get()) < 0) {
-                rotateLeft(node->left);
-            }
-            rotateRight(node);
-        } else if(balanceFactor < -1) {
-            // Right leaning tree
-            if(getBalanceFactor(node->right.get()) > 0) {
-                rotateRight(node->right);
-            }
-            rotateLeft(node);
-        }
+    [[nodiscard]]
+    auto end() {
+        return iteratorTo<iterator>(&header);
     }
 
     [[nodiscard]]
-    bool eraseHelper(const K& key, std::unique_ptr<Node>& root) {
-        if(root == nullptr) {
-            return false;
-        }
-        if(Compare{}(key, root->value.first)) {
-            const auto wasErased(eraseHelper(key, root->left));
-            updateHeight(root.get());
-            rotate(root);
-            return wasErased;
-        }
-        if(Compare{}(root->value.first, key)) {
-            const auto wasErased(eraseHelper(key, root->right));
-            updateHeight(root.get());
-            rotate(root);
-            return wasErased;
-        }
-        // Values are equal, we're removing this node.
-        if(!root->left || !root->right) {
-            auto promoted(root->left != nullptr ? std::move(root->left) : std::move(root->right));
-            if(!promoted) {
-                // This node has no children, just delete it and then we're done.
-                root.reset();
-            } else {
-                promoted->parent = root->parent;
-                root = std::move(promoted);
-            }
-            --numElems;
-        } else {
-            // 2 valid children; both left and right
-            auto* tmp(root->right.get());
-            while(tmp->left) {
-                tmp = tmp->left.get();
-            }
-            root->value = tmp->value;
-            (void)eraseHelper(tmp->value.first, root->right);
-            updateHeight(root.get());
-            rotate(root);
-        }
-        return true;
+    auto end() const {
+        return cend();
     }
 
-    template<typename Iter>
     [[nodiscard]]
-    static Iter findHelper(const K& key, Node* root) {
-        if(root == nullptr) {
-            return Iter{nullptr};
-        }
-        if(Compare{}(key, root->value.first)) {
-            return findHelper<Iter>(key, root->left.get());
-        }
-        if(Compare{}(root->value.first, key)) {
-            return findHelper<Iter>(key, root->right.get());
+    auto cend() const {
+        return iteratorTo<const_iterator>(nullptr);
+    }
+
+    /**
+     * @brief Iterate in descending key order, starting from the last element.
+     */
+    [[nodiscard]]
+    auto rbegin() {
+        return reverse_iterator(end());
+    }
+
+    [[nodiscard]]
+    auto rend() {
+        return reverse_iterator(begin());
+    }
+
+    [[nodiscard]]
+    auto crbegin() const {
+        return const_reverse_iterator(cend());
+    }
+
+    [[nodiscard]]
+    auto crend() const {
+        return const_reverse_iterator(cbegin());
+    }
+
+    [[nodiscard]]
+    iterator find(const K& key) {
+        return findHelper<iterator>(key, root);
+    }
+
+    [[nodiscard]]
+    const_iterator find(const K& key) const {
+        return findHelper<const_iterator>(key, root);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    iterator find(const Key& key) {
+        return findHelper<iterator>(key, root);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator find(const Key& key) const {
+        return findHelper<const_iterator>(key, root);
+    }
+
+    /**
+     * @brief Find @p key by a finger search from @p hint.
+     *
+     * The search climbs from @p hint through the parent links until it reaches a subtree that
+     * must hold @p key, and only descends from there, so a key close to the hint in key order
+     * skips most of the walk from the root. An end() hint climbs from the last node.
+     */
+    [[nodiscard]]
+    iterator find(const_iterator hint, const K& key) {
+        return findHelper<iterator>(key, fingerStart(hint.node, key));
+    }
+
+    [[nodiscard]]
+    const_iterator find(const_iterator hint, const K& key) const {
+        return findHelper<const_iterator>(key, fingerStart(hint.node, key));
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    iterator find(const_iterator hint, const Key& key) {
+        return findHelper<iterator>(key, fingerStart(hint.node, key));
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator find(const_iterator hint, const Key& key) const {
+        return findHelper<const_iterator>(key, fingerStart(hint.node, key));
+    }
+
+    /**
+     * @brief The first element whose key is not less than @p key.
+     */
+    [[nodiscard]]
+    iterator lower_bound(const K& key) {
+        return lowerBoundHelper<iterator>(key, root);
+    }
+
+    [[nodiscard]]
+    const_iterator lower_bound(const K& key) const {
+        return lowerBoundHelper<const_iterator>(key, root);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    iterator lower_bound(const Key& key) {
+        return lowerBoundHelper<iterator>(key, root);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator lower_bound(const Key& key) const {
+        return lowerBoundHelper<const_iterator>(key, root);
+    }
+
+    /**
+     * @brief The first element whose key is greater than @p key.
+     */
+    [[nodiscard]]
+    iterator upper_bound(const K& key) {
+        return upperBoundHelper<iterator>(key, root);
+    }
+
+    [[nodiscard]]
+    const_iterator upper_bound(const K& key) const {
+        return upperBoundHelper<const_iterator>(key, root);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    iterator upper_bound(const Key& key) {
+        return upperBoundHelper<iterator>(key, root);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator upper_bound(const Key& key) const {
+        return upperBoundHelper<const_iterator>(key, root);
+    }
+
+    /**
+     * @brief The run of elements with a key equal to @p key, which holds at most one element.
+     */
+    [[nodiscard]]
+    std::pair<iterator, iterator> equal_range(const K& key) {
+        return equalRangeHelper<iterator>(key, root);
+    }
+
+    [[nodiscard]]
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+        return equalRangeHelper<const_iterator>(key, root);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    std::pair<iterator, iterator> equal_range(const Key& key) {
+        return equalRangeHelper<iterator>(key, root);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const {
+        return equalRangeHelper<const_iterator>(key, root);
+    }
+
+    /**
+     * @brief The elements with keys in the half open interval [@p low, @p high).
+     */
+    [[nodiscard]]
+    Range<iterator> range(const K& low, const K& high) {
+        return {lower_bound(low), lower_bound(high)};
+    }
+
+    [[nodiscard]]
+    Range<const_iterator> range(const K& low, const K& high) const {
+        return {lower_bound(low), lower_bound(high)};
+    }
+
+    template<typename Low, typename High>
+    requires isTransparent
+    [[nodiscard]]
+    Range<iterator> range(const Low& low, const High& high) {
+        return {lower_bound(low), lower_bound(high)};
+    }
+
+    template<typename Low, typename High>
+    requires isTransparent
+    [[nodiscard]]
+    Range<const_iterator> range(const Low& low, const High& high) const {
+        return {lower_bound(low), lower_bound(high)};
+    }
+
+    /**
+     * @brief Look up every key in @p keys, storing the element found for each, or end(),
+     *        at the same index of @p out.
+     *
+     * Groups of descents advance one level at a time in lockstep and prefetch the node each
+     * visits next, so their cache misses overlap instead of waiting on one another.
+     * @p out must be at least as long as @p keys.
+     */
+    void find_batch(std::span<const K> keys, std::span<iterator> out) {
+        findBatchHelper(keys, [&](const size_t index, Node* const node) {
+            out[index] = iteratorTo<iterator>(node);
+        });
+    }
+
+    void find_batch(std::span<const K> keys, std::span<const_iterator> out) const {
+        findBatchHelper(keys, [&](const size_t index, Node* const node) {
+            out[index] = iteratorTo<const_iterator>(node);
+        });
+    }
+
+    /**
+     * @brief Store whether each key in @p keys is in the tree at the same index of @p out.
+     *
+     * @return The number of keys that were found.
+     */
+    size_t contains_batch(std::span<const K> keys, std::span<bool> out) const {
+        size_t found(0);
+        findBatchHelper(keys, [&](const size_t index, const Node* const node) {
+            out[index] = node != nullptr;
+            found += node != nullptr ? 1 : 0;
+        });
+        return found;
+    }
+
+    /**
+     * @brief The element with @p index smaller elements before it, or end() if @p index is out of range.
+     */
+    [[nodiscard]]
+    iterator select(size_t index) requires orderStatistics {
+        return selectHelper<iterator>(index, root);
+    }
+
+    [[nodiscard]]
+    const_iterator select(size_t index) const requires orderStatistics {
+        return selectHelper<const_iterator>(index, root);
+    }
+
+    /**
+     * @brief The number of elements with a key less than @p key.
+     */
+    [[nodiscard]]
+    size_t rank(const K& key) const requires orderStatistics {
+        return rankHelper(key);
+    }
+
+    template<typename Key>
+    requires (orderStatistics && isTransparent)
+    [[nodiscard]]
+    size_t rank(const Key& key) const {
+        return rankHelper(key);
+    }
+
+    /**
+     * @brief The combination of every element in key order under AvlTreeOptions::Monoid, in O(1).
+     */
+    [[nodiscard]]
+    auto aggregate() const requires augmented {
+        return aggregateOf(root);
+    }
+
+    /**
+     * @brief The combination in key order of the elements with keys in the half open
+     *        interval [@p low, @p high) under AvlTreeOptions::Monoid, in O(log n).
+     */
+    [[nodiscard]]
+    auto aggregate(const K& low, const K& high) const requires augmented {
+        return aggregateHelper(low, high);
+    }
+
+    template<typename Low, typename High>
+    requires (augmented && isTransparent)
+    [[nodiscard]]
+    auto aggregate(const Low& low, const High& high) const {
+        return aggregateHelper(low, high);
+    }
+
+    /**
+     * @brief The number of elements with keys in the half open interval [@p low, @p high).
+     */
+    [[nodiscard]]
+    size_t count_range(const K& low, const K& high) const requires orderStatistics {
+        return countRangeHelper(low, high);
+    }
+
+    template<typename Low, typename High>
+    requires (orderStatistics && isTransparent)
+    [[nodiscard]]
+    size_t count_range(const Low& low, const High& high) const {
+        return countRangeHelper(low, high);
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return root == nullptr;
+    }
+
+    [[nodiscard]]
+    auto size() const {
+        return numElems;
+    }
+
+    /**
+     * @brief Replace the contents of the tree with the elements in [@p first, @p last)
+     *        in linear time.
+     *
+     * The input must be sorted by key in strictly increasing order. The result is
+     * perfectly balanced and its nodes are laid out contiguously in key order.
+     * If constructing an element throws, the tree is left empty.
+     */
+    template<std::forward_iterator Iter>
+    void assign_sorted(Iter first, Iter last) {
+        clear();
+        const auto count(static_cast<size_t>(std::distance(first, last)));
+        pool.reserve(count);
+        auto* const built(buildSorted(first, count));
+        threadOrder(built, &header);
+        setRoot({built, static_cast<int>(std::bit_width(count))});
+        numElems = count;
+    }
+
+    /**
+     * @brief Split the tree around @p key by relinking its nodes, leaving it empty.
+     *
+     * No element is copied or moved, so iterators remain valid in whichever half their
+     * element ends up in. This takes O(log n) time with order statistics enabled, without
+     * them the size of the smaller half is counted, which adds time linear in it. Both halves
+     * hold on to the node storage of the tree, which is given back once both are gone.
+     *
+     * @return A tree with every element whose key is less than @p key and a tree with the rest.
+     */
+    [[nodiscard]]
+    std::pair<AvlTree, AvlTree> split(const K& key) && {
+        return splitHelper(key);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    std::pair<AvlTree, AvlTree> split(const Key& key) && {
+        return splitHelper(key);
+    }
+
+    /**
+     * @brief Concatenate @p left and @p right in O(log n) by relinking their nodes.
+     *
+     * Every key in @p left must order before every key in @p right. The result takes over the
+     * elements and node storage of both, which is why their allocators must compare equal,
+     * and keeps the comparator of @p left.
+     */
+    [[nodiscard]]
+    static AvlTree join(AvlTree&& left, AvlTree&& right) {
+        left.pool.adopt(right.pool);
+        linkOrder(left.header.left, right.leftmost);
+        left.setRoot(left.concat(left.whole(), right.whole()));
+        left.numElems += std::exchange(right.numElems, 0);
+        right.setRoot({});
+        return std::move(left);
+    }
+
+    /**
+     * @brief Move every element of @p other into the tree by relinking its nodes, leaving
+     *        @p other empty.
+     *
+     * Where both trees hold a key the element of this tree is kept and the one of @p other
+     * is destroyed. Merging m elements into n, or n into m, for m <= n takes
+     * O(m log(n/m + 1)) time, and only O(log n) when the keys of one tree all order before
+     * those of the other. The allocators of both trees must compare equal.
+     */
+    void merge(AvlTree&& other) {
+        if(this == &other || other.empty()) {
+            return;
+        }
+        pool.adopt(other.pool);
+        (void) absorb(other.whole(), other.numElems, other.header);
+        other.setRoot({});
+        other.numElems = 0;
+    }
+
+    /**
+     * @brief Insert the elements in [@p first, @p last) whose key is not in the tree yet.
+     *
+     * The input must be sorted by key in strictly increasing order. It is built into a
+     * perfectly balanced tree of its own, with its nodes next to each other in memory, and
+     * merged in, so inserting m elements into n takes O(m log(n/m + 1)) time rather than
+     * O(m log n), and only O(log n) when the batch orders entirely before or after the tree.
+     * If constructing an element throws, the tree is left unchanged.
+     *
+     * @return The number of elements inserted.
+     */
+    template<std::forward_iterator Iter>
+    size_t insert_batch(Iter first, Iter last) {
+        const auto count(static_cast<size_t>(std::distance(first, last)));
+        if(count == 0) {
+            return 0;
+        }
+        pool.reserve(count);
+        auto* const batch(buildSorted(first, count));
+        // The batch is threaded onto a list of its own, which absorb() moves into that of the tree.
+        Node ends;
+        threadOrder(batch, &ends);
+        return absorb(Subtree{batch, static_cast<int>(std::bit_width(count))}, count, ends);
+    }
+
+    /**
+     * @brief The union of @p first and @p second, made by relinking their nodes.
+     *
+     * Where both trees hold a key the element of @p first is kept and the other destroyed.
+     * For trees of m and n elements, m <= n, this does O(m log(n/m + 1)) work, spread over
+     * up to about twice @p threads threads as the two halves of every divide and conquer
+     * step run in parallel. The comparator must be safe to call from several threads at
+     * once and the allocators of both trees must compare equal.
+     */
+    [[nodiscard]]
+    static AvlTree set_union(AvlTree&& first, AvlTree&& second,
+                             const unsigned threads = std::thread::hardware_concurrency()) {
+        return setOperation(std::move(first), std::move(second), threads, &AvlTree::uniteAt);
+    }
+
+    /**
+     * @brief The elements of @p first whose keys @p second holds too, made by relinking
+     *        nodes and destroying every other element, with the same cost as set_union().
+     */
+    [[nodiscard]]
+    static AvlTree set_intersection(AvlTree&& first, AvlTree&& second,
+                                    const unsigned threads = std::thread::hardware_concurrency()) {
+        return setOperation(std::move(first), std::move(second), threads, &AvlTree::intersectAt);
+    }
+
+    /**
+     * @brief The elements of @p first whose keys @p second does not hold, made by relinking
+     *        nodes and destroying every other element, with the same cost as set_union().
+     */
+    [[nodiscard]]
+    static AvlTree set_difference(AvlTree&& first, AvlTree&& second,
+                                  const unsigned threads = std::thread::hardware_concurrency()) {
+        return setOperation(std::move(first), std::move(second), threads, &AvlTree::subtractAt);
+    }
+
+    /**
+     * @brief Call @p function with every element, visiting the subtrees below the top levels
+     *        of the tree on up to about twice @p threads threads.
+     *
+     * Each subtree is visited in key order, but subtrees are visited at the same time, so
+     * @p function must be safe to call concurrently. It may modify values but not keys, the
+     * aggregates of an augmented tree are recomputed afterwards. If it throws, an exception
+     * is rethrown once every thread is done.
+     */
+    template<typename Function>
+    void parallel_for_each(const Function& function, const unsigned threads = std::thread::hardware_concurrency()) {
+        const auto forks(forksFor(threads));
+        try {
+            forEachIn(whole(), forks, [&](Node* const node) { function(node->value); });
+        } catch(...) {
+            // Values changed before the throw count as well.
+            updateIn(whole(), forks);
+            throw;
+        }
+        updateIn(whole(), forks);
+    }
+
+    template<typename Function>
+    void parallel_for_each(const Function& function, const unsigned threads = std::thread::hardware_concurrency()) const {
+        forEachIn(whole(), forksFor(threads), [&](const Node* const node) { function(std::as_const(node->value)); });
+    }
+
+    /**
+     * @brief Combine @p init and the result of @p map for every element with @p reduce, reducing
+     *        the subtrees below the top levels of the tree on up to about twice @p threads threads.
+     *
+     * Results are combined in key order, so @p reduce only needs to be associative, not
+     * commutative, and @p init is combined once, on the left. @p map and @p reduce must be
+     * safe to call concurrently.
+     *
+     * @return @p init for an empty tree, otherwise reduce(init, map(first) ... map(last)).
+     */
+    template<typename T, typename Map, typename Reduce>
+    [[nodiscard]]
+    T parallel_reduce(T init, const Map& map, const Reduce& reduce,
+                      const unsigned threads = std::thread::hardware_concurrency()) const {
+        if(root == nullptr) {
+            return init;
+        }
+        return reduce(std::move(init), reduceIn<T>(whole(), forksFor(threads), map, reduce));
+    }
+
+    /**
+     * @brief Remove every element, returning all node chunks to the allocator at once.
+     */
+    void clear() {
+        if constexpr(!std::is_trivially_destructible_v<value_type> ||
+                     !std::is_trivially_destructible_v<typename Monoid::value_type>) {
+            destroyValues(root);
+        }
+        pool.release();
+        record(&Counters::frees, numElems);
+        setRoot({});
+        numElems = 0;
+    }
+
+    [[nodiscard]]
+    allocator_type get_allocator() const {
+        return pool.get_allocator();
+    }
+
+    [[nodiscard]]
+    Compare key_comp() const {
+        return comp;
+    }
+
+    /**
+     * @brief A snapshot of the counters, taken one at a time, so changes made meanwhile
+     *        may be reflected in some of them and not in others.
+     */
+    [[nodiscard]]
+    AvlTreeStats stats() const requires collectStats {
+        const auto load([](const std::atomic<std::uint64_t>& counter) {
+            return counter.load(std::memory_order_relaxed);
+        });
+        AvlTreeStats snapshot;
+        snapshot.comparisons = load(counters.comparisons);
+        snapshot.rotations = load(counters.rotations);
+        snapshot.allocations = load(counters.allocations);
+        snapshot.frees = load(counters.frees);
+        std::ranges::transform(counters.descentDepths, snapshot.descentDepths.begin(), load);
+        std::ranges::transform(stepLengths, snapshot.stepLengths.begin(), load);
+        return snapshot;
+    }
+
+    friend void swap(AvlTree& lhs, AvlTree& rhs) noexcept(std::is_nothrow_swappable_v<Compare>) {
+        using std::swap;
+        swap(lhs.root, rhs.root);
+        swap(lhs.leftmost, rhs.leftmost);
+        swap(lhs.header.left, rhs.header.left);
+        swap(lhs.numElems, rhs.numElems);
+        swap(lhs.pool, rhs.pool);
+        swap(lhs.comp, rhs.comp);
+        lhs.reattach();
+        rhs.reattach();
+    }
+
+private:
+    // The node end() points at. The root hangs off it as if it were the parent, its left link
+    // points at the last node, or back at the header while the tree is empty, and its right link
+    // stays null. This way stepping forward from the last node and back from end() need no
+    // special cases.
+    Node header;
+    Node* root{nullptr};
+    // The first node, or the header while the tree is empty.
+    Node* leftmost{&header};
+    size_t numElems{0};
+    NodePool<Node, Allocator> pool;
+    // An empty comparator such as std::less takes up no space.
+    [[no_unique_address]] Compare comp;
+    // Updated by const lookups that may run at the same time and by the threads of set operations,
+    // none of which needs the counts ordered with anything else.
+    struct Counters {
+        std::atomic<std::uint64_t> comparisons{0};
+        std::atomic<std::uint64_t> rotations{0};
+        std::atomic<std::uint64_t> allocations{0};
+        std::atomic<std::uint64_t> frees{0};
+        std::array<std::atomic<std::uint64_t>, AvlTreeStats::depthBuckets> descentDepths{};
+
+        static void add(std::atomic<std::uint64_t>& counter, const std::uint64_t amount = 1) noexcept {
+            counter.fetch_add(amount, std::memory_order_relaxed);
+        }
+    };
+    using StepCounters = std::array<std::atomic<std::uint64_t>, AvlTreeStats::stepBuckets>;
+
+    // Belong to this tree object rather than to its elements, so moving or swapping trees leaves them behind.
+    [[no_unique_address]] mutable std::conditional_t<collectStats, Counters, Disabled> counters;
+    // An iterator stays valid as long as its element does, which a split, join, merge, swap, move
+    // or node handle may carry into another tree that outlives the one it came from. So rather
+    // than point back at the counters of a tree, iterators count their steps here.
+    static inline std::conditional_t<collectStats, StepCounters, Disabled> stepLengths{};
+
+    static void recordStep(const unsigned links) noexcept requires collectStats {
+        Counters::add(stepLengths[std::min<size_t>(std::bit_width(links) - 1, AvlTreeStats::stepBuckets - 1)]);
+    }
+
+    /**
+     * @brief An iterator to @p node, or end() if it is nullptr, which is how searches report a miss.
+     */
+    template<typename Iter>
+    [[nodiscard]]
+    Iter iteratorTo(Node* const node) const {
+        // The header is only ever modified through a non-const tree.
+        return Iter{node != nullptr ? node : const_cast<Node*>(&header)};
+    }
+
+    template<typename Lhs, typename Rhs>
+    [[nodiscard]]
+    bool less(const Lhs& lhs, const Rhs& rhs) const {
+        record(&Counters::comparisons);
+        return comp(lhs, rhs);
+    }
+
+    /**
+     * @brief The first eight bytes of @p key as a big endian integer, padded with zeros.
+     *
+     * Integers that differ order the same way as the keys they were taken from, as chars
+     * compare as unsigned char. Equal ones may belong to different keys, which are then
+     * compared in full.
+     */
+    template<typename Key>
+    [[nodiscard]]
+    static Prefix prefixOf(const Key& key) noexcept {
+        if constexpr(hasPrefix<Key>) {
+            const std::string_view view(key);
+            std::array<unsigned char, sizeof(std::uint64_t)> bytes{};
+            std::memcpy(bytes.data(), view.data(), std::min(view.size(), bytes.size()));
+            std::uint64_t prefix(0);
+            for(const auto byte : bytes) {
+                prefix = prefix << (sizeof(byte) * CHAR_BIT) | byte;
+            }
+            return prefix;
+        } else {
+            return {};
+        }
+    }
+
+    /**
+     * @brief How @p key orders against the key of @p node, @p prefix being prefixOf(key).
+     *
+     * A single comparison tells apart keys in the default order, any other comparator is asked both ways.
+     */
+    template<typename Key>
+    [[nodiscard]]
+    std::weak_ordering order(const Key& key, const Prefix prefix, const Node* const node) const {
+        if constexpr(hasPrefix<Key>) {
+            if(prefix != node->prefix) {
+                return prefix < node->prefix ? std::weak_ordering::less : std::weak_ordering::greater;
+            }
+        }
+        if constexpr(isThreeWay<Key>) {
+            record(&Counters::comparisons);
+            return std::compare_three_way{}(key, node->value.first);
+        } else {
+            if(less(key, node->value.first)) {
+                return std::weak_ordering::less;
+            }
+            return less(node->value.first, key) ? std::weak_ordering::greater : std::weak_ordering::equivalent;
+        }
+    }
+
+    void record(std::atomic<std::uint64_t> Counters::* const counter, const std::uint64_t amount = 1) const noexcept {
+        if constexpr(collectStats) {
+            Counters::add(counters.*counter, amount);
+        }
+    }
+
+    /**
+     * @brief Count a descent that visited @p depth nodes before it stopped.
+     */
+    void recordDescent(const size_t depth) const noexcept {
+        if constexpr(collectStats) {
+            Counters::add(counters.descentDepths[std::min(depth, AvlTreeStats::depthBuckets - 1)]);
+        }
+    }
+
+    template<typename... Args>
+    [[nodiscard]]
+    Node* createNode(Node* const parent, Args&&... args) {
+        auto* const node(pool.create(parent, std::forward<Args>(args)...));
+        record(&Counters::allocations);
+        return node;
+    }
+
+    /**
+     * @brief Hang the root off the header, or reset the ends of the tree if it is empty.
+     */
+    void reattach() noexcept {
+        if(root != nullptr) {
+            setParent(root, &header);
+        } else {
+            leftmost = header.left = &header;
+        }
+        // Inside the list every link is already right, only the ends can still be those of another tree.
+        linkOrder(&header, leftmost);
+        linkOrder(header.left, &header);
+    }
+
+    /**
+     * @brief Take over the first and last node of @p other, whose root was just moved here.
+     */
+    void takeEnds(AvlTree& other) noexcept {
+        leftmost = other.leftmost;
+        header.left = other.header.left;
+        reattach();
+        other.reattach();
+    }
+
+    void destroyNode(Node* const node) noexcept {
+        node->destroyElement();
+        pool.deallocate(node);
+        record(&Counters::frees);
+    }
+
+    /**
+     * @brief Build a perfectly balanced tree out of the next @p count elements at @p first.
+     *
+     * Nodes are created in key order, so a contiguous supply of storage
+     * from the pool puts them next to each other in memory.
+     */
+    template<typename Iter>
+    [[nodiscard]]
+    Node* buildSorted(Iter& first, const size_t count) {
+        if(count == 0) {
+            return nullptr;
+        }
+        const auto leftCount((count - 1) / 2);
+        auto* const left(buildSorted(first, leftCount));
+        Node* node;
+        try {
+            node = createNode(nullptr, *first);
+        } catch(...) {
+            destroySubtree(left);
+            throw;
+        }
+        ++first;
+        node->left = left;
+        if(left) {
+            setParent(left, node);
+        }
+        try {
+            node->right = buildSorted(first, count - leftCount - 1);
+        } catch(...) {
+            destroySubtree(node);
+            throw;
+        }
+        if(node->right) {
+            setParent(node->right, node);
+        }
+        // A perfectly balanced subtree of n nodes is bit_width(n) levels tall.
+        setBalance(node, std::bit_width(leftCount) - std::bit_width(count - leftCount - 1));
+        updateSubtree(node);
+        return node;
+    }
+
+    /**
+     * @brief Destroy and free every node of the tree rooted at @p node.
+     */
+    void destroySubtree(Node* node) noexcept {
+        // Stop at the parent of the subtree, which may be a node still under construction.
+        auto* const stop(node != nullptr ? parentOf(node) : nullptr);
+        while(node != stop) {
+            if(node->left) {
+                node = std::exchange(node->left, nullptr);
+            } else if(node->right) {
+                node = std::exchange(node->right, nullptr);
+            } else {
+                destroyNode(std::exchange(node, parentOf(node)));
+            }
+        }
+    }
+
+    /**
+     * @brief Run the destructor of every element in the tree rooted at @p node without
+     *        freeing any nodes, their storage is reclaimed in bulk by the pool.
+     */
+    static void destroyValues(Node* node) noexcept {
+        // Post-order walk over the parent links, unhooking children
+        // as they are visited so no stack is needed.
+        auto* const stop(node != nullptr ? parentOf(node) : nullptr);
+        while(node != stop) {
+            if(node->left) {
+                node = std::exchange(node->left, nullptr);
+            } else if(node->right) {
+                node = std::exchange(node->right, nullptr);
+            } else {
+                auto* const parent(parentOf(node));
+                node->destroyElement();
+                node = parent;
+            }
+        }
+    }
+
+    template<typename... Args>
+    [[nodiscard]]
+    static constexpr bool isKeyAndValue() {
+        if constexpr(sizeof...(Args) == 2) {
+            return isKey<std::tuple_element_t<0, std::tuple<Args...>>>;
+        }
+        return false;
+    }
+
+    template<typename... Args>
+    [[nodiscard]]
+    static constexpr bool isPairWithKey() {
+        if constexpr(sizeof...(Args) == 1) {
+            using Pair = std::remove_cvref_t<std::tuple_element_t<0, std::tuple<Args...>>>;
+            if constexpr(requires { typename Pair::first_type; typename Pair::second_type; }) {
+                return isKey<typename Pair::first_type>;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Find where @p key belongs in the tree.
+     *
+     * @return The parent of the position and the child pointer for it, which
+     *         points at the element with an equal key if there is one.
+     */
+    template<typename Key>
+    [[nodiscard]]
+    std::pair<Node*, Node**> findInsertPosition(const Key& key) {
+        return findInsertPosition(key, &header, &root);
+    }
+
+    /**
+     * @brief Find where @p key belongs in the subtree at @p link, whose root has @p parent.
+     */
+    template<typename Key>
+    [[nodiscard]]
+    std::pair<Node*, Node**> findInsertPosition(const Key& key, Node* parent, Node** link) {
+        const auto prefix(prefixOf(key));
+        size_t depth(0);
+        for(; *link != nullptr; ++depth) {
+            const auto side(order(key, prefix, *link));
+            if(side < 0) {
+                parent = *link;
+                link = &parent->left;
+            } else if(side > 0) {
+                parent = *link;
+                link = &parent->right;
+            } else {
+                // Values are equal
+                ++depth;
+                break;
+            }
+        }
+        recordDescent(depth);
+        return {parent, link};
+    }
+
+    /**
+     * @brief Find where @p key belongs in the tree, starting from @p hint unless it is nullptr.
+     *
+     * Between @p hint and its neighbour on the side of @p key there is a free child pointer,
+     * so a key that falls there is placed without searching. An end() hint neighbours the
+     * last node.
+     */
+    template<typename Key>
+    [[nodiscard]]
+    std::pair<Node*, Node**> findInsertPosition(const Node* const hint, const Key& key) {
+        if(hint == nullptr || root == nullptr) {
+            return findInsertPosition(key);
+        }
+        auto* const node(const_cast<Node*>(hint));
+        if(node == &header || less(key, node->value.first)) {
+            // Stepping back from the first node would climb past the root.
+            auto* const before(node == leftmost ? &header : step<false>(node));
+            if(before == &header || less(before->value.first, key)) {
+                return node->left == nullptr ? std::pair(node, &node->left) : std::pair(before, &before->right);
+            }
+        } else if(less(node->value.first, key)) {
+            auto* const after(step<true>(node));
+            if(after == &header || less(key, after->value.first)) {
+                return node->right == nullptr ? std::pair(node, &node->right) : std::pair(after, &after->left);
+            }
+        } else {
+            return {parentOf(node), &linkTo(node)};
+        }
+        auto* const from(fingerStart(hint, key));
+        return findInsertPosition(key, parentOf(from), &linkTo(from));
+    }
+
+    /**
+     * @brief The root of a subtree around @p hint that holds @p key or the place it belongs,
+     *        or the root of the tree if @p hint is nullptr.
+     *
+     * Climbing out of a left subtree passes a key greater than everything in it, and climbing
+     * out of a right subtree one less than everything in it. The first such key on the far side
+     * of @p key from the hint bounds the subtree just climbed out of, so the climb ends there.
+     * An end() hint climbs from the last node.
+     */
+    template<typename Key>
+    [[nodiscard]]
+    Node* fingerStart(const Node* const hint, const Key& key) const {
+        if(hint == nullptr || root == nullptr) {
+            return root;
+        }
+        auto* node(const_cast<Node*>(hint == &header ? header.left : hint));
+        const bool after(less(node->value.first, key));
+        if(!after && !less(key, node->value.first)) {
+            return node;
+        }
+        for(auto* parent(parentOf(node)); parent != &header; node = std::exchange(parent, parentOf(parent))) {
+            if(after != (node == parent->left)) {
+                continue;
+            }
+            const auto& bound(parent->value.first);
+            if(after ? less(key, bound) : less(bound, key)) {
+                return node;
+            }
+            if(after ? !less(bound, key) : !less(key, bound)) {
+                return parent;
+            }
+        }
+        return node;
+    }
+
+    /**
+     * @brief The node after @p node in key order if @p forward, otherwise the one before it.
+     *
+     * Stepping forward from the last node ends at the header, and stepping back from the header
+     * at the last node. Stepping back from the first node is not allowed, it climbs past the root.
+     */
+    template<bool forward, typename N>
+    [[nodiscard]]
+    static N* stepFrom(N* node) {
+        unsigned links;
+        return stepFrom<forward>(node, links);
+    }
+
+    /**
+     * @brief Like stepFrom(), also counting the links followed into @p links.
+     */
+    template<bool forward, typename N>
+    [[nodiscard]]
+    static N* stepFrom(N* node, unsigned& links) {
+        constexpr auto ahead(forward ? &Node::right : &Node::left);
+        constexpr auto behind(forward ? &Node::left : &Node::right);
+        links = 1;
+        if(node->*ahead != nullptr) {
+            for(node = node->*ahead; node->*behind != nullptr; node = node->*behind) {
+                ++links;
+            }
+            return node;
+        }
+        auto* parent(parentOf(node));
+        while(node == parent->*ahead) {
+            node = std::exchange(parent, parentOf(parent));
+            ++links;
+        }
+        return parent;
+    }
+
+    /**
+     * @brief Like stepFrom(), but through the list of nodes in key order when the tree keeps one.
+     */
+    template<bool forward, typename N>
+    [[nodiscard]]
+    static N* step(N* node) {
+        if constexpr(linkedNodes) {
+            return forward ? node->order.next : node->order.prev;
+        } else {
+            return stepFrom<forward>(node);
+        }
+    }
+
+    template<bool forward, typename N>
+    [[nodiscard]]
+    static N* step(N* node, unsigned& links) {
+        if constexpr(linkedNodes) {
+            links = 1;
+            return forward ? node->order.next : node->order.prev;
+        } else {
+            return stepFrom<forward>(node, links);
+        }
+    }
+
+    /**
+     * @brief Make @p after follow @p before in the list of nodes in key order, if there is one.
+     */
+    static void linkOrder(Node* const before, Node* const after) noexcept {
+        if constexpr(linkedNodes) {
+            before->order.next = after;
+            after->order.prev = before;
+        }
+    }
+
+    static void unlinkOrder(Node* const node) noexcept {
+        if constexpr(linkedNodes) {
+            linkOrder(node->order.prev, node->order.next);
+        }
+    }
+
+    /**
+     * @brief Link the nodes of the detached tree rooted at @p root into a list in key order
+     *        that starts and ends at @p ends.
+     */
+    static void threadOrder(Node* const root, Node* const ends) noexcept {
+        if constexpr(linkedNodes) {
+            if(root == nullptr) {
+                linkOrder(ends, ends);
+                return;
+            }
+            const auto [first, last](threadSubtree(root));
+            linkOrder(ends, first);
+            linkOrder(last, ends);
+        }
+    }
+
+    /**
+     * @brief Link the nodes of the non-empty subtree at @p root into a list in key order.
+     *
+     * @return The first and the last node of the list, whose outer links are left as they were.
+     */
+    static std::pair<Node*, Node*> threadSubtree(Node* const root) noexcept {
+        // Stepping forward from the last node would climb past the root.
+        auto* const last(maxOf(root));
+        auto* const first(minOf(root));
+        for(auto* node(first); node != last;) {
+            auto* const next(stepFrom<true>(node));
+            linkOrder(node, next);
+            node = next;
+        }
+        return {first, last};
+    }
+
+    iterator linkNewNode(Node* const parent, Node*& link, Node* const node) {
+        if constexpr(linkedNodes) {
+            // A new leaf sits right before its parent if it is a left child and right after it otherwise.
+            if(&link == &parent->left) {
+                linkOrder(parent->order.prev, node);
+                linkOrder(node, parent);
+            } else {
+                linkOrder(node, parent->order.next);
+                linkOrder(parent, node);
+            }
+        }
+        if(parent == &header) {
+            leftmost = header.left = node;
+        } else if(&link == &leftmost->left) {
+            leftmost = node;
+        } else if(&link == &header.left->right) {
+            header.left = node;
+        }
+        link = node;
+        ++numElems;
+        if constexpr(augmented) {
+            // Every ancestor gains an element, even above where rebalancing stops.
+            updateAncestors(node);
+        } else if constexpr(orderStatistics) {
+            node->size = 1;
+            for(auto* ancestor(parent); ancestor != &header; ancestor = parentOf(ancestor)) {
+                ++ancestor->size;
+            }
+        }
+        rebalanceAfterInsert(node);
+        return iteratorTo<iterator>(node);
+    }
+
+    template<typename... Args>
+    [[nodiscard]]
+    std::pair<iterator, bool> emplaceNear(const Node* const hint, Args&&... args) {
+        if constexpr(isKeyAndValue<Args...>()) {
+            return emplaceHelper(hint, std::forward<Args>(args)...);
+        } else if constexpr(isPairWithKey<Args...>()) {
+            return emplacePair(hint, std::forward<Args>(args)...);
+        } else {
+            auto* const node(createNode(nullptr, std::forward<Args>(args)...));
+            const auto [parent, link](findInsertPosition(hint, node->value.first));
+            if(*link != nullptr) {
+                destroyNode(node);
+                return {iteratorTo<iterator>(*link), false};
+            }
+            setParent(node, parent);
+            return {linkNewNode(parent, *link, node), true};
+        }
+    }
+
+    template<typename Key, typename... Args>
+    [[nodiscard]]
+    std::pair<iterator, bool> emplaceHelper(const Node* const hint, Key&& key, Args&&... args) {
+        const auto [parent, link](findInsertPosition(hint, key));
+        if(*link != nullptr) {
+            return {iteratorTo<iterator>(*link), false};
+        }
+        auto* const node(createNode(parent, std::piecewise_construct,
+                                    std::forward_as_tuple(std::forward<Key>(key)),
+                                    std::forward_as_tuple(std::forward<Args>(args)...)));
+        return {linkNewNode(parent, *link, node), true};
+    }
+
+    template<typename Pair>
+    [[nodiscard]]
+    std::pair<iterator, bool> emplacePair(const Node* const hint, Pair&& pair) {
+        return emplaceHelper(hint, std::forward<Pair>(pair).first, std::forward<Pair>(pair).second);
+    }
+
+    /**
+     * @brief Link the node of @p handle into the tree, taking it out of @p handle only if it was inserted.
+     */
+    [[nodiscard]]
+    std::pair<iterator, bool> insertNode(const Node* const hint, node_type& handle) {
+        if(handle.empty()) {
+            return {end(), false};
+        }
+        auto* const node(handle.node);
+        const auto [parent, link](findInsertPosition(hint, node->value.first));
+        if(*link != nullptr) {
+            return {iteratorTo<iterator>(*link), false};
+        }
+        // The tree may reuse the slot of the node once it is erased, so it needs the chunk as well.
+        pool.adopt(handle.pool);
+        handle.node = nullptr;
+        if constexpr(cacheKeyPrefix) {
+            node->prefix = prefixOf(node->value.first);
+        }
+        setParent(node, parent);
+        return {linkNewNode(parent, *link, node), true};
+    }
+
+    template<typename Key, typename M>
+    std::pair<iterator, bool> insertOrAssignHelper(Key&& key, M&& value) {
+        const auto [parent, link](findInsertPosition(key));
+        if(*link != nullptr) {
+            (*link)->value.second = std::forward<M>(value);
+            updateAncestors(*link);
+            return {iteratorTo<iterator>(*link), false};
+        }
+        auto* const node(createNode(parent, std::forward<Key>(key), std::forward<M>(value)));
+        return {linkNewNode(parent, *link, node), true};
+    }
+
+    /**
+     * @brief The pointer that owns @p node, either a child pointer of its parent or the root.
+     */
+    [[nodiscard]]
+    Node*& linkTo(const Node* const node) {
+        auto* const parent(parentOf(node));
+        if(parent == &header) {
+            return root;
+        }
+        return node == parent->left ? parent->left : parent->right;
+    }
+
+    /**
+     * @brief Restore balance on the path from @p node up to the root after it was linked
+     *        into the tree as a new leaf.
+     */
+    void rebalanceAfterInsert(Node* node) {
+        for(auto* parent(parentOf(node)); parent != &header; node = parent, parent = parentOf(node)) {
+            const auto balance(balanceOf(parent) + (node == parent->left ? 1 : -1));
+            if(balance == 0) {
+                // The shorter side caught up, the height of the subtree is unchanged.
+                setBalance(parent, 0);
+                return;
+            }
+            if(balance == 2 || balance == -2) {
+                // The single or double rotation brings this subtree back to the height it
+                // had before the insert, so nothing above it needs to change.
+                (void) rotate(linkTo(parent), balance);
+                return;
+            }
+            setBalance(parent, balance);
+        }
+    }
+
+    /**
+     * @brief Restore balance on the path from @p node up to the root after one of
+     *        its subtrees shrank by a level.
+     *
+     * @param node The parent of an unlinked node.
+     * @param leftShrank Whether it was the left subtree of @p node that shrank.
+     */
+    void rebalanceAfterErase(Node* node, bool leftShrank) {
+        while(node != &header) {
+            auto* const parent(parentOf(node));
+            const auto parentLeftShrinks(parent != &header && node == parent->left);
+            const auto balance(balanceOf(node) + (leftShrank ? -1 : 1));
+            if(balance == 1 || balance == -1) {
+                // The subtree was even, its taller side still sets its height.
+                setBalance(node, balance);
+                return;
+            }
+            // Unlike an insert, a rotation here can leave the subtree
+            // shorter, so keep walking until a height holds steady.
+            if(balance == 0) {
+                setBalance(node, 0);
+            } else if(!rotate(linkTo(node), balance)) {
+                return;
+            }
+            node = parent;
+            leftShrank = parentLeftShrinks;
+        }
+    }
+
+    [[nodiscard]]
+    static size_t getSize(const Node* const node) requires orderStatistics {
+        return node == nullptr ? 0 : node->size;
+    }
+
+    [[nodiscard]]
+    static auto aggregateOf(const Node* const node) requires augmented {
+        return node == nullptr ? Monoid::identity() : node->aggregate;
+    }
+
+    [[nodiscard]]
+    static auto lift(const Node* const node) requires augmented {
+        return Monoid::lift(std::as_const(node->value.first), std::as_const(node->value.second));
+    }
+
+    /**
+     * @brief Recompute what @p node keeps about its subtree from what its children keep.
+     */
+    static void updateSubtree(Node* const node) {
+        if constexpr(orderStatistics) {
+            node->size = getSize(node->left) + getSize(node->right) + 1;
+        }
+        if constexpr(augmented) {
+            node->aggregate = Monoid::combine(Monoid::combine(aggregateOf(node->left), lift(node)),
+                                              aggregateOf(node->right));
+        }
+    }
+
+    /**
+     * @brief Recompute the aggregates of @p node and every ancestor, after its subtree changed.
+     */
+    void updateAncestors(Node* node) {
+        if constexpr(augmented) {
+            for(; node != &header; node = parentOf(node)) {
+                updateSubtree(node);
+            }
+        }
+    }
+
+    /**
+     * @brief Right rotate a left leaning tree rooted at @p oldRoot, leaving balance factors to the caller.
+     *
+     * @param oldRoot The root of a left leaning tree.
+     */
+    void rotateRight(Node*& oldRoot) const {
+        auto* const newRoot(oldRoot->left);
+        auto* const parent(parentOf(oldRoot));
+        oldRoot->left = newRoot->right;
+        if(oldRoot->left) {
+            setParent(oldRoot->left, oldRoot);
+        }
+        setParent(oldRoot, newRoot);
+        newRoot->right = oldRoot;
+        setParent(newRoot, parent);
+        updateSubtree(newRoot->right);
+        updateSubtree(newRoot);
+        oldRoot = newRoot;
+        record(&Counters::rotations);
+    }
+
+    /**
+     * @brief Left rotate a right leaning tree rooted at @p oldRoot, leaving balance factors to the caller.
+     *
+     * @param oldRoot The root of a right leaning tree.
+     */
+    void rotateLeft(Node*& oldRoot) const {
+        auto* const newRoot(oldRoot->right);
+        auto* const parent(parentOf(oldRoot));
+        oldRoot->right = newRoot->left;
+        if(oldRoot->right) {
+            setParent(oldRoot->right, oldRoot);
+        }
+        setParent(oldRoot, newRoot);
+        newRoot->left = oldRoot;
+        setParent(newRoot, parent);
+        updateSubtree(newRoot->left);
+        updateSubtree(newRoot);
+        oldRoot = newRoot;
+        record(&Counters::rotations);
+    }
+
+    /**
+     * @brief Rebalance the tree rooted at @p node with a single or double rotation.
+     *
+     * @param node The root of a tree whose subtrees differ in height by two levels.
+     * @param balance The balance factor of @p node, 2 if it leans left and -2 if it leans right.
+     *                It is passed in because it does not fit the packed representation.
+     * @return Whether the tree ended up a level shorter, which is only false when
+     *         the taller child of @p node was itself balanced.
+     */
+    bool rotate(Node*& node, const int balance) const {
+        auto* const oldRoot(node);
+        if(balance > 0) {
+            // Left leaning tree
+            auto* const left(oldRoot->left);
+            const auto leftBalance(balanceOf(left));
+            if(leftBalance >= 0) {
+                rotateRight(node);
+                setBalance(oldRoot, 1 - leftBalance);
+                setBalance(left, leftBalance - 1);
+                return leftBalance != 0;
+            }
+            auto* const pivot(left->right);
+            const auto pivotBalance(balanceOf(pivot));
+            rotateLeft(oldRoot->left);
+            rotateRight(node);
+            setBalance(left, pivotBalance < 0 ? 1 : 0);
+            setBalance(oldRoot, pivotBalance > 0 ? -1 : 0);
+            setBalance(pivot, 0);
+            return true;
+        }
+        // Right leaning tree
+        auto* const right(oldRoot->right);
+        const auto rightBalance(balanceOf(right));
+        if(rightBalance <= 0) {
+            rotateLeft(node);
+            setBalance(oldRoot, -1 - rightBalance);
+            setBalance(right, rightBalance + 1);
+            return rightBalance != 0;
+        }
+        auto* const pivot(right->left);
+        const auto pivotBalance(balanceOf(pivot));
+        rotateRight(oldRoot->right);
+        rotateLeft(node);
+        setBalance(right, pivotBalance > 0 ? -1 : 0);
+        setBalance(oldRoot, pivotBalance < 0 ? 1 : 0);
+        setBalance(pivot, 0);
+        return true;
+    }
+
+    // A subtree detached from any parent along with its height, which split and join keep
+    // track of as they go rather than walk down to find.
+    struct Subtree {
+        Node* root;
+        int height;
+    };
+
+    [[nodiscard]]
+    Subtree whole() const {
+        int height(0);
+        // The taller child of every node is on the longest path down.
+        for(const auto* node(root); node != nullptr; node = balanceOf(node) < 0 ? node->right : node->left) {
+            ++height;
+        }
+        return {root, height};
+    }
+
+    void setRoot(const Subtree tree) {
+        root = tree.root;
+        if(root != nullptr) {
+            leftmost = minOf(root);
+            header.left = maxOf(root);
+        }
+        reattach();
+    }
+
+    [[nodiscard]]
+    static Subtree leftOf(const Subtree tree) {
+        return {tree.root->left, tree.height - (balanceOf(tree.root) < 0 ? 2 : 1)};
+    }
+
+    [[nodiscard]]
+    static Subtree rightOf(const Subtree tree) {
+        return {tree.root->right, tree.height - (balanceOf(tree.root) > 0 ? 2 : 1)};
+    }
+
+    template<typename N>
+    [[nodiscard]]
+    static N* minOf(N* node) {
+        while(node->left) {
+            node = node->left;
+        }
+        return node;
+    }
+
+    template<typename N>
+    [[nodiscard]]
+    static N* maxOf(N* node) {
+        while(node->right) {
+            node = node->right;
+        }
+        return node;
+    }
+
+    /**
+     * @brief Make @p mid the root of a tree with subtrees @p left and @p right, which differ
+     *        in height by a level at most.
+     */
+    [[nodiscard]]
+    static Subtree attach(const Subtree left, Node* const mid, const Subtree right) {
+        mid->left = left.root;
+        if(left.root) {
+            setParent(left.root, mid);
+        }
+        mid->right = right.root;
+        if(right.root) {
+            setParent(right.root, mid);
+        }
+        setBalance(mid, left.height - right.height);
+        updateSubtree(mid);
+        return {mid, std::max(left.height, right.height) + 1};
+    }
+
+    /**
+     * @brief Join @p mid and @p right onto the right spine of @p left, which is taller by
+     *        two levels or more.
+     */
+    [[nodiscard]]
+    Subtree joinRight(const Subtree left, Node* const mid, const Subtree right) const {
+        auto* node(left.root);
+        const auto leftChild(leftOf(left));
+        auto rightChild(rightOf(left));
+        rightChild = rightChild.height <= right.height + 1 ? attach(rightChild, mid, right)
+                                                            : joinRight(rightChild, mid, right);
+        node->right = rightChild.root;
+        setParent(rightChild.root, node);
+        const auto balance(leftChild.height - rightChild.height);
+        if(balance >= -1) {
+            setBalance(node, balance);
+            updateSubtree(node);
+            return {node, std::max(leftChild.height, rightChild.height) + 1};
+        }
+        // The spine grew by a level at most, which a single or double rotation makes up for.
+        const auto shorter(rotate(node, balance));
+        return {node, rightChild.height + (shorter ? 0 : 1)};
+    }
+
+    /**
+     * @brief Join @p left and @p mid onto the left spine of @p right, which is taller by
+     *        two levels or more.
+     */
+    [[nodiscard]]
+    Subtree joinLeft(const Subtree left, Node* const mid, const Subtree right) const {
+        auto* node(right.root);
+        const auto rightChild(rightOf(right));
+        auto leftChild(leftOf(right));
+        leftChild = leftChild.height <= left.height + 1 ? attach(left, mid, leftChild)
+                                                         : joinLeft(left, mid, leftChild);
+        node->left = leftChild.root;
+        setParent(leftChild.root, node);
+        const auto balance(leftChild.height - rightChild.height);
+        if(balance <= 1) {
+            setBalance(node, balance);
+            updateSubtree(node);
+            return {node, std::max(leftChild.height, rightChild.height) + 1};
+        }
+        const auto shorter(rotate(node, balance));
+        return {node, leftChild.height + (shorter ? 0 : 1)};
+    }
+
+    /**
+     * @brief Join @p left, @p mid and @p right, which must be in key order, into a single
+     *        tree in time proportional to the difference in height of @p left and @p right.
+     */
+    [[nodiscard]]
+    Subtree joinAt(const Subtree left, Node* const mid, const Subtree right) const {
+        Subtree joined;
+        if(left.height > right.height + 1) {
+            joined = joinRight(left, mid, right);
+        } else if(right.height > left.height + 1) {
+            joined = joinLeft(left, mid, right);
+        } else {
+            joined = attach(left, mid, right);
+        }
+        setParent(joined.root, nullptr);
+        return joined;
+    }
+
+    /**
+     * @brief Unlink the leftmost node of @p tree, storing it in @p min.
+     *
+     * @return What remains of the tree.
+     */
+    [[nodiscard]]
+    Subtree removeMin(const Subtree tree, Node*& min) const {
+        if(tree.root->left == nullptr) {
+            min = tree.root;
+            const auto right(rightOf(tree));
+            if(right.root) {
+                setParent(right.root, nullptr);
+            }
+            return right;
+        }
+        const auto left(removeMin(leftOf(tree), min));
+        return joinAt(left, tree.root, rightOf(tree));
+    }
+
+    /**
+     * @brief Concatenate @p left and @p right, every key of which orders after those of @p left.
+     */
+    [[nodiscard]]
+    Subtree concat(const Subtree left, const Subtree right) const {
+        if(right.root == nullptr) {
+            return left;
+        }
+        Node* mid;
+        const auto rest(removeMin(right, mid));
+        return joinAt(left, mid, rest);
+    }
+
+    /**
+     * @brief Split @p tree into the nodes with keys less than @p key, the node with an equal
+     *        key if there is one and the nodes with greater keys, in O(log n).
+     */
+    template<typename Key>
+    void splitAt(const Subtree tree, const Key& key, Subtree& lesser, Node*& match, Subtree& greater) const {
+        if(tree.root == nullptr) {
+            lesser = greater = Subtree{nullptr, 0};
+            match = nullptr;
+            return;
+        }
+        auto* const node(tree.root);
+        const auto side(order(key, prefixOf(key), node));
+        if(side < 0) {
+            splitAt(leftOf(tree), key, lesser, match, greater);
+            greater = joinAt(greater, node, rightOf(tree));
+        } else if(side > 0) {
+            splitAt(rightOf(tree), key, lesser, match, greater);
+            lesser = joinAt(leftOf(tree), node, lesser);
+        } else {
+            lesser = leftOf(tree);
+            greater = rightOf(tree);
+            match = node;
+            for(auto* const child : {lesser.root, greater.root}) {
+                if(child) {
+                    setParent(child, nullptr);
+                }
+            }
+        }
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    std::pair<AvlTree, AvlTree> splitHelper(const Key& key) {
+        std::pair<AvlTree, AvlTree> halves(AvlTree(comp, get_allocator()), AvlTree(comp, get_allocator()));
+        halves.second.pool = pool.share();
+        halves.first.pool = std::move(pool);
+        Subtree less;
+        Node* match;
+        Subtree greater;
+        splitAt(whole(), key, less, match, greater);
+        if(match != nullptr) {
+            greater = joinAt(Subtree{nullptr, 0}, match, greater);
+        }
+        halves.first.setRoot(less);
+        halves.second.setRoot(greater);
+        if constexpr(orderStatistics) {
+            halves.first.numElems = getSize(less.root);
+        } else {
+            halves.first.numElems = countFirst(halves.first, halves.second, numElems);
+        }
+        halves.second.numElems = numElems - halves.first.numElems;
+        setRoot({});
+        numElems = 0;
+        return halves;
+    }
+
+    /**
+     * @brief The number of elements in @p first, given that it and @p second hold @p total,
+     *        in time linear in the smaller of the two.
+     */
+    [[nodiscard]]
+    static size_t countFirst(const AvlTree& first, const AvlTree& second, const size_t total) {
+        auto firstIter(first.cbegin());
+        auto secondIter(second.cbegin());
+        size_t count(0);
+        // Walk both in lockstep until the smaller one runs out.
+        while(firstIter != first.cend() && secondIter != second.cend()) {
+            ++firstIter;
+            ++secondIter;
+            ++count;
+        }
+        return firstIter == first.cend() ? count : total - count;
+    }
+
+    // Subtrees of at least this height are worth handing to another thread.
+    static constexpr int minForkHeight{12};
+
+    // Nodes a set operation took out of the trees, with their values already destroyed,
+    // linked through their right child until they go back to the pool all at once.
+    struct Discarded {
+        void add(Node* const node) noexcept {
+            node->destroyElement();
+            node->right = nullptr;
+            (last != nullptr ? last->right : first) = node;
+            last = node;
+            ++count;
+        }
+        void splice(const Discarded& other) noexcept {
+            if(other.first != nullptr) {
+                (last != nullptr ? last->right : first) = other.first;
+                last = other.last;
+                count += other.count;
+            }
+        }
+
+        Node* first{nullptr};
+        Node* last{nullptr};
+        size_t count{0};
+    };
+
+    void reclaim(const Discarded& discarded) noexcept {
+        for(auto* node(discarded.first); node != nullptr;) {
+            pool.deallocate(std::exchange(node, node->right));
+        }
+        record(&Counters::frees, discarded.count);
+    }
+
+    /**
+     * @brief Move what is left of the list at @p otherEnds into the list of this tree once
+     *        @p tree, about to become its root, holds every node of both, and drop the nodes
+     *        in @p discarded from either list.
+     *
+     * Nodes join in key order, so each goes right after the node before it in @p tree, which
+     * only a node of @p otherEnds that joined earlier can be missing from the list.
+     */
+    void weave(const Subtree tree, Node& otherEnds, const Discarded& discarded) noexcept {
+        if constexpr(linkedNodes) {
+            for(auto* node(discarded.first); node != nullptr; node = node->right) {
+                unlinkOrder(node);
+            }
+            if(otherEnds.order.next == &otherEnds) {
+                return;
+            }
+            auto* const first(minOf(tree.root));
+            for(auto* node(otherEnds.order.next); node != &otherEnds;) {
+                auto* const following(node->order.next);
+                auto* const before(node == first ? &header : stepFrom<false>(node));
+                linkOrder(node, before->order.next);
+                linkOrder(before, node);
+                node = following;
+            }
+        }
+    }
+
+    static void discardSubtree(Node* node, Discarded& discarded) noexcept {
+        if(node == nullptr) {
+            return;
+        }
+        // The same walk as destroyValues(), which needs the subtree detached from its parent.
+        setParent(node, nullptr);
+        while(node != nullptr) {
+            if(node->left) {
+                node = std::exchange(node->left, nullptr);
+            } else if(node->right) {
+                node = std::exchange(node->right, nullptr);
+            } else {
+                auto* const parent(parentOf(node));
+                discarded.add(node);
+                node = parent;
+            }
+        }
+    }
+
+    /**
+     * @brief Like threadSubtree(), threading both subtrees of the top @p forks levels of
+     *        @p tree in parallel, which each own a range of keys of their own.
+     */
+    static std::pair<Node*, Node*> threadIn(const Subtree tree, const int forks) {
+        if(forks <= 0 || tree.height < minForkHeight) {
+            return threadSubtree(tree.root);
+        }
+        const auto left(leftOf(tree));
+        const auto right(rightOf(tree));
+        std::pair<Node*, Node*> leftEnds(tree.root, tree.root);
+        std::pair<Node*, Node*> rightEnds(tree.root, tree.root);
+        forkJoin(true,
+                 [&] {
+                     if(left.root != nullptr) {
+                         leftEnds = threadIn(left, forks - 1);
+                     }
+                 },
+                 [&] {
+                     if(right.root != nullptr) {
+                         rightEnds = threadIn(right, forks - 1);
+                     }
+                 });
+        if(left.root != nullptr) {
+            linkOrder(leftEnds.second, tree.root);
+        }
+        if(right.root != nullptr) {
+            linkOrder(tree.root, rightEnds.first);
+        }
+        return {leftEnds.first, rightEnds.second};
+    }
+
+    using SetOperation = Subtree (AvlTree::*)(Subtree, Subtree, Discarded&, int) const;
+
+    [[nodiscard]]
+    static AvlTree setOperation(AvlTree&& first, AvlTree&& second, const unsigned threads, const SetOperation operation) {
+        first.pool.adopt(second.pool);
+        const auto total(first.numElems + second.numElems);
+        Discarded discarded;
+        const auto forks(forksFor(threads));
+        const auto result((first.*operation)(first.whole(), second.whole(), discarded, forks));
+        if constexpr(linkedNodes) {
+            // Weaving touches the nodes of second and the discarded ones on this thread alone, rebuilding
+            // the list touches every node of the result but spreads them over the threads.
+            const auto resultSize(total - discarded.count);
+            if(forks > 0 && (second.numElems + discarded.count) * threads >= resultSize && result.root != nullptr) {
+                const auto [lowest, highest](threadIn(result, forks));
+                linkOrder(&first.header, lowest);
+                linkOrder(highest, &first.header);
+            } else {
+                first.weave(result, second.header, discarded);
+            }
+        }
+        first.setRoot(result);
+        second.setRoot({});
+        second.numElems = 0;
+        first.numElems = total - discarded.count;
+        first.reclaim(discarded);
+        return std::move(first);
+    }
+
+    /**
+     * @brief Run @p left and @p right, on another thread for @p right if @p fork holds.
+     */
+    template<typename Left, typename Right>
+    static void forkJoin(const bool fork, const Left& left, const Right& right) {
+        if(!fork) {
+            left();
+            right();
+            return;
+        }
+        auto future(std::async(std::launch::async, right));
+        left();
+        future.get();
+    }
+
+    [[nodiscard]]
+    static bool shouldFork(const int forks, const Subtree first, const Subtree second) {
+        return forks > 0 && std::max(first.height, second.height) >= minForkHeight;
+    }
+
+    /**
+     * @brief How many levels of a divide and conquer step to run in parallel on @p threads threads.
+     */
+    [[nodiscard]]
+    static int forksFor(const unsigned threads) {
+        // Forking one level deeper than there are threads evens out halves of unequal size.
+        return threads > 1 ? std::bit_width(threads - 1) + 1 : 0;
+    }
+
+    /**
+     * @brief Call @p visit with every node of @p tree in key order, visiting both subtrees
+     *        of the top @p forks levels in parallel.
+     */
+    template<typename Visit>
+    void forEachIn(const Subtree tree, const int forks, const Visit& visit) const {
+        if(tree.root == nullptr) {
+            return;
+        }
+        if(forks > 0 && tree.height >= minForkHeight) {
+            forkJoin(true, [&] { forEachIn(leftOf(tree), forks - 1, visit); },
+                     [&] {
+                         visit(tree.root);
+                         forEachIn(rightOf(tree), forks - 1, visit);
+                     });
+            return;
+        }
+        // Below the forks only the left subtrees need a call of their own.
+        for(auto* node(tree.root); node != nullptr; node = node->right) {
+            forEachIn(Subtree{node->left, 0}, 0, visit);
+            visit(node);
+        }
+    }
+
+    /**
+     * @brief Recompute the aggregates of @p tree bottom up, both subtrees of the top @p forks levels in parallel.
+     */
+    void updateIn(const Subtree tree, const int forks) {
+        if(!augmented || tree.root == nullptr) {
+            return;
+        }
+        forkJoin(forks > 0 && tree.height >= minForkHeight, [&] { updateIn(leftOf(tree), forks - 1); },
+                 [&] { updateIn(rightOf(tree), forks - 1); });
+        updateSubtree(tree.root);
+    }
+
+    /**
+     * @brief Reduce the elements of the non-empty @p tree in key order, reducing both
+     *        subtrees of the top @p forks levels in parallel.
+     */
+    template<typename T, typename Map, typename Reduce>
+    [[nodiscard]]
+    T reduceIn(const Subtree tree, const int forks, const Map& map, const Reduce& reduce) const {
+        const auto left(leftOf(tree));
+        const auto right(rightOf(tree));
+        // The results of the halves are only built once they are ready, T need not be default constructible.
+        std::optional<T> leftResult;
+        std::optional<T> rightResult;
+        forkJoin(forks > 0 && tree.height >= minForkHeight,
+                 [&] {
+                     if(left.root != nullptr) {
+                         leftResult.emplace(reduceIn<T>(left, forks - 1, map, reduce));
+                     }
+                 },
+                 [&] {
+                     if(right.root != nullptr) {
+                         rightResult.emplace(reduceIn<T>(right, forks - 1, map, reduce));
+                     }
+                 });
+        T result(map(std::as_const(tree.root->value)));
+        if(leftResult) {
+            result = reduce(std::move(*leftResult), std::move(result));
+        }
+        if(rightResult) {
+            result = reduce(std::move(result), std::move(*rightResult));
+        }
+        return result;
+    }
+
+    /**
+     * @brief The union of @p first and @p second, discarding the nodes of @p second whose
+     *        keys @p first holds too.
+     *
+     * Splitting @p second by the root of @p first and uniting the halves with its subtrees
+     * does O(m log(n/m + 1)) work for trees of m and n elements. The two unions are
+     * independent, so the top @p forks levels run them in parallel.
+     */
+    [[nodiscard]]
+    Subtree uniteAt(const Subtree first, const Subtree second, Discarded& discarded, const int forks) const {
+        if(first.root == nullptr) {
+            return second;
+        }
+        if(second.root == nullptr) {
+            return first;
+        }
+        auto* const node(first.root);
+        Subtree less;
+        Node* match;
+        Subtree greater;
+        splitAt(second, node->value.first, less, match, greater);
+        if(match != nullptr) {
+            discarded.add(match);
+        }
+        const auto leftOfFirst(leftOf(first));
+        const auto rightOfFirst(rightOf(first));
+        Subtree left;
+        Subtree right;
+        Discarded rightDiscarded;
+        forkJoin(shouldFork(forks, first, second),
+                 [&] { left = uniteAt(leftOfFirst, less, discarded, forks - 1); },
+                 [&] { right = uniteAt(rightOfFirst, greater, rightDiscarded, forks - 1); });
+        discarded.splice(rightDiscarded);
+        return joinAt(left, node, right);
+    }
+
+    /**
+     * @brief Merge the detached, non-empty tree @p other of @p count elements into this one,
+     *        destroying its elements whose key is already present.
+     *
+     * @param otherEnds The header of the list in key order of @p other, when the tree keeps one.
+     * @return The number of elements added.
+     */
+    size_t absorb(const Subtree other, const size_t count, Node& otherEnds) {
+        const auto tree(whole());
+        auto* const otherMin(minOf(other.root));
+        auto* const otherMax(maxOf(other.root));
+        if(tree.root == nullptr || less(header.left->value.first, otherMin->value.first)) {
+            linkOrder(header.left, otherMin);
+            setRoot(concat(tree, other));
+        } else if(less(otherMax->value.first, leftmost->value.first)) {
+            linkOrder(otherMax, leftmost);
+            setRoot(concat(other, tree));
+        } else {
+            Discarded duplicates;
+            const auto united(uniteAt(tree, other, duplicates, 0));
+            weave(united, otherEnds, duplicates);
+            setRoot(united);
+            reclaim(duplicates);
+            numElems += count - duplicates.count;
+            return count - duplicates.count;
+        }
+        numElems += count;
+        return count;
+    }
+
+    /**
+     * @brief The nodes of @p first whose keys @p second holds too, discarding the rest of both.
+     */
+    [[nodiscard]]
+    Subtree intersectAt(const Subtree first, const Subtree second, Discarded& discarded, const int forks) const {
+        if(first.root == nullptr || second.root == nullptr) {
+            discardSubtree(first.root, discarded);
+            discardSubtree(second.root, discarded);
+            return Subtree{nullptr, 0};
+        }
+        auto* const node(first.root);
+        Subtree less;
+        Node* match;
+        Subtree greater;
+        splitAt(second, node->value.first, less, match, greater);
+        const auto leftOfFirst(leftOf(first));
+        const auto rightOfFirst(rightOf(first));
+        Subtree left;
+        Subtree right;
+        Discarded rightDiscarded;
+        forkJoin(shouldFork(forks, first, second),
+                 [&] { left = intersectAt(leftOfFirst, less, discarded, forks - 1); },
+                 [&] { right = intersectAt(rightOfFirst, greater, rightDiscarded, forks - 1); });
+        discarded.splice(rightDiscarded);
+        if(match != nullptr) {
+            discarded.add(match);
+            return joinAt(left, node, right);
+        }
+        discarded.add(node);
+        return concat(left, right);
+    }
+
+    /**
+     * @brief The nodes of @p first whose keys @p second does not hold, discarding the rest of both.
+     */
+    [[nodiscard]]
+    Subtree subtractAt(const Subtree first, const Subtree second, Discarded& discarded, const int forks) const {
+        if(first.root == nullptr || second.root == nullptr) {
+            discardSubtree(second.root, discarded);
+            return first;
+        }
+        // Splitting by the roots of @p second leaves what is left of @p first in key order.
+        auto* const node(second.root);
+        Subtree less;
+        Node* match;
+        Subtree greater;
+        splitAt(first, node->value.first, less, match, greater);
+        const auto leftOfSecond(leftOf(second));
+        const auto rightOfSecond(rightOf(second));
+        Subtree left;
+        Subtree right;
+        Discarded rightDiscarded;
+        forkJoin(shouldFork(forks, first, second),
+                 [&] { left = subtractAt(less, leftOfSecond, discarded, forks - 1); },
+                 [&] { right = subtractAt(greater, rightOfSecond, rightDiscarded, forks - 1); });
+        discarded.splice(rightDiscarded);
+        if(match != nullptr) {
+            discarded.add(match);
+        }
+        discarded.add(node);
+        return concat(left, right);
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    bool eraseHelper(const Key& key) {
+        auto* const node(findHelper<iterator>(key, root).node);
+        if(node == &header) {
+            return false;
+        }
+        eraseNode(node);
+        return true;
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    node_type extractHelper(const Key& key) {
+        auto* const node(findHelper<iterator>(key, root).node);
+        if(node == &header) {
+            return {};
+        }
+        return extractNode(node);
+    }
+
+    [[nodiscard]]
+    node_type extractNode(Node* const node) {
+        // Sharing the chunks may allocate, so it comes first to leave the tree unchanged if that throws.
+        auto sharing(pool.share());
+        (void) unlinkNode(node);
+        node->left = node->right = nullptr;
+        setBalance(node, 0);
+        return node_type(node, std::move(sharing));
+    }
+
+    /**
+     * @brief Unlink @p node from the tree, rebalance and free it.
+     *
+     * @return The node holding the element that followed the erased one.
+     */
+    Node* eraseNode(Node* const node) {
+        auto* const next(unlinkNode(node));
+        destroyNode(node);
+        return next;
+    }
+
+    /**
+     * @brief Unlink @p node from the tree and rebalance, leaving the node to the caller.
+     *
+     * No element is copied or moved, every other node keeps its value so
+     * iterators to anything but @p node remain valid.
+     *
+     * @return The node holding the element that followed the unlinked one.
+     */
+    Node* unlinkNode(Node* const node) {
+        if(node == header.left) {
+            header.left = node == leftmost ? &header : step<false>(node);
+        }
+        if(node == leftmost) {
+            leftmost = step<true>(node);
+        }
+        unlinkOrder(node);
+        auto& link(linkTo(node));
+        Node* rebalanceFrom;
+        bool leftShrank;
+        Node* next;
+        if(node->left && node->right) {
+            // 2 valid children; both left and right. Splice the in-order successor,
+            // which has no left child, into the position of the erased node.
+            auto* successor(node->right);
+            while(successor->left) {
+                successor = successor->left;
+            }
+            if(successor == node->right) {
+                rebalanceFrom = successor;
+                leftShrank = false;
+            } else {
+                rebalanceFrom = parentOf(successor);
+                leftShrank = true;
+                rebalanceFrom->left = successor->right;
+                if(successor->right) {
+                    setParent(successor->right, rebalanceFrom);
+                }
+                successor->right = node->right;
+                setParent(successor->right, successor);
+            }
+            successor->left = node->left;
+            setParent(successor->left, successor);
+            setParent(successor, parentOf(node));
+            setBalance(successor, balanceOf(node));
+            successor->size = node->size;
+            link = successor;
+            next = successor;
+        } else {
+            next = step<true>(node);
+            auto* const promoted(node->left != nullptr ? node->left : node->right);
+            rebalanceFrom = parentOf(node);
+            leftShrank = rebalanceFrom != &header && node == rebalanceFrom->left;
+            if(promoted) {
+                setParent(promoted, rebalanceFrom);
+            }
+            link = promoted;
+        }
+        --numElems;
+        if constexpr(augmented) {
+            // The path up from where the node was unlinked passes through its successor, if that took its place.
+            updateAncestors(rebalanceFrom);
+        } else if constexpr(orderStatistics) {
+            for(auto* ancestor(rebalanceFrom); ancestor != &header; ancestor = parentOf(ancestor)) {
+                --ancestor->size;
+            }
+        }
+        rebalanceAfterErase(rebalanceFrom, leftShrank);
+        return next;
+    }
+
+    template<typename Iter, typename Key>
+    [[nodiscard]]
+    Iter findHelper(const Key& key, Node* root) const {
+        const auto prefix(prefixOf(key));
+        size_t depth(0);
+        for(; root != nullptr; ++depth) {
+            const auto side(order(key, prefix, root));
+            if(side < 0) {
+                root = root->left;
+            } else if(side > 0) {
+                root = root->right;
+            } else {
+                // Values are equal, we found what we're looking for
+                ++depth;
+                break;
+            }
+        }
+        recordDescent(depth);
+        return iteratorTo<Iter>(root);
+    }
+
+    // Enough descents in flight to cover the latency of a miss, few enough to stay in registers.
+    static constexpr size_t batchGroupSize{16};
+
+    /**
+     * @brief Find every key in @p keys, calling @p visit with its index and its node,
+     *        or nullptr if it is missing.
+     */
+    template<typename Visit>
+    void findBatchHelper(std::span<const K> keys, const Visit& visit) const {
+        std::array<Node*, batchGroupSize> cursors{};
+        for(size_t first(0); first < keys.size(); first += batchGroupSize) {
+            const auto count(std::min(batchGroupSize, keys.size() - first));
+            for(size_t i(0); i < count; ++i) {
+                cursors[i] = root;
+                if(root == nullptr) {
+                    visit(first + i, nullptr);
+                }
+            }
+            // Every pass takes each unfinished descent one level further down.
+            for(auto pending(root != nullptr ? count : 0); pending > 0;) {
+                pending = 0;
+                for(size_t i(0); i < count; ++i) {
+                    auto* const node(cursors[i]);
+                    if(node == nullptr) {
+                        continue;
+                    }
+                    const auto& key(keys[first + i]);
+                    const auto side(order(key, prefixOf(key), node));
+                    Node* next;
+                    if(side < 0) {
+                        next = node->left;
+                    } else if(side > 0) {
+                        next = node->right;
+                    } else {
+                        visit(first + i, node);
+                        cursors[i] = nullptr;
+                        continue;
+                    }
+                    if(next == nullptr) {
+                        visit(first + i, nullptr);
+                    } else {
+                        prefetch(next);
+                        ++pending;
+                    }
+                    cursors[i] = next;
+                }
+            }
+        }
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    size_t rankHelper(const Key& key) const {
+        size_t smaller(0);
+        const auto* node(root);
+        while(node != nullptr) {
+            if(less(node->value.first, key)) {
+                smaller += getSize(node->left) + 1;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return smaller;
+    }
+
+    template<typename Low, typename High>
+    [[nodiscard]]
+    auto aggregateHelper(const Low& low, const High& high) const {
+        // Descend to the top node in the range, where the paths to both ends of it part.
+        const Node* top(root);
+        while(top != nullptr) {
+            if(less(top->value.first, low)) {
+                top = top->right;
+            } else if(!less(top->value.first, high)) {
+                top = top->left;
+            } else {
+                break;
+            }
+        }
+        if(top == nullptr) {
+            return Monoid::identity();
+        }
+        // Down the left path every node in the range comes with all of its right subtree,
+        // ahead of what was collected so far, and down the right path the other way round.
+        auto lower(Monoid::identity());
+        for(const auto* node(top->left); node != nullptr;) {
+            if(less(node->value.first, low)) {
+                node = node->right;
+            } else {
+                lower = Monoid::combine(Monoid::combine(lift(node), aggregateOf(node->right)), lower);
+                node = node->left;
+            }
+        }
+        auto upper(Monoid::identity());
+        for(const auto* node(top->right); node != nullptr;) {
+            if(less(node->value.first, high)) {
+                upper = Monoid::combine(upper, Monoid::combine(aggregateOf(node->left), lift(node)));
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return Monoid::combine(Monoid::combine(lower, lift(top)), upper);
+    }
+
+    template<typename Low, typename High>
+    [[nodiscard]]
+    size_t countRangeHelper(const Low& low, const High& high) const {
+        const auto lowRank(rankHelper(low));
+        const auto highRank(rankHelper(high));
+        return highRank > lowRank ? highRank - lowRank : 0;
+    }
+
+    template<typename Iter>
+    [[nodiscard]]
+    Iter selectHelper(size_t index, Node* root) const {
+        while(root != nullptr) {
+            const auto leftSize(getSize(root->left));
+            if(index < leftSize) {
+                root = root->left;
+            } else if(index > leftSize) {
+                index -= leftSize + 1;
+                root = root->right;
+            } else {
+                break;
+            }
+        }
+        return iteratorTo<Iter>(root);
+    }
+
+    template<typename Iter, typename Key>
+    [[nodiscard]]
+    Iter lowerBoundHelper(const Key& key, Node* root) const {
+        Node* bound(nullptr);
+        while(root != nullptr) {
+            if(less(root->value.first, key)) {
+                root = root->right;
+            } else {
+                bound = root;
+                root = root->left;
+            }
+        }
+        return iteratorTo<Iter>(bound);
+    }
+
+    template<typename Iter, typename Key>
+    [[nodiscard]]
+    Iter upperBoundHelper(const Key& key, Node* root) const {
+        Node* bound(nullptr);
+        while(root != nullptr) {
+            if(less(key, root->value.first)) {
+                bound = root;
+                root = root->left;
+            } else {
+                root = root->right;
+            }
+        }
+        return iteratorTo<Iter>(bound);
+    }
+
+    template<typename Iter, typename Key>
+    [[nodiscard]]
+    std::pair<Iter, Iter> equalRangeHelper(const Key& key, Node* root) const {
+        // Keys are unique, so both ends fall out of a single descent.
+        const auto prefix(prefixOf(key));
+        Node* bound(nullptr);
+        while(root != nullptr) {
+            const auto side(order(key, prefix, root));
+            if(side < 0) {
+                bound = root;
+                root = root->left;
+            } else if(side > 0) {
+                root = root->right;
+            } else {
+                auto next(iteratorTo<Iter>(root));
+                ++next;
+                return {iteratorTo<Iter>(root), next};
+            }
         }
-        // Values are equal, we found what we're looking for
-        return Iter{root};
+        return {iteratorTo<Iter>(bound), iteratorTo<Iter>(bound)};
     }
 };
 
@@ -0,0 +1,637 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "NodePool.hpp"
+#include "PathIterator.hpp"
+
+namespace algos {
+
+/**
+ * @brief An AVL tree that any number of threads can read without locks while writes happen.
+ *
+ * Nodes are never modified once published. A write copies the path from the root down to
+ * what it changes, rebalances the copies and publishes the new root with a single atomic
+ * store, so readers always see a complete version of the tree. The nodes a write replaced
+ * are retired and only reclaimed once no reader can reach them any more, which readers make
+ * known by pinning the current epoch in a slot on a cache line of their own.
+ *
+ * Reads go through a Snapshot, which sees the version that was current when it was taken.
+ * Writes are serialized by a mutex. As every write copies the elements on its path, keys
+ * and values must be copyable.
+ *
+ * @tparam K The type of keys used to identify elements in the tree.
+ * @tparam V The type of value associated with each key.
+ * @tparam Compare A function used for ordering keys, it is stored in the tree and may carry state.
+ * @tparam Allocator The allocator used to obtain the chunks nodes are carved from.
+ */
+template<typename K, typename V, typename Compare=std::less<K>, typename Allocator=std::allocator<std::pair<K, V>>>
+class ConcurrentAvlTree {
+public:
+    using value_type = std::pair<K, V>;
+    using allocator_type = Allocator;
+private:
+    static constexpr bool isTransparent{requires { typename Compare::is_transparent; }};
+    // An AVL tree 64 levels tall holds more than 2^44 elements, more than fit in memory.
+    static constexpr size_t maxHeight{64};
+    // The most nodes a single write creates, a copy of every node on the path and of the
+    // sibling each rotation on the way back up touches, plus the successor of an erased node.
+    static constexpr size_t maxNodesPerWrite{3 * maxHeight + 1};
+    static constexpr size_t cacheLineSize{64};
+
+    struct Node {
+        template<typename... Args>
+        explicit Node(const std::uint64_t born, Args&&... args) : value(std::forward<Args>(args)...), born(born) {}
+
+        value_type value;
+        Node* left{nullptr};
+        Node* right{nullptr};
+        // The epoch of the write that created the node, which may modify it until it is published.
+        std::uint64_t born;
+        int height{1};
+    };
+
+    struct alignas(cacheLineSize) ReaderSlot {
+        // The epoch pinned by the snapshot using the slot, or 0 while the slot is free.
+        std::atomic<std::uint64_t> epoch{0};
+        // The thread that took the snapshot, so a thread can tell it is waiting on itself.
+        std::atomic<std::thread::id> owner{};
+    };
+    using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<ReaderSlot>;
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node*>;
+    using RetiredAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<std::pair<std::uint64_t, Node*>>;
+public:
+    using iterator = PathIterator<Node>;
+    using const_iterator = PathIterator<Node>;
+
+    /**
+     * @brief A consistent, read-only view of the tree as it was when the snapshot was taken.
+     *
+     * Reading through a snapshot takes no locks and never waits for writers. Nodes of the
+     * version it sees are kept alive until it is destroyed, so it should not be held for
+     * longer than needed, and it must not outlive the tree.
+     */
+    class Snapshot {
+    public:
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        Snapshot(Snapshot&& other) noexcept
+            : tree(other.tree), slot(std::exchange(other.slot, nullptr)), root(other.root) {}
+
+        Snapshot& operator=(Snapshot&& other) noexcept {
+            if(this != &other) {
+                unpin();
+                tree = other.tree;
+                slot = std::exchange(other.slot, nullptr);
+                root = other.root;
+            }
+            return *this;
+        }
+
+        ~Snapshot() {
+            unpin();
+        }
+
+        [[nodiscard]]
+        const_iterator cbegin() const {
+            return const_iterator::first(root);
+        }
+
+        [[nodiscard]]
+        const_iterator begin() const {
+            return cbegin();
+        }
+
+        [[nodiscard]]
+        const_iterator cend() const {
+            return const_iterator{};
+        }
+
+        [[nodiscard]]
+        const_iterator end() const {
+            return cend();
+        }
+
+        [[nodiscard]]
+        const_iterator find(const K& key) const {
+            return const_iterator::find(root, key, tree->comp);
+        }
+
+        template<typename Key>
+        requires isTransparent
+        [[nodiscard]]
+        const_iterator find(const Key& key) const {
+            return const_iterator::find(root, key, tree->comp);
+        }
+
+        /**
+         * @brief The first element with a key not less than @p key.
+         */
+        [[nodiscard]]
+        const_iterator lower_bound(const K& key) const {
+            return const_iterator::lowerBound(root, key, tree->comp);
+        }
+
+        template<typename Key>
+        requires isTransparent
+        [[nodiscard]]
+        const_iterator lower_bound(const Key& key) const {
+            return const_iterator::lowerBound(root, key, tree->comp);
+        }
+
+        /**
+         * @brief The first element with a key greater than @p key.
+         */
+        [[nodiscard]]
+        const_iterator upper_bound(const K& key) const {
+            return const_iterator::upperBound(root, key, tree->comp);
+        }
+
+        template<typename Key>
+        requires isTransparent
+        [[nodiscard]]
+        const_iterator upper_bound(const Key& key) const {
+            return const_iterator::upperBound(root, key, tree->comp);
+        }
+
+        [[nodiscard]]
+        bool empty() const {
+            return root == nullptr;
+        }
+
+    private:
+        friend class ConcurrentAvlTree;
+
+        Snapshot(const ConcurrentAvlTree* tree, ReaderSlot* slot) : tree(tree), slot(slot), root(tree->root.load()) {}
+
+        void unpin() {
+            if(slot != nullptr) {
+                slot->owner.store(std::thread::id(), std::memory_order_relaxed);
+                slot->epoch.store(0, std::memory_order_release);
+            }
+        }
+
+        const ConcurrentAvlTree* tree;
+        ReaderSlot* slot;
+        const Node* root;
+    };
+
+    ConcurrentAvlTree() : ConcurrentAvlTree(Compare()) {}
+
+    /**
+     * @param maxReaders The number of snapshots that can be alive at once. Taking another
+     *                   one waits until an existing snapshot is destroyed, see snapshot().
+     */
+    explicit ConcurrentAvlTree(const Compare& comp, const Allocator& alloc = Allocator(),
+                               const size_t maxReaders = defaultMaxReaders())
+        : slots(maxReaders, SlotAllocator(alloc)), pool(alloc), fresh(NodeAllocator(alloc)),
+          pending(NodeAllocator(alloc)), retired(RetiredAllocator(alloc)), comp(comp) {
+        fresh.reserve(maxNodesPerWrite);
+        pending.reserve(maxNodesPerWrite);
+    }
+
+    explicit ConcurrentAvlTree(const Allocator& alloc) : ConcurrentAvlTree(Compare(), alloc) {}
+
+    ConcurrentAvlTree(const ConcurrentAvlTree&) = delete;
+    ConcurrentAvlTree& operator=(const ConcurrentAvlTree&) = delete;
+
+    /**
+     * @brief Free every node, no snapshot of the tree may still be alive.
+     */
+    ~ConcurrentAvlTree() {
+        destroySubtree(root.load(std::memory_order_relaxed));
+        for(auto iter(retired.begin() + static_cast<std::ptrdiff_t>(firstRetired)); iter != retired.end(); ++iter) {
+            pool.destroy(iter->second);
+        }
+    }
+
+    /**
+     * @brief Take a snapshot of the current version of the tree, to read it without locks.
+     *
+     * If maxReaders snapshots are alive, this waits until one of them is destroyed.
+     *
+     * @throws std::runtime_error If the calling thread took every snapshot that is alive,
+     *         which it would otherwise wait on forever.
+     */
+    [[nodiscard]]
+    Snapshot snapshot() const {
+        return Snapshot(this, &pin());
+    }
+
+    /**
+     * @brief Insert @p key with a copy of @p value, unless the key is already present.
+     *
+     * @return Whether the element was inserted.
+     */
+    bool insert(const K& key, const V& value) {
+        return write([&](Node* const oldRoot) { return insertAt(oldRoot, key, value, false); }) > 0;
+    }
+
+    /**
+     * @brief Insert @p key with a copy of @p value, or replace the value of an existing element.
+     *
+     * @return Whether the element was inserted rather than assigned to.
+     */
+    bool insert_or_assign(const K& key, const V& value) {
+        return write([&](Node* const oldRoot) { return insertAt(oldRoot, key, value, true); }) > 0;
+    }
+
+    /**
+     * @brief Erase the element with @p key if it exists.
+     *
+     * @return Whether an element was erased.
+     */
+    bool erase(const K& key) {
+        return write([&](Node* const oldRoot) { return eraseAt(oldRoot, key); }) < 0;
+    }
+
+    template<typename Key>
+    requires isTransparent
+    bool erase(const Key& key) {
+        return write([&](Node* const oldRoot) { return eraseAt(oldRoot, key); }) < 0;
+    }
+
+    void clear() {
+        (void) write([&](Node* const oldRoot) -> Node* {
+            retireSubtree(oldRoot);
+            sizeChange = -static_cast<std::ptrdiff_t>(size());
+            return nullptr;
+        });
+    }
+
+    /**
+     * @brief The number of elements after the most recent write.
+     */
+    [[nodiscard]]
+    size_t size() const {
+        return numElems.load(std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return size() == 0;
+    }
+
+    [[nodiscard]]
+    allocator_type get_allocator() const {
+        return pool.get_allocator();
+    }
+
+    [[nodiscard]]
+    Compare key_comp() const {
+        return comp;
+    }
+
+private:
+    // Shared with every reader and written once per write, so kept apart from the rest.
+    alignas(cacheLineSize) std::atomic<Node*> root{nullptr};
+    std::atomic<std::uint64_t> epoch{1};
+
+    alignas(cacheLineSize) mutable std::vector<ReaderSlot, SlotAllocator> slots;
+    std::mutex writeMutex;
+    std::atomic<size_t> numElems{0};
+    NodePool<Node, Allocator> pool;
+    // The epoch of the write in progress, nodes born in it are not published yet.
+    std::uint64_t writeEpoch{0};
+    // The nodes created and the nodes replaced by the write in progress.
+    std::vector<Node*, NodeAllocator> fresh;
+    std::vector<Node*, NodeAllocator> pending;
+    std::ptrdiff_t sizeChange{0};
+    // Replaced nodes in the order they were retired, with the epoch they were retired in. Those
+    // before firstRetired are freed already and dropped from the front once they are the most.
+    std::vector<std::pair<std::uint64_t, Node*>, RetiredAllocator> retired;
+    size_t firstRetired{0};
+    // How many nodes are left to retire before reclaim() scans the reader slots again.
+    size_t retiresUntilScan{0};
+    [[no_unique_address]] Compare comp;
+
+    [[nodiscard]]
+    static size_t defaultMaxReaders() {
+        return std::max<size_t>(64, 4 * static_cast<size_t>(std::thread::hardware_concurrency()));
+    }
+
+    /**
+     * @brief Claim a free reader slot and pin the current epoch in it.
+     */
+    ReaderSlot& pin() const {
+        // Threads start looking in different places, and usually find the slot they freed last.
+        const auto self(std::this_thread::get_id());
+        thread_local size_t hint(std::hash<std::thread::id>{}(self));
+        while(true) {
+            bool allOwn(true);
+            for(size_t i(0); i < slots.size(); ++i) {
+                auto& slot(slots[(hint + i) % slots.size()]);
+                std::uint64_t expected(0);
+                // Reading first skips slots in use without pulling their cache lines in exclusively.
+                if(slot.epoch.load(std::memory_order_relaxed) == 0 &&
+                   slot.epoch.compare_exchange_strong(expected, epoch.load())) {
+                    slot.owner.store(self, std::memory_order_relaxed);
+                    hint = (hint + i) % slots.size();
+                    return slot;
+                }
+                // An owner is cleared before its slot is freed, so a stale read never claims a slot for this thread.
+                allOwn = allOwn && slot.owner.load(std::memory_order_relaxed) == self;
+            }
+            if(allOwn) {
+                throw std::runtime_error("every reader slot is held by a snapshot of the calling thread");
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * @brief Apply @p change to a private copy of the tree and publish the result.
+     *
+     * @p change takes the current root and returns the new one, copying every node it
+     * modifies with own(). If it throws, the published tree is left as it was.
+     *
+     * @return The change in the number of elements.
+     */
+    template<typename Change>
+    std::ptrdiff_t write(const Change& change) {
+        const std::lock_guard lock(writeMutex);
+        writeEpoch = epoch.load(std::memory_order_relaxed);
+        auto* const oldRoot(root.load(std::memory_order_relaxed));
+        sizeChange = 0;
+        Node* newRoot;
+        try {
+            newRoot = change(oldRoot);
+            retired.reserve(retired.size() + pending.size());
+        } catch(...) {
+            for(auto* const node : fresh) {
+                pool.destroy(node);
+            }
+            fresh.clear();
+            pending.clear();
+            throw;
+        }
+        fresh.clear();
+        if(newRoot != oldRoot || !pending.empty()) {
+            root.store(newRoot);
+            // Snapshots pinning the new epoch load the new root, so they never see what was replaced.
+            epoch.store(writeEpoch + 1);
+            for(auto* const node : pending) {
+                retired.emplace_back(writeEpoch, node);
+            }
+            retiresUntilScan -= std::min(retiresUntilScan, pending.size());
+            pending.clear();
+            // Wraps around to subtract when the write removed elements.
+            numElems.store(numElems.load(std::memory_order_relaxed) + static_cast<size_t>(sizeChange),
+                           std::memory_order_relaxed);
+            reclaim();
+        }
+        return sizeChange;
+    }
+
+    /**
+     * @brief Free the retired nodes no snapshot can reach any more.
+     *
+     * The reader slots are only scanned once as many nodes were retired since the last scan
+     * as there are slots, so a write takes amortized constant time however many nodes a
+     * long lived snapshot holds on to.
+     */
+    void reclaim() {
+        if(retiresUntilScan > 0) {
+            return;
+        }
+        retiresUntilScan = slots.size();
+        auto oldestPinned(std::numeric_limits<std::uint64_t>::max());
+        for(const auto& slot : slots) {
+            const auto pinned(slot.epoch.load());
+            if(pinned != 0) {
+                oldestPinned = std::min(oldestPinned, pinned);
+            }
+        }
+        // A snapshot pinned in an epoch may have loaded the root that was replaced in it.
+        for(; firstRetired < retired.size() && retired[firstRetired].first < oldestPinned; ++firstRetired) {
+            pool.destroy(retired[firstRetired].second);
+        }
+        // Dropping the freed entries only once they outnumber the rest moves each entry a constant number of times.
+        if(2 * firstRetired >= retired.size()) {
+            retired.erase(retired.begin(), retired.begin() + static_cast<std::ptrdiff_t>(firstRetired));
+            firstRetired = 0;
+        }
+    }
+
+    template<typename... Args>
+    [[nodiscard]]
+    Node* create(Args&&... args) {
+        auto* const node(pool.create(writeEpoch, std::forward<Args>(args)...));
+        fresh.push_back(node);
+        return node;
+    }
+
+    /**
+     * @brief A version of @p node the write in progress may modify, which is a copy unless
+     *        the write created @p node itself.
+     */
+    [[nodiscard]]
+    Node* own(Node* const node) {
+        if(node->born == writeEpoch) {
+            return node;
+        }
+        auto* const copy(create(node->value));
+        copy->left = node->left;
+        copy->right = node->right;
+        copy->height = node->height;
+        pending.push_back(node);
+        return copy;
+    }
+
+    [[nodiscard]]
+    Node* insertAt(Node* node, const K& key, const V& value, const bool assign) {
+        if(node == nullptr) {
+            sizeChange = 1;
+            return create(key, value);
+        }
+        if(comp(key, node->value.first)) {
+            auto* const left(insertAt(node->left, key, value, assign));
+            if(left == node->left) {
+                return node;
+            }
+            node = own(node);
+            node->left = left;
+        } else if(comp(node->value.first, key)) {
+            auto* const right(insertAt(node->right, key, value, assign));
+            if(right == node->right) {
+                return node;
+            }
+            node = own(node);
+            node->right = right;
+        } else {
+            if(assign) {
+                node = own(node);
+                node->value.second = value;
+            }
+            return node;
+        }
+        return rebalance(node);
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    Node* eraseAt(Node* node, const Key& key) {
+        if(node == nullptr) {
+            return nullptr;
+        }
+        if(comp(key, node->value.first)) {
+            auto* const left(eraseAt(node->left, key));
+            if(left == node->left) {
+                return node;
+            }
+            node = own(node);
+            node->left = left;
+            return rebalance(node);
+        }
+        if(comp(node->value.first, key)) {
+            auto* const right(eraseAt(node->right, key));
+            if(right == node->right) {
+                return node;
+            }
+            node = own(node);
+            node->right = right;
+            return rebalance(node);
+        }
+        sizeChange = -1;
+        pending.push_back(node);
+        if(node->left == nullptr) {
+            return node->right;
+        }
+        if(node->right == nullptr) {
+            return node->left;
+        }
+        // Readers may still be looking at the successor where it is, so it is copied
+        // into the place of the erased node rather than moved.
+        Node* successor;
+        auto* const right(eraseMin(node->right, successor));
+        auto* const replacement(create(successor->value));
+        replacement->left = node->left;
+        replacement->right = right;
+        return rebalance(replacement);
+    }
+
+    /**
+     * @brief Unlink the leftmost node of the tree rooted at @p node, storing it in @p min.
+     *
+     * @return The new root of the tree.
+     */
+    [[nodiscard]]
+    Node* eraseMin(Node* node, Node*& min) {
+        if(node->left == nullptr) {
+            min = node;
+            pending.push_back(node);
+            return node->right;
+        }
+        auto* const left(eraseMin(node->left, min));
+        node = own(node);
+        node->left = left;
+        return rebalance(node);
+    }
+
+    void retireSubtree(Node* const node) {
+        if(node != nullptr) {
+            pending.push_back(node);
+            retireSubtree(node->left);
+            retireSubtree(node->right);
+        }
+    }
+
+    void destroySubtree(Node* const node) {
+        if(node != nullptr) {
+            destroySubtree(node->left);
+            destroySubtree(node->right);
+            pool.destroy(node);
+        }
+    }
+
+    [[nodiscard]]
+    static int getHeight(const Node* const node) {
+        return node == nullptr ? 0 : node->height;
+    }
+
+    static void updateHeight(Node* const node) {
+        node->height = std::max(getHeight(node->left), getHeight(node->right)) + 1;
+    }
+
+    [[nodiscard]]
+    static int getBalanceFactor(const Node* const node) {
+        return getHeight(node->left) - getHeight(node->right);
+    }
+
+    /**
+     * @brief Right rotate the tree rooted at @p node, which must be owned along with its left child.
+     *
+     * @return The new root of the tree.
+     */
+    [[nodiscard]]
+    static Node* rotateRight(Node* const node) {
+        auto* const newRoot(node->left);
+        node->left = newRoot->right;
+        newRoot->right = node;
+        updateHeight(node);
+        updateHeight(newRoot);
+        return newRoot;
+    }
+
+    /**
+     * @brief Left rotate the tree rooted at @p node, which must be owned along with its right child.
+     *
+     * @return The new root of the tree.
+     */
+    [[nodiscard]]
+    static Node* rotateLeft(Node* const node) {
+        auto* const newRoot(node->right);
+        node->right = newRoot->left;
+        newRoot->left = node;
+        updateHeight(node);
+        updateHeight(newRoot);
+        return newRoot;
+    }
+
+    /**
+     * @brief Restore the balance of the owned @p node after one of its subtrees changed height,
+     *        owning whatever the rotations modify.
+     *
+     * @return The new root of the subtree.
+     */
+    [[nodiscard]]
+    Node* rebalance(Node* const node) {
+        updateHeight(node);
+        const auto balanceFactor(getBalanceFactor(node));
+        if(balanceFactor > 1) {
+            // Left leaning tree
+            auto* left(own(node->left));
+            if(getBalanceFactor(left) < 0) {
+                left->right = own(left->right);
+                left = rotateLeft(left);
+            }
+            node->left = left;
+            return rotateRight(node);
+        }
+        if(balanceFactor < -1) {
+            // Right leaning tree
+            auto* right(own(node->right));
+            if(getBalanceFactor(right) > 0) {
+                right->left = own(right->left);
+                right = rotateRight(right);
+            }
+            node->right = right;
+            return rotateLeft(node);
+        }
+        return node;
+    }
+};
+
+}
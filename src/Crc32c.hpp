@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace algos {
+
+// The remainder of every byte value, for the reflected Castagnoli polynomial.
+inline constexpr auto crc32cTable = [] {
+    std::array<std::uint32_t, 256> table{};
+    for(std::uint32_t byte(0); byte < table.size(); ++byte) {
+        auto remainder(byte);
+        for(int bit(0); bit < 8; ++bit) {
+            remainder = (remainder >> 1) ^ ((remainder & 1) != 0 ? 0x82F63B78U : 0);
+        }
+        table[byte] = remainder;
+    }
+    return table;
+}();
+
+/**
+ * @brief The CRC-32C checksum of @p bytes, continuing from the checksum @p crc of the bytes
+ *        before them, so a message may be checksummed a piece at a time.
+ */
+[[nodiscard]]
+constexpr std::uint32_t crc32c(const std::span<const std::byte> bytes, std::uint32_t crc = 0) {
+    crc = ~crc;
+    for(const auto byte : bytes) {
+        crc = (crc >> 8) ^ crc32cTable[(crc ^ static_cast<std::uint32_t>(byte)) & 0xFF];
+    }
+    return ~crc;
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+
+#include "Prefetch.hpp"
+
+/**
+ * @brief Index arithmetic for sorted arrays laid out in Eytzinger order, the breadth first order
+ *        of a complete binary search tree.
+ *
+ * Positions are one based, the children of position i are at 2i and 2i + 1 and position 0
+ * stands for no position at all.
+ */
+namespace algos::eytzinger {
+
+/**
+ * @brief The first position in key order of the subtree at @p index, out of @p count.
+ */
+[[nodiscard]]
+inline size_t leftmostFrom(size_t index, const size_t count) {
+    while(2 * index <= count) {
+        index *= 2;
+    }
+    return index;
+}
+
+/**
+ * @brief The last position in key order of the subtree at @p index, out of @p count.
+ */
+[[nodiscard]]
+inline size_t rightmostFrom(size_t index, const size_t count) {
+    while(2 * index + 1 <= count) {
+        index = 2 * index + 1;
+    }
+    return index;
+}
+
+/**
+ * @brief The position a descent that ran off the tree at @p index last went left from,
+ *        which is 0 if it never did.
+ */
+[[nodiscard]]
+inline size_t lastLeftTurn(const size_t index) {
+    // Every trailing one is a step right, undo them and the final step left.
+    return index >> (std::countr_one(index) + 1);
+}
+
+/**
+ * @brief The position following @p index in key order out of @p count, or 0 past the last one.
+ */
+[[nodiscard]]
+inline size_t nextIndex(const size_t index, const size_t count) {
+    if(2 * index + 1 <= count) {
+        return leftmostFrom(2 * index + 1, count);
+    }
+    // Climb past every ancestor reached from its right child, then one more level.
+    return lastLeftTurn(index);
+}
+
+/**
+ * @brief The position preceding @p index in key order out of @p count, or 0 before the first one.
+ */
+[[nodiscard]]
+inline size_t prevIndex(const size_t index, const size_t count) {
+    if(2 * index <= count) {
+        return rightmostFrom(2 * index, count);
+    }
+    // Climb past every ancestor reached from its left child, then one more level.
+    return index >> (std::countr_zero(index) + 1);
+}
+
+/**
+ * @brief Descend the @p count keys at @p base to a leaf, going right whenever @p goRight
+ *        holds for the key at a position.
+ *
+ * The level whose keys for a given ancestor share a cache line is prefetched while the
+ * current one is compared, which is as far ahead as a single prefetch covers.
+ *
+ * @return The last position the descent went left from, which is 0 if it never did.
+ */
+template<typename K, typename GoRight>
+[[nodiscard]]
+size_t descend(const K* const base, const size_t count, const GoRight& goRight) {
+    constexpr size_t prefetchStride{std::bit_floor(std::max<size_t>(64 / sizeof(K), 2))};
+    size_t index(1);
+    while(index <= count) {
+        prefetch(base + std::min(index * prefetchStride, count) - 1);
+        index = 2 * index + static_cast<size_t>(goRight(base[index - 1]));
+    }
+    return lastLeftTurn(index);
+}
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace algos {
+
+/**
+ * @brief An open file descriptor, closed when it goes out of scope, that reports every failure
+ *        of the calls made on it by throwing std::system_error.
+ */
+class File {
+public:
+    /**
+     * @brief Open the file at @p path with the flags of open(2), creating it readable by all
+     *        if @p flags include O_CREAT.
+     */
+    File(std::filesystem::path path, const int flags) : path(std::move(path)) {
+        fd = ::open(this->path.c_str(), flags | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            fail("open");
+        }
+    }
+
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    File(File&& other) noexcept : path(std::move(other.path)), fd(std::exchange(other.fd, -1)) {}
+
+    File& operator=(File&& other) noexcept {
+        std::swap(path, other.path);
+        std::swap(fd, other.fd);
+        return *this;
+    }
+
+    ~File() {
+        if(fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    [[nodiscard]]
+    int descriptor() const {
+        return fd;
+    }
+
+    [[nodiscard]]
+    size_t size() const {
+        struct stat status{};
+        if(::fstat(fd, &status) != 0) {
+            fail("stat");
+        }
+        return static_cast<size_t>(status.st_size);
+    }
+
+    /**
+     * @brief Cut the file short or extend it with zeros to @p length bytes.
+     */
+    void resize(const size_t length) const {
+        if(::ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            fail("truncate");
+        }
+    }
+
+    /**
+     * @brief Write all of @p bytes at the current offset, resuming after partial writes and signals.
+     */
+    void write(std::span<const std::byte> bytes) const {
+        while(!bytes.empty()) {
+            bytes = bytes.subspan(writeSome(bytes));
+        }
+    }
+
+    /**
+     * @brief Write a prefix of the non-empty @p bytes at the current offset, retrying after signals.
+     *
+     * @return How many bytes were written, which a caller that resumes after a failure has to keep
+     *         track of to avoid writing them twice.
+     */
+    size_t writeSome(const std::span<const std::byte> bytes) const {
+        while(true) {
+            const auto written(::write(fd, bytes.data(), bytes.size()));
+            if(written >= 0) {
+                return static_cast<size_t>(written);
+            }
+            if(errno != EINTR) {
+                fail("write");
+            }
+        }
+    }
+
+    /**
+     * @brief Block until everything written so far has reached the storage device.
+     */
+    void sync() const {
+        if(::fsync(fd) != 0) {
+            fail("fsync");
+        }
+    }
+
+    [[noreturn]]
+    void fail(const char* const operation) const {
+        throw std::system_error(errno, std::generic_category(), std::string(operation) + " " + path.string());
+    }
+
+private:
+    std::filesystem::path path;
+    int fd;
+};
+
+}
@@ -0,0 +1,517 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "AvlTree.hpp"
+#include "Eytzinger.hpp"
+#include "Prefetch.hpp"
+
+namespace algos {
+
+/**
+ * @brief An immutable, read-optimized copy of the elements of an AvlTree.
+ *
+ * The elements are stored implicitly in Eytzinger order, the breadth first order of a complete
+ * binary search tree, where the children of position i are at 2i and 2i + 1. Keys are kept in an
+ * array of their own so a descent touches as few cache lines as possible, the next levels are
+ * prefetched while the current one is compared, and moving down is a branch-free index update.
+ * Lookups and iteration mirror those of AvlTree, so read paths can switch between the two.
+ *
+ * @tparam K The type of keys used to identify elements.
+ * @tparam V The type of value associated with each key.
+ * @tparam Compare A function used for ordering keys, it is stored and may carry state.
+ * @tparam Allocator The allocator used for the key and element arrays, it is rebound as needed.
+ */
+template<typename K, typename V, typename Compare=std::less<K>, typename Allocator=std::allocator<std::pair<K, V>>>
+class FrozenAvlTree {
+public:
+    using value_type = std::pair<K, V>;
+    using allocator_type = Allocator;
+private:
+    static constexpr bool isTransparent{requires { typename Compare::is_transparent; }};
+    // Enough descents in flight to cover the latency of a miss, few enough to stay in registers.
+    static constexpr size_t batchGroupSize{16};
+    // 32 and 64 bit integers in their natural order can be compared a vector at a time.
+    static constexpr bool vectorKeys{std::is_integral_v<K> && (sizeof(K) == 4 || sizeof(K) == 8) &&
+                                     (std::is_same_v<Compare, std::less<K>> || std::is_same_v<Compare, std::less<>>)};
+
+    using KeyAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<K>;
+public:
+    struct Iterator {
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = FrozenAvlTree::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        Iterator() = default;
+        Iterator& operator++() {
+            index = eytzinger::nextIndex(index, tree->keys.size());
+            return *this;
+        }
+        Iterator operator++(int) {
+            const Iterator old(*this);
+            ++(*this);
+            return old;
+        }
+        /**
+         * @brief Step back, where decrementing end() reaches the last element.
+         */
+        Iterator& operator--() {
+            const auto count(tree->keys.size());
+            index = index == 0 ? eytzinger::rightmostFrom(1, count) : eytzinger::prevIndex(index, count);
+            return *this;
+        }
+        Iterator operator--(int) {
+            const Iterator old(*this);
+            --(*this);
+            return old;
+        }
+        [[nodiscard]]
+        reference operator*() const {
+            return tree->elements[index - 1];
+        }
+        pointer operator->() const {
+            return &tree->elements[index - 1];
+        }
+        [[nodiscard]]
+        bool operator==(const Iterator& rhs) const {
+            return index == rhs.index;
+        }
+        friend std::ostream& operator<<(std::ostream& out, const Iterator& iter) {
+            if(iter.index == 0) {
+                return out << "end";
+            }
+            return out << "(" << iter->first << ", " << iter->second << ")";
+        }
+    private:
+        friend class FrozenAvlTree;
+        Iterator(const FrozenAvlTree* tree, size_t index) : tree(tree), index(index) {}
+        const FrozenAvlTree* tree{nullptr};
+        // The one based Eytzinger position of the element, 0 for end().
+        size_t index{0};
+    };
+
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+    template<typename Iter>
+    using Range = IteratorRange<Iter>;
+
+    FrozenAvlTree() = default;
+
+    /**
+     * @brief Copy the current contents of @p tree, along with its comparator.
+     */
+    template<typename Options>
+    explicit FrozenAvlTree(const AvlTree<K, V, Compare, Allocator, Options>& tree)
+        : keys(KeyAllocator(tree.get_allocator())), elements(tree.get_allocator()), comp(tree.key_comp()) {
+        build(tree.cbegin(), tree.cend(), tree.size());
+    }
+
+    /**
+     * @brief Copy the elements in [@p first, @p last), which must be sorted by key in
+     *        strictly increasing order.
+     */
+    template<std::forward_iterator Iter>
+    FrozenAvlTree(Iter first, Iter last, const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+        : keys(KeyAllocator(alloc)), elements(alloc), comp(comp) {
+        build(first, last, static_cast<size_t>(std::distance(first, last)));
+    }
+
+    [[nodiscard]]
+    const_iterator cbegin() const {
+        if(keys.empty()) {
+            return cend();
+        }
+        return const_iterator{this, eytzinger::leftmostFrom(1, keys.size())};
+    }
+
+    [[nodiscard]]
+    const_iterator begin() const {
+        return cbegin();
+    }
+
+    [[nodiscard]]
+    const_iterator cend() const {
+        return const_iterator{this, 0};
+    }
+
+    [[nodiscard]]
+    const_iterator end() const {
+        return cend();
+    }
+
+    [[nodiscard]]
+    const_iterator find(const K& key) const {
+        return findHelper(key);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator find(const Key& key) const {
+        return findHelper(key);
+    }
+
+    /**
+     * @brief The first element with a key not less than @p key.
+     */
+    [[nodiscard]]
+    const_iterator lower_bound(const K& key) const {
+        return const_iterator{this, lowerBoundIndex(key)};
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator lower_bound(const Key& key) const {
+        return const_iterator{this, lowerBoundIndex(key)};
+    }
+
+    /**
+     * @brief The first element with a key greater than @p key.
+     */
+    [[nodiscard]]
+    const_iterator upper_bound(const K& key) const {
+        return const_iterator{this, upperBoundIndex(key)};
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator upper_bound(const Key& key) const {
+        return const_iterator{this, upperBoundIndex(key)};
+    }
+
+    /**
+     * @brief The run of elements with a key equal to @p key, which holds at most one element.
+     */
+    [[nodiscard]]
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+        return equalRangeHelper(key);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const {
+        return equalRangeHelper(key);
+    }
+
+    /**
+     * @brief The elements with keys in the half open interval [@p low, @p high).
+     */
+    [[nodiscard]]
+    Range<const_iterator> range(const K& low, const K& high) const {
+        return {lower_bound(low), lower_bound(high)};
+    }
+
+    template<typename Low, typename High>
+    requires isTransparent
+    [[nodiscard]]
+    Range<const_iterator> range(const Low& low, const High& high) const {
+        return {lower_bound(low), lower_bound(high)};
+    }
+
+    /**
+     * @brief Look up every key in @p probes, storing the element found for each, or end(),
+     *        at the same index of @p out.
+     *
+     * Groups of descents advance one level at a time in lockstep so their cache misses
+     * overlap. With AVX2, 32 and 64 bit integer keys in their natural order descend a
+     * vector of lanes at a time. @p out must be at least as long as @p probes.
+     */
+    void find_batch(std::span<const K> probes, std::span<const_iterator> out) const {
+        lowerBoundBatch(probes, [&](const size_t index, const size_t position) {
+            out[index] = const_iterator{this, isMatch(position, probes[index]) ? position : 0};
+        });
+    }
+
+    /**
+     * @brief Store whether each key in @p probes is present at the same index of @p out.
+     *
+     * @return The number of keys that were found.
+     */
+    size_t contains_batch(std::span<const K> probes, std::span<bool> out) const {
+        size_t found(0);
+        lowerBoundBatch(probes, [&](const size_t index, const size_t position) {
+            out[index] = isMatch(position, probes[index]);
+            found += out[index] ? 1 : 0;
+        });
+        return found;
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return keys.empty();
+    }
+
+    [[nodiscard]]
+    auto size() const {
+        return keys.size();
+    }
+
+    [[nodiscard]]
+    allocator_type get_allocator() const {
+        return elements.get_allocator();
+    }
+
+    [[nodiscard]]
+    Compare key_comp() const {
+        return comp;
+    }
+
+    friend void swap(FrozenAvlTree& lhs, FrozenAvlTree& rhs) noexcept(std::is_nothrow_swappable_v<Compare>) {
+        using std::swap;
+        swap(lhs.keys, rhs.keys);
+        swap(lhs.elements, rhs.elements);
+        swap(lhs.comp, rhs.comp);
+    }
+
+private:
+    // Position i of the implicit tree lives at index i - 1 of both arrays.
+    std::vector<K, KeyAllocator> keys;
+    std::vector<value_type, Allocator> elements;
+    [[no_unique_address]] Compare comp;
+
+    /**
+     * @brief Lay out the @p count sorted elements starting at @p first in Eytzinger order.
+     */
+    template<typename Iter>
+    void build(Iter first, const Iter last, const size_t count) {
+        // Visiting the positions in order pairs each with the rank of its element, then both
+        // arrays are filled front to back so nothing needs to be default constructible.
+        std::vector<Iter> inOrder;
+        inOrder.reserve(count);
+        std::vector<size_t> rankAt(count);
+        for(size_t index(count > 0 ? eytzinger::leftmostFrom(1, count) : 0); first != last; ++first) {
+            rankAt[index - 1] = inOrder.size();
+            inOrder.push_back(first);
+            index = eytzinger::nextIndex(index, count);
+        }
+        keys.reserve(count);
+        elements.reserve(count);
+        for(const auto rank : rankAt) {
+            const auto& element(*inOrder[rank]);
+            keys.push_back(element.first);
+            elements.emplace_back(element);
+        }
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    size_t lowerBoundIndex(const Key& key) const {
+        return eytzinger::descend(keys.data(), keys.size(), [&](const K& candidate) { return comp(candidate, key); });
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    size_t upperBoundIndex(const Key& key) const {
+        return eytzinger::descend(keys.data(), keys.size(), [&](const K& candidate) { return !comp(key, candidate); });
+    }
+
+    /**
+     * @brief Whether @p position, the lower bound of @p key, holds an element equal to it.
+     */
+    template<typename Key>
+    [[nodiscard]]
+    bool isMatch(const size_t position, const Key& key) const {
+        return position != 0 && !comp(key, keys[position - 1]);
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    const_iterator findHelper(const Key& key) const {
+        const auto index(lowerBoundIndex(key));
+        return const_iterator{this, isMatch(index, key) ? index : 0};
+    }
+
+    /**
+     * @brief Find the lower bound of every key in @p probes, calling @p visit with its index and position.
+     */
+    template<typename Visit>
+    void lowerBoundBatch(std::span<const K> probes, const Visit& visit) const {
+        size_t first(0);
+#if defined(__AVX2__)
+        if constexpr(vectorKeys) {
+            first = lowerBoundBatchVector(probes, visit);
+        }
+#endif
+        const auto* const base(keys.data());
+        const auto count(keys.size());
+        std::array<size_t, batchGroupSize> positions{};
+        for(; first < probes.size(); first += batchGroupSize) {
+            const auto group(std::min(batchGroupSize, probes.size() - first));
+            std::fill_n(positions.begin(), group, 1);
+            // Descents differ in depth by at most one level, so they all finish within bit_width(count) passes.
+            for(auto levels(std::bit_width(count)); levels > 0; --levels) {
+                for(size_t i(0); i < group; ++i) {
+                    auto& position(positions[i]);
+                    if(position <= count) {
+                        position = 2 * position + static_cast<size_t>(comp(base[position - 1], probes[first + i]));
+                        prefetch(base + std::min(position, count) - 1);
+                    }
+                }
+            }
+            for(size_t i(0); i < group; ++i) {
+                visit(first + i, eytzinger::lastLeftTurn(positions[i]));
+            }
+        }
+    }
+
+#if defined(__AVX2__)
+    // One lane per key, with positions in lanes as wide as the keys.
+    static constexpr size_t vectorLanes{32 / sizeof(K)};
+    static constexpr size_t vectorsPerGroup{4};
+
+    [[nodiscard]]
+    static __m256i broadcast(const std::int64_t value) {
+        if constexpr(sizeof(K) == 4) {
+            return _mm256_set1_epi32(static_cast<std::int32_t>(value));
+        } else {
+            return _mm256_set1_epi64x(value);
+        }
+    }
+
+    [[nodiscard]]
+    static __m256i addLanes(const __m256i lhs, const __m256i rhs) {
+        if constexpr(sizeof(K) == 4) {
+            return _mm256_add_epi32(lhs, rhs);
+        } else {
+            return _mm256_add_epi64(lhs, rhs);
+        }
+    }
+
+    [[nodiscard]]
+    static __m256i subLanes(const __m256i lhs, const __m256i rhs) {
+        if constexpr(sizeof(K) == 4) {
+            return _mm256_sub_epi32(lhs, rhs);
+        } else {
+            return _mm256_sub_epi64(lhs, rhs);
+        }
+    }
+
+    /**
+     * @brief All ones in the lanes where @p lhs is greater than @p rhs, as signed integers.
+     */
+    [[nodiscard]]
+    static __m256i greaterLanes(const __m256i lhs, const __m256i rhs) {
+        if constexpr(sizeof(K) == 4) {
+            return _mm256_cmpgt_epi32(lhs, rhs);
+        } else {
+            return _mm256_cmpgt_epi64(lhs, rhs);
+        }
+    }
+
+    /**
+     * @brief Flip the sign bit of unsigned keys so a signed comparison orders them correctly.
+     */
+    [[nodiscard]]
+    static __m256i toSigned(const __m256i lanes) {
+        if constexpr(std::is_unsigned_v<K>) {
+            return _mm256_xor_si256(lanes, broadcast(std::numeric_limits<std::make_signed_t<K>>::min()));
+        } else {
+            return lanes;
+        }
+    }
+
+    /**
+     * @brief Load the key at each one based position in @p positions, or zero where @p mask is clear.
+     */
+    [[nodiscard]]
+    __m256i gatherKeys(const __m256i positions, const __m256i mask) const {
+        const auto indices(subLanes(positions, broadcast(1)));
+        if constexpr(sizeof(K) == 4) {
+            return toSigned(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+                                                        reinterpret_cast<const int*>(keys.data()), indices, mask, 4));
+        } else {
+            return toSigned(_mm256_mask_i64gather_epi64(_mm256_setzero_si256(),
+                                                        reinterpret_cast<const long long*>(keys.data()), indices, mask, 8));
+        }
+    }
+
+    /**
+     * @brief The vector counterpart of lowerBoundBatch(), for as many whole groups as @p probes holds.
+     *
+     * @return The number of probes handled, the rest are left to the scalar loop.
+     */
+    template<typename Visit>
+    size_t lowerBoundBatchVector(std::span<const K> probes, const Visit& visit) const {
+        constexpr size_t groupSize(vectorLanes * vectorsPerGroup);
+        const auto count(keys.size());
+        // Positions may reach 2 * count + 1 and must stay positive in a signed lane.
+        if(count == 0 || count >= (size_t{1} << (8 * sizeof(K) - 2))) {
+            return 0;
+        }
+        const auto allLanes(broadcast(-1));
+        const auto beyondLast(broadcast(static_cast<std::int64_t>(count) + 1));
+        // Every level above the last one is full, so only the final step needs a mask.
+        const auto fullLevels(std::bit_width(count) - 1);
+        size_t first(0);
+        for(; first + groupSize <= probes.size(); first += groupSize) {
+            // std::array would drop the alignment attributes of the vector type.
+            __m256i positions[vectorsPerGroup]; // NOLINT(modernize-avoid-c-arrays)
+            __m256i targets[vectorsPerGroup]; // NOLINT(modernize-avoid-c-arrays)
+            for(size_t v(0); v < vectorsPerGroup; ++v) {
+                positions[v] = broadcast(1);
+                targets[v] = toSigned(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(probes.data() + first + v * vectorLanes)));
+            }
+            for(auto level(fullLevels); level > 0; --level) {
+                for(size_t v(0); v < vectorsPerGroup; ++v) {
+                    // Going right adds one to the doubled position, and a set lane is minus one.
+                    const auto goRight(greaterLanes(targets[v], gatherKeys(positions[v], allLanes)));
+                    positions[v] = subLanes(addLanes(positions[v], positions[v]), goRight);
+                }
+            }
+            for(size_t v(0); v < vectorsPerGroup; ++v) {
+                const auto present(greaterLanes(beyondLast, positions[v]));
+                const auto goRight(_mm256_and_si256(present, greaterLanes(targets[v], gatherKeys(positions[v], present))));
+                const auto next(subLanes(addLanes(positions[v], positions[v]), goRight));
+                positions[v] = _mm256_blendv_epi8(positions[v], next, present);
+            }
+            for(size_t v(0); v < vectorsPerGroup; ++v) {
+                alignas(32) std::array<std::make_unsigned_t<K>, vectorLanes> lanes;
+                _mm256_store_si256(reinterpret_cast<__m256i*>(lanes.data()), positions[v]);
+                for(size_t lane(0); lane < vectorLanes; ++lane) {
+                    const auto position(static_cast<size_t>(lanes[lane]));
+                    visit(first + v * vectorLanes + lane, eytzinger::lastLeftTurn(position));
+                }
+            }
+        }
+        return first;
+    }
+#endif
+
+    template<typename Key>
+    [[nodiscard]]
+    std::pair<const_iterator, const_iterator> equalRangeHelper(const Key& key) const {
+        auto first(lower_bound(key));
+        if(first == cend() || comp(key, first->first)) {
+            return {first, first};
+        }
+        auto last(first);
+        return {first, ++last};
+    }
+};
+
+template<typename K, typename V, typename Compare, typename Allocator, typename Options>
+FrozenAvlTree(const AvlTree<K, V, Compare, Allocator, Options>&) -> FrozenAvlTree<K, V, Compare, Allocator>;
+
+}
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+
+#include "AvlTree.hpp"
+#include "Crc32c.hpp"
+#include "File.hpp"
+#include "MappedAvlTree.hpp"
+
+namespace algos {
+
+/**
+ * @brief An AvlTree that appends every change to a log on disk, so it can be recovered after
+ *        a restart without being saved whole after every change.
+ *
+ * The tree at @p path is kept as a snapshot written by MappedAvlTree::save() plus a log of the
+ * changes made since, at the same path with ".log" appended. Each insert, assignment or erase
+ * that changes the tree appends a fixed size binary record to a buffer, which is written out
+ * once it holds a batch of them. Every batch is framed by its length and a CRC-32C of it.
+ * sync() makes every change so far durable with a single fsync, so its cost is proportional
+ * to the changes and a group of them shares it. checkpoint() is a compaction that writes all
+ * of the tree as a new snapshot, O(n) whatever changed, and empties the log.
+ *
+ * Opening a tree reads the snapshot and the log, sorts the changes by key and merges them with
+ * the snapshot into a sorted run that is bulk loaded with AvlTree::assign_sorted(). Replay stops
+ * at the first batch that is cut short, fails its checksum or does not hold whole records, which
+ * is what a crash leaves of the last write, such as a tail of zeros. The log is cut back to the
+ * batches before it, so later changes are not appended after it.
+ *
+ * @tparam K The type of keys used to identify elements, which must be trivially copyable.
+ * @tparam V The type of value associated with each key, which must be trivially copyable.
+ * @tparam Compare A function used for ordering keys, it is stored in the tree and may carry state.
+ * @tparam Allocator The allocator used to obtain the chunks nodes are carved from.
+ * @tparam Options The optional features enabled for the tree, see AvlTreeOptions.
+ */
+template<typename K, typename V, typename Compare=std::less<K>, typename Allocator=std::allocator<std::pair<K, V>>,
+         typename Options=AvlTreeOptions>
+class LoggedAvlTree {
+    static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>,
+                  "Only trivially copyable keys and values can be logged byte for byte");
+public:
+    using Tree = AvlTree<K, V, Compare, Allocator, Options>;
+    using value_type = typename Tree::value_type;
+    using allocator_type = Allocator;
+
+    // Enough records to amortize a write, few enough that a batch stays small.
+    static constexpr size_t defaultBatchBytes{64 * 1024};
+private:
+    enum class Operation : std::uint8_t {
+        Put = 1,
+        Erase = 2
+    };
+
+    static constexpr std::array<char, 8> logMagic{'a', 'l', 'g', 'o', 's', 'l', 'o', 'g'};
+    static constexpr std::uint32_t logVersion{2};
+
+    struct LogHeader {
+        std::array<char, 8> magic;
+        // Written as one, which reads back as something else on a machine of the other byte order.
+        std::uint32_t byteOrder;
+        std::uint32_t version;
+        std::uint32_t keySize;
+        std::uint32_t valueSize;
+    };
+
+    // Ahead of the records of every batch, the checksum covers the length and the records.
+    struct BatchHeader {
+        std::uint32_t length;
+        std::uint32_t checksum;
+    };
+
+    static constexpr size_t putSize{1 + sizeof(K) + sizeof(V)};
+    static constexpr size_t eraseSize{1 + sizeof(K)};
+
+    // The last change the log holds for a key, with no value if it was erased.
+    struct Change {
+        K key;
+        std::optional<V> value;
+    };
+public:
+    /**
+     * @brief Open the tree at @p path, recovering what it held, or start an empty one there.
+     *
+     * @param batchBytes How many bytes of records to buffer before writing them out.
+     * @throws std::system_error If the snapshot or the log cannot be read, or the log cannot be opened.
+     * @throws std::runtime_error If the snapshot or the log was not written for these keys and values.
+     */
+    explicit LoggedAvlTree(std::filesystem::path path, const size_t batchBytes = defaultBatchBytes,
+                           const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+        : elements(comp, alloc), path(std::move(path)), log(recover()), batchBytes(batchBytes) {
+        // Room for a whole batch and one more record, so appending never allocates.
+        buffer.reserve(sizeof(BatchHeader) + batchBytes + putSize);
+        buffer.resize(sizeof(BatchHeader));
+    }
+
+    LoggedAvlTree(const LoggedAvlTree&) = delete;
+    LoggedAvlTree& operator=(const LoggedAvlTree&) = delete;
+
+    /**
+     * @brief Write out whatever is still buffered, without waiting for it to become durable.
+     */
+    ~LoggedAvlTree() {
+        try {
+            flush();
+        } catch(...) {
+            // The records are lost, which a crash at this point would have done as well.
+        }
+    }
+
+    /**
+     * @brief Insert @p key with @p value unless @p key is present, logging the insert if it happens.
+     *
+     * @return Whether the element was inserted.
+     */
+    bool insert(const K& key, const V& value) {
+        const auto inserted(elements.insert(key, value).second);
+        if(inserted) {
+            append(Operation::Put, key, &value);
+        }
+        return inserted;
+    }
+
+    /**
+     * @brief Insert @p key with @p value, or assign @p value to the existing element, and log it.
+     *
+     * @return Whether the element was newly inserted.
+     */
+    bool insert_or_assign(const K& key, const V& value) {
+        const auto inserted(elements.insert_or_assign(key, value).second);
+        append(Operation::Put, key, &value);
+        return inserted;
+    }
+
+    /**
+     * @brief Erase the element with @p key, logging the erase if there was one.
+     */
+    bool erase(const K& key) {
+        const auto erased(elements.erase(key));
+        if(erased) {
+            append(Operation::Erase, key, nullptr);
+        }
+        return erased;
+    }
+
+    /**
+     * @brief Write out every buffered record and wait until all of the log has become durable.
+     */
+    void sync() {
+        flush();
+        log.sync();
+    }
+
+    /**
+     * @brief Save all of the tree as a new snapshot and empty the log, which bounds the time
+     *        and space recovery takes.
+     *
+     * This writes every element, not only those changed since the last checkpoint, so it
+     * costs O(n) and is meant to be called once the log has grown large. The snapshot is
+     * durable before the log is emptied, so a crash in between only replays changes the
+     * snapshot already holds.
+     */
+    void checkpoint() {
+        flush();
+        MappedAvlTree<K, V, Compare>::save(elements, path);
+        log.resize(sizeof(LogHeader));
+        log.sync();
+    }
+
+    /**
+     * @brief The elements of the tree, to read through.
+     */
+    [[nodiscard]]
+    const Tree& tree() const {
+        return elements;
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return elements.empty();
+    }
+
+    [[nodiscard]]
+    auto size() const {
+        return elements.size();
+    }
+
+    /**
+     * @brief The number of records buffered and not yet written out.
+     */
+    [[nodiscard]]
+    size_t pending() const {
+        return pendingRecords;
+    }
+
+private:
+    Tree elements;
+    std::filesystem::path path;
+    File log;
+    // A header for the batch, then its records.
+    std::vector<std::byte> buffer;
+    size_t batchBytes;
+    size_t pendingRecords{0};
+    // How much of the buffer the header of the batch being written covers, and how much of
+    // that has been written, both zero unless a write failed part of the way through.
+    size_t framed{0};
+    size_t written{0};
+
+    [[nodiscard]]
+    std::filesystem::path logPath() const {
+        auto logged(path);
+        logged += ".log";
+        return logged;
+    }
+
+    [[nodiscard]]
+    static LogHeader expectedHeader() {
+        return {logMagic, 1, logVersion, sizeof(K), sizeof(V)};
+    }
+
+    template<typename T>
+    [[nodiscard]]
+    static T load(const std::byte* const bytes) {
+        std::array<std::byte, sizeof(T)> raw;
+        std::memcpy(raw.data(), bytes, sizeof(T));
+        return std::bit_cast<T>(raw);
+    }
+
+    void append(const Operation operation, const K& key, const V* const value) {
+        const auto start(buffer.size());
+        buffer.resize(start + (value != nullptr ? putSize : eraseSize));
+        buffer[start] = static_cast<std::byte>(operation);
+        std::memcpy(buffer.data() + start + 1, &key, sizeof(K));
+        if(value != nullptr) {
+            std::memcpy(buffer.data() + start + 1 + sizeof(K), value, sizeof(V));
+        }
+        ++pendingRecords;
+        if(buffer.size() - sizeof(BatchHeader) >= batchBytes) {
+            flush();
+        }
+    }
+
+    /**
+     * @brief Frame and write out the buffered records. A retry after a failed write resumes
+     *        that batch where the write stopped, records appended since go in the next one.
+     */
+    void flush() {
+        while(buffer.size() > sizeof(BatchHeader)) {
+            if(framed == 0) {
+                framed = buffer.size();
+                const auto length(static_cast<std::uint32_t>(framed - sizeof(BatchHeader)));
+                std::memcpy(buffer.data(), &length, sizeof(length));
+                const auto checksum(checksumOf(buffer.data(), length));
+                std::memcpy(buffer.data() + sizeof(length), &checksum, sizeof(checksum));
+            }
+            while(written < framed) {
+                written += log.writeSome(std::span(buffer).subspan(written, framed - written));
+            }
+            buffer.erase(buffer.begin() + sizeof(BatchHeader), buffer.begin() + static_cast<std::ptrdiff_t>(framed));
+            framed = 0;
+            written = 0;
+        }
+        pendingRecords = 0;
+    }
+
+    /**
+     * @brief The checksum of a batch of @p length bytes of records whose header is at @p batch.
+     */
+    [[nodiscard]]
+    static std::uint32_t checksumOf(const std::byte* const batch, const std::uint32_t length) {
+        const auto lengthBytes(std::span(batch, sizeof(length)));
+        return crc32c(std::span(batch + sizeof(BatchHeader), length), crc32c(lengthBytes));
+    }
+
+    /**
+     * @brief Load the snapshot and replay the log into the tree, then open the log for appending.
+     */
+    [[nodiscard]]
+    File recover() {
+        const auto logged(logPath());
+        std::vector<std::byte> bytes;
+        if(std::filesystem::exists(logged)) {
+            std::ifstream in(logged, std::ios::binary);
+            bytes.resize(static_cast<size_t>(std::filesystem::file_size(logged)));
+            if(!in.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+                throw std::runtime_error("could not read " + logged.string());
+            }
+        }
+        const auto expected(expectedHeader());
+        if(!bytes.empty()) {
+            LogHeader header{};
+            if(bytes.size() >= sizeof(header)) {
+                std::memcpy(&header, bytes.data(), sizeof(header));
+            }
+            if(bytes.size() < sizeof(header) || header.magic != expected.magic || header.byteOrder != 1 ||
+               header.version != expected.version || header.keySize != sizeof(K) || header.valueSize != sizeof(V)) {
+                throw std::runtime_error(logged.string() + " is not a log of these keys and values");
+            }
+        }
+        const auto validLength(replay(bytes));
+
+        File file(logged, O_WRONLY | O_CREAT | O_APPEND);
+        if(bytes.empty()) {
+            file.write(std::as_bytes(std::span(&expected, 1)));
+        } else if(validLength < bytes.size()) {
+            // Appending after a torn batch would leave the batches that follow unreadable, and
+            // the cut has to be durable before they are written.
+            file.resize(validLength);
+            file.sync();
+        }
+        return file;
+    }
+
+    /**
+     * @brief Rebuild the tree from the snapshot and the batches of records in @p bytes.
+     *
+     * @return The length of the log up to the end of its last intact batch.
+     */
+    [[nodiscard]]
+    size_t replay(std::span<const std::byte> bytes) {
+        std::vector<Change> changes;
+        size_t offset(bytes.empty() ? 0 : sizeof(LogHeader));
+        while(bytes.size() - offset >= sizeof(BatchHeader)) {
+            const auto header(load<BatchHeader>(bytes.data() + offset));
+            if(header.length == 0 || header.length > bytes.size() - offset - sizeof(BatchHeader) ||
+               header.checksum != checksumOf(bytes.data() + offset, header.length) ||
+               !parseBatch(bytes.subspan(offset + sizeof(BatchHeader), header.length), changes)) {
+                break;
+            }
+            offset += sizeof(BatchHeader) + header.length;
+        }
+
+        // A stable sort keeps the changes to each key in the order they were made, the last one wins.
+        const auto comp(elements.key_comp());
+        std::stable_sort(changes.begin(), changes.end(),
+                         [&](const Change& lhs, const Change& rhs) { return comp(lhs.key, rhs.key); });
+        std::optional<MappedAvlTree<K, V, Compare>> snapshot;
+        if(std::filesystem::exists(path)) {
+            snapshot.emplace(path, comp);
+        }
+        std::vector<value_type> merged;
+        merged.reserve((snapshot ? snapshot->size() : 0) + changes.size());
+        auto base(snapshot ? snapshot->begin() : typename MappedAvlTree<K, V, Compare>::const_iterator{});
+        const auto baseEnd(snapshot ? snapshot->end() : base);
+        for(size_t i(0); i < changes.size(); ++i) {
+            const auto& change(changes[i]);
+            if(i + 1 < changes.size() && !comp(change.key, changes[i + 1].key)) {
+                continue;
+            }
+            for(; base != baseEnd && comp(base->first, change.key); ++base) {
+                merged.emplace_back(base->first, base->second);
+            }
+            if(base != baseEnd && !comp(change.key, base->first)) {
+                ++base;
+            }
+            if(change.value) {
+                merged.emplace_back(change.key, *change.value);
+            }
+        }
+        for(; base != baseEnd; ++base) {
+            merged.emplace_back(base->first, base->second);
+        }
+        elements.assign_sorted(merged.begin(), merged.end());
+        return offset;
+    }
+
+    /**
+     * @brief Append the changes recorded in @p records to @p changes, unless they are not all
+     *        whole records, which leaves @p changes as it was.
+     */
+    [[nodiscard]]
+    static bool parseBatch(const std::span<const std::byte> records, std::vector<Change>& changes) {
+        const auto before(changes.size());
+        for(size_t offset(0); offset < records.size();) {
+            const auto operation(static_cast<Operation>(records[offset]));
+            const auto size(operation == Operation::Put ? putSize : eraseSize);
+            if((operation != Operation::Put && operation != Operation::Erase) || size > records.size() - offset) {
+                changes.erase(changes.begin() + static_cast<std::ptrdiff_t>(before), changes.end());
+                return false;
+            }
+            const auto key(load<K>(records.data() + offset + 1));
+            if(operation == Operation::Put) {
+                changes.push_back({key, load<V>(records.data() + offset + 1 + sizeof(K))});
+            } else {
+                changes.push_back({key, std::nullopt});
+            }
+            offset += size;
+        }
+        return true;
+    }
+};
+
+}
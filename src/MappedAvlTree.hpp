@@ -0,0 +1,438 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "AvlTree.hpp"
+#include "Eytzinger.hpp"
+#include "File.hpp"
+
+namespace algos {
+
+/**
+ * @brief A read-only view of the elements of an AvlTree saved to a file, searched in place
+ *        through a memory mapping.
+ *
+ * save() lays the elements out the way FrozenAvlTree keeps them, keys in an array of their own
+ * followed by the elements, both in Eytzinger order. The layout holds no pointers, only offsets
+ * from the start of the file, so opening it maps the file and checks its header without reading
+ * or converting anything. Pages are faulted in as lookups touch them and are shared through the
+ * page cache by every process mapping the same file.
+ *
+ * The file records the sizes of the keys and values but not their types or the comparator,
+ * which must be the same as those it was saved with. Its byte order is that of the machine
+ * that saved it.
+ *
+ * @tparam K The type of keys used to identify elements, which must be trivially copyable.
+ * @tparam V The type of value associated with each key, which must be trivially copyable.
+ * @tparam Compare A function used for ordering keys, it is stored and may carry state.
+ */
+template<typename K, typename V, typename Compare=std::less<K>>
+class MappedAvlTree {
+    static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>,
+                  "Only trivially copyable keys and values can be used straight from a file");
+public:
+    /**
+     * @brief An element as it is stored in the file, std::pair being not trivially copyable.
+     */
+    struct value_type {
+        K first;
+        V second;
+    };
+private:
+    static constexpr bool isTransparent{requires { typename Compare::is_transparent; }};
+    // Both arrays start on a cache line of their own, mappings start on a page boundary.
+    static constexpr size_t arrayAlignment{64};
+    static_assert(alignof(value_type) <= arrayAlignment);
+
+    static constexpr std::array<char, 8> fileMagic{'a', 'l', 'g', 'o', 's', 'a', 'v', 'l'};
+    static constexpr std::uint32_t fileVersion{1};
+
+    struct FileHeader {
+        std::array<char, 8> magic;
+        // Written as one, which reads back as something else on a machine of the other byte order.
+        std::uint32_t byteOrder;
+        std::uint32_t version;
+        std::uint64_t keySize;
+        std::uint64_t elementSize;
+        std::uint64_t count;
+        std::uint64_t keysOffset;
+        std::uint64_t elementsOffset;
+    };
+public:
+    struct Iterator {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = MappedAvlTree::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        Iterator() = default;
+        Iterator& operator++() {
+            index = eytzinger::nextIndex(index, tree->count);
+            return *this;
+        }
+        Iterator operator++(int) {
+            const Iterator old(*this);
+            ++(*this);
+            return old;
+        }
+        [[nodiscard]]
+        reference operator*() const {
+            return tree->elements[index - 1];
+        }
+        pointer operator->() const {
+            return &tree->elements[index - 1];
+        }
+        [[nodiscard]]
+        bool operator==(const Iterator& rhs) const {
+            return index == rhs.index;
+        }
+        friend std::ostream& operator<<(std::ostream& out, const Iterator& iter) {
+            if(iter.index == 0) {
+                return out << "end";
+            }
+            return out << "(" << iter->first << ", " << iter->second << ")";
+        }
+    private:
+        friend class MappedAvlTree;
+        Iterator(const MappedAvlTree* tree, size_t index) : tree(tree), index(index) {}
+        const MappedAvlTree* tree{nullptr};
+        // The one based Eytzinger position of the element, 0 for end().
+        size_t index{0};
+    };
+
+    using iterator = Iterator;
+    using const_iterator = Iterator;
+    template<typename Iter>
+    using Range = IteratorRange<Iter>;
+
+    MappedAvlTree() = default;
+
+    /**
+     * @brief Map the file at @p path, which save() wrote.
+     *
+     * @throws std::system_error If the file cannot be opened or mapped.
+     * @throws std::runtime_error If the file was not saved by a tree of the same key and value sizes.
+     */
+    explicit MappedAvlTree(const std::filesystem::path& path, const Compare& comp = Compare()) : comp(comp) {
+        const File file(path, O_RDONLY);
+        const auto length(file.size());
+        if(length < sizeof(FileHeader)) {
+            throw std::runtime_error(path.string() + " is too short to be a saved tree");
+        }
+        Mapping mapping(file, length, PROT_READ);
+        FileHeader header;
+        std::memcpy(&header, mapping.data, sizeof(header));
+        // Each of the offsets and the count is bounded by the length before any of them is added up.
+        if(header.magic != fileMagic || header.byteOrder != 1 || header.version != fileVersion ||
+           header.keySize != sizeof(K) || header.elementSize != sizeof(value_type) ||
+           header.keysOffset > length || header.elementsOffset > length || header.count > length ||
+           header.keysOffset % arrayAlignment != 0 || header.elementsOffset % arrayAlignment != 0 ||
+           header.keysOffset + header.count * sizeof(K) > header.elementsOffset ||
+           header.elementsOffset + header.count * sizeof(value_type) > length) {
+            throw std::runtime_error(path.string() + " does not hold a tree of these keys and values");
+        }
+        // Both arrays were written from objects of these trivially copyable types.
+        keys = reinterpret_cast<const K*>(mapping.data + header.keysOffset);
+        elements = reinterpret_cast<const value_type*>(mapping.data + header.elementsOffset);
+        count = header.count;
+        base = std::exchange(mapping.data, nullptr);
+        baseLength = length;
+    }
+
+    MappedAvlTree(const MappedAvlTree&) = delete;
+    MappedAvlTree& operator=(const MappedAvlTree&) = delete;
+
+    MappedAvlTree(MappedAvlTree&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare>)
+        : base(std::exchange(other.base, nullptr)),
+          baseLength(std::exchange(other.baseLength, 0)),
+          keys(std::exchange(other.keys, nullptr)),
+          elements(std::exchange(other.elements, nullptr)),
+          count(std::exchange(other.count, 0)),
+          comp(other.comp) {}
+
+    MappedAvlTree& operator=(MappedAvlTree&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare> &&
+                                                             std::is_nothrow_swappable_v<Compare>) {
+        MappedAvlTree moved(std::move(other));
+        swap(*this, moved);
+        return *this;
+    }
+
+    ~MappedAvlTree() {
+        if(base != nullptr) {
+            ::munmap(base, baseLength);
+        }
+    }
+
+    /**
+     * @brief Write the elements of @p tree to the file at @p path, replacing it if it exists.
+     *
+     * The file is written under a temporary name next to @p path and renamed over it once it is
+     * complete and flushed, so processes that still map an older version keep reading that one.
+     * The directory is flushed after the rename, so once this returns the new file survives a crash.
+     *
+     * @throws std::system_error If the file cannot be created, written, renamed or flushed.
+     */
+    template<typename Allocator, typename Options>
+    static void save(const AvlTree<K, V, Compare, Allocator, Options>& tree, const std::filesystem::path& path) {
+        write(tree.cbegin(), tree.cend(), tree.size(), path);
+    }
+
+    /**
+     * @brief Write the elements in [@p first, @p last), which must be sorted by key in strictly
+     *        increasing order, to the file at @p path, see save(const AvlTree&, const std::filesystem::path&).
+     */
+    template<std::forward_iterator Iter>
+    static void save(Iter first, Iter last, const std::filesystem::path& path) {
+        write(first, last, static_cast<size_t>(std::distance(first, last)), path);
+    }
+
+    [[nodiscard]]
+    const_iterator cbegin() const {
+        if(count == 0) {
+            return cend();
+        }
+        return const_iterator{this, eytzinger::leftmostFrom(1, count)};
+    }
+
+    [[nodiscard]]
+    const_iterator begin() const {
+        return cbegin();
+    }
+
+    [[nodiscard]]
+    const_iterator cend() const {
+        return const_iterator{this, 0};
+    }
+
+    [[nodiscard]]
+    const_iterator end() const {
+        return cend();
+    }
+
+    [[nodiscard]]
+    const_iterator find(const K& key) const {
+        return findHelper(key);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator find(const Key& key) const {
+        return findHelper(key);
+    }
+
+    /**
+     * @brief The first element with a key not less than @p key.
+     */
+    [[nodiscard]]
+    const_iterator lower_bound(const K& key) const {
+        return const_iterator{this, lowerBoundIndex(key)};
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator lower_bound(const Key& key) const {
+        return const_iterator{this, lowerBoundIndex(key)};
+    }
+
+    /**
+     * @brief The first element with a key greater than @p key.
+     */
+    [[nodiscard]]
+    const_iterator upper_bound(const K& key) const {
+        return const_iterator{this, upperBoundIndex(key)};
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator upper_bound(const Key& key) const {
+        return const_iterator{this, upperBoundIndex(key)};
+    }
+
+    /**
+     * @brief The run of elements with a key equal to @p key, which holds at most one element.
+     */
+    [[nodiscard]]
+    std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+        return equalRangeHelper(key);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    std::pair<const_iterator, const_iterator> equal_range(const Key& key) const {
+        return equalRangeHelper(key);
+    }
+
+    /**
+     * @brief The elements with keys in the half open interval [@p low, @p high).
+     */
+    [[nodiscard]]
+    Range<const_iterator> range(const K& low, const K& high) const {
+        return {lower_bound(low), lower_bound(high)};
+    }
+
+    template<typename Low, typename High>
+    requires isTransparent
+    [[nodiscard]]
+    Range<const_iterator> range(const Low& low, const High& high) const {
+        return {lower_bound(low), lower_bound(high)};
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return count == 0;
+    }
+
+    [[nodiscard]]
+    auto size() const {
+        return count;
+    }
+
+    [[nodiscard]]
+    Compare key_comp() const {
+        return comp;
+    }
+
+    friend void swap(MappedAvlTree& lhs, MappedAvlTree& rhs) noexcept(std::is_nothrow_swappable_v<Compare>) {
+        using std::swap;
+        swap(lhs.base, rhs.base);
+        swap(lhs.baseLength, rhs.baseLength);
+        swap(lhs.keys, rhs.keys);
+        swap(lhs.elements, rhs.elements);
+        swap(lhs.count, rhs.count);
+        swap(lhs.comp, rhs.comp);
+    }
+
+private:
+    // The whole mapping, or nullptr for a tree that maps nothing.
+    void* base{nullptr};
+    size_t baseLength{0};
+    // Position i of the implicit tree lives at index i - 1 of both arrays.
+    const K* keys{nullptr};
+    const value_type* elements{nullptr};
+    size_t count{0};
+    [[no_unique_address]] Compare comp;
+
+    // Owns a shared mapping of a whole file until it goes out of scope, unless it is taken over.
+    struct Mapping {
+        Mapping(const File& file, const size_t length, const int protection) : length(length) {
+            auto* const mapped(::mmap(nullptr, length, protection, MAP_SHARED, file.descriptor(), 0));
+            if(mapped == MAP_FAILED) {
+                file.fail("mmap");
+            }
+            data = static_cast<std::byte*>(mapped);
+        }
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        ~Mapping() {
+            if(data != nullptr) {
+                ::munmap(data, length);
+            }
+        }
+
+        std::byte* data{nullptr};
+        size_t length;
+    };
+
+    [[nodiscard]]
+    static constexpr std::uint64_t alignUp(const std::uint64_t offset) {
+        return (offset + arrayAlignment - 1) / arrayAlignment * arrayAlignment;
+    }
+
+    /**
+     * @brief Write the @p count sorted elements starting at @p first, each straight to its
+     *        Eytzinger position in a mapping of the new file.
+     */
+    template<typename Iter>
+    static void write(Iter first, const Iter last, const size_t count, const std::filesystem::path& path) {
+        FileHeader header{fileMagic, 1, fileVersion, sizeof(K), sizeof(value_type), count, 0, 0};
+        header.keysOffset = alignUp(sizeof(FileHeader));
+        header.elementsOffset = alignUp(header.keysOffset + count * sizeof(K));
+        const auto length(static_cast<size_t>(header.elementsOffset + count * sizeof(value_type)));
+
+        auto temporary(path);
+        temporary += ".tmp";
+        try {
+            const File file(temporary, O_RDWR | O_CREAT | O_TRUNC);
+            file.resize(length);
+            {
+                const Mapping mapping(file, length, PROT_READ | PROT_WRITE);
+                std::memcpy(mapping.data, &header, sizeof(header));
+                auto* const keysOut(mapping.data + header.keysOffset);
+                auto* const elementsOut(mapping.data + header.elementsOffset);
+                for(size_t index(count > 0 ? eytzinger::leftmostFrom(1, count) : 0); first != last; ++first) {
+                    const auto& [key, value](*first);
+                    const value_type element{key, value};
+                    std::memcpy(keysOut + (index - 1) * sizeof(K), &element.first, sizeof(K));
+                    std::memcpy(elementsOut + (index - 1) * sizeof(value_type), &element, sizeof(value_type));
+                    index = eytzinger::nextIndex(index, count);
+                }
+            }
+            file.sync();
+        } catch(...) {
+            std::error_code ignored;
+            std::filesystem::remove(temporary, ignored);
+            throw;
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if(error) {
+            std::filesystem::remove(temporary, error);
+            throw std::system_error(error, "rename " + temporary.string());
+        }
+        // The rename is only durable once the directory holding the new name is.
+        const auto directory(path.parent_path());
+        File(directory.empty() ? std::filesystem::path(".") : directory, O_RDONLY | O_DIRECTORY).sync();
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    size_t lowerBoundIndex(const Key& key) const {
+        return eytzinger::descend(keys, count, [&](const K& candidate) { return comp(candidate, key); });
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    size_t upperBoundIndex(const Key& key) const {
+        return eytzinger::descend(keys, count, [&](const K& candidate) { return !comp(key, candidate); });
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    const_iterator findHelper(const Key& key) const {
+        const auto index(lowerBoundIndex(key));
+        return const_iterator{this, index != 0 && !comp(key, keys[index - 1]) ? index : 0};
+    }
+
+    template<typename Key>
+    [[nodiscard]]
+    std::pair<const_iterator, const_iterator> equalRangeHelper(const Key& key) const {
+        auto first(lower_bound(key));
+        if(first == cend() || comp(key, first->first)) {
+            return {first, first};
+        }
+        auto last(first);
+        return {first, ++last};
+    }
+};
+
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace algos {
+
+/**
+ * @brief A slab allocator handing out storage for objects of a single type.
+ *
+ * Storage is obtained from @p Allocator in chunks of contiguous slots. Slots given back with
+ * deallocate() are threaded onto a free list and handed out again by later allocations, so a
+ * workload with heavy churn stops touching @p Allocator once the pool has grown to its peak
+ * size. Chunks are only returned to @p Allocator by release() or when the pool is destroyed.
+ *
+ * Pools can also hand their chunks to one another with share() and adopt(), so that objects
+ * outlive the pool they were allocated from. Shared chunks are returned once every pool
+ * holding on to them has released them, which may happen on different threads.
+ *
+ * @tparam T The type of objects stored in the pool.
+ * @tparam Allocator The allocator used to obtain chunks, it is rebound as needed.
+ */
+template<typename T, typename Allocator=std::allocator<T>>
+class NodePool {
+    union Slot {
+        Slot* next;
+        struct {
+            Slot* next;
+            size_t capacity;
+        } chunk;
+        alignas(T) std::byte storage[sizeof(T)];
+    };
+    using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Slot>;
+    using SlotTraits = std::allocator_traits<SlotAllocator>;
+
+    // Chunks held by more than one pool. Groups nest when pools holding different
+    // groups are merged, a group frees its chunks and lets go of its nested groups
+    // once the last pool or group referring to it does.
+    struct Group {
+        std::atomic<size_t> refs{1};
+        Slot* chunks{nullptr};
+        std::array<Group*, 2> nested{};
+        // Links groups that are being freed, so freeing nested groups needs no recursion.
+        Group* nextDead{nullptr};
+    };
+    using GroupAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Group>;
+    using GroupTraits = std::allocator_traits<GroupAllocator>;
+
+    // Every chunk reserves its first slot to link it into the list of chunks.
+    static constexpr size_t minChunkSlots{16};
+    static constexpr size_t maxChunkSlots{size_t{1} << 16};
+
+public:
+    using allocator_type = Allocator;
+
+    explicit NodePool(const Allocator& alloc = Allocator()) : allocator(alloc) {}
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    NodePool(NodePool&& other) noexcept
+        : allocator(std::move(other.allocator)),
+          chunks(std::exchange(other.chunks, nullptr)),
+          shared(std::exchange(other.shared, nullptr)),
+          freeList(std::exchange(other.freeList, nullptr)),
+          bumpBegin(std::exchange(other.bumpBegin, nullptr)),
+          bumpEnd(std::exchange(other.bumpEnd, nullptr)),
+          nextChunkSlots(std::exchange(other.nextChunkSlots, minChunkSlots)) {}
+
+    NodePool& operator=(NodePool&& other) noexcept {
+        if(this != &other) {
+            release();
+            allocator = std::move(other.allocator);
+            chunks = std::exchange(other.chunks, nullptr);
+            shared = std::exchange(other.shared, nullptr);
+            freeList = std::exchange(other.freeList, nullptr);
+            bumpBegin = std::exchange(other.bumpBegin, nullptr);
+            bumpEnd = std::exchange(other.bumpEnd, nullptr);
+            nextChunkSlots = std::exchange(other.nextChunkSlots, minChunkSlots);
+        }
+        return *this;
+    }
+
+    ~NodePool() {
+        release();
+    }
+
+    /**
+     * @brief Obtain uninitialized storage for a single @p T.
+     */
+    [[nodiscard]]
+    T* allocate() {
+        if(freeList != nullptr) {
+            auto* const slot(freeList);
+            freeList = slot->next;
+            return reinterpret_cast<T*>(slot->storage);
+        }
+        if(bumpBegin == bumpEnd) {
+            grow(nextChunkSlots);
+            nextChunkSlots = std::min(nextChunkSlots * 2, maxChunkSlots);
+        }
+        return reinterpret_cast<T*>((bumpBegin++)->storage);
+    }
+
+    /**
+     * @brief Return storage obtained from allocate() to the free list.
+     */
+    void deallocate(T* const ptr) noexcept {
+        auto* const slot(reinterpret_cast<Slot*>(ptr));
+        slot->next = freeList;
+        freeList = slot;
+    }
+
+    /**
+     * @brief Make room for @p count more objects in a single chunk.
+     *
+     * As long as the free list is empty, the next @p count allocations
+     * then return adjacent slots in increasing address order.
+     */
+    void reserve(const size_t count) {
+        if(static_cast<size_t>(bumpEnd - bumpBegin) < count) {
+            grow(count + 1);
+        }
+    }
+
+    template<typename... Args>
+    [[nodiscard]]
+    T* create(Args&&... args) {
+        auto* const ptr(allocate());
+        try {
+            return std::construct_at(ptr, std::forward<Args>(args)...);
+        } catch(...) {
+            deallocate(ptr);
+            throw;
+        }
+    }
+
+    void destroy(T* const ptr) noexcept {
+        std::destroy_at(ptr);
+        deallocate(ptr);
+    }
+
+    /**
+     * @brief Give every chunk back to the allocator at once.
+     *
+     * Objects still living in the pool are not destroyed, the caller must
+     * have destroyed them already unless @p T is trivially destructible.
+     */
+    void release() noexcept {
+        freeChunks(std::exchange(chunks, nullptr));
+        releaseGroup(std::exchange(shared, nullptr));
+        freeList = bumpBegin = bumpEnd = nullptr;
+        nextChunkSlots = minChunkSlots;
+    }
+
+    /**
+     * @brief An empty pool holding on to every chunk of this one, so objects allocated from
+     *        this pool may be destroyed through the new one and outlive this pool.
+     *
+     * The chunks are given back to the allocator once both pools have released them.
+     */
+    [[nodiscard]]
+    NodePool share() {
+        if(chunks != nullptr) {
+            shared = createGroup(chunks, shared, nullptr);
+            chunks = nullptr;
+        }
+        NodePool sharing(get_allocator());
+        if(shared != nullptr) {
+            shared->refs.fetch_add(1, std::memory_order_relaxed);
+            sharing.shared = shared;
+        }
+        return sharing;
+    }
+
+    /**
+     * @brief Take over every chunk of @p other, leaving it empty, so objects allocated from
+     *        either pool may be destroyed through this one.
+     *
+     * This takes time linear in the number of chunks only @p other holds and in how deeply
+     * the shared groups of both are nested. A group that already keeps the other one alive
+     * is taken as it is, so pools handing objects back and forth soon hold the same group
+     * and adopting one another allocates nothing. Slots @p other had not handed out yet are
+     * only reused if this pool has fewer of its own, the rest stay idle until the chunks
+     * are released.
+     */
+    void adopt(NodePool& other) {
+        if(this == &other) {
+            return;
+        }
+        if(other.shared != nullptr) {
+            if(shared == nullptr || holds(other.shared, shared)) {
+                // The group of other keeps everything alive that ours did.
+                releaseGroup(shared);
+                shared = other.shared;
+            } else if(holds(shared, other.shared)) {
+                releaseGroup(other.shared);
+            } else {
+                shared = createGroup(nullptr, shared, other.shared);
+            }
+        }
+        if(other.chunks != nullptr) {
+            auto* last(other.chunks);
+            while(last->chunk.next != nullptr) {
+                last = last->chunk.next;
+            }
+            last->chunk.next = chunks;
+            chunks = other.chunks;
+        }
+        if(freeList == nullptr) {
+            freeList = other.freeList;
+        }
+        if(other.bumpEnd - other.bumpBegin > bumpEnd - bumpBegin) {
+            bumpBegin = other.bumpBegin;
+            bumpEnd = other.bumpEnd;
+        }
+        nextChunkSlots = std::max(nextChunkSlots, other.nextChunkSlots);
+        other.chunks = nullptr;
+        other.shared = nullptr;
+        other.freeList = other.bumpBegin = other.bumpEnd = nullptr;
+        other.nextChunkSlots = minChunkSlots;
+    }
+
+    [[nodiscard]]
+    allocator_type get_allocator() const {
+        return allocator_type(allocator);
+    }
+
+    friend void swap(NodePool& lhs, NodePool& rhs) noexcept {
+        using std::swap;
+        swap(lhs.allocator, rhs.allocator);
+        swap(lhs.chunks, rhs.chunks);
+        swap(lhs.shared, rhs.shared);
+        swap(lhs.freeList, rhs.freeList);
+        swap(lhs.bumpBegin, rhs.bumpBegin);
+        swap(lhs.bumpEnd, rhs.bumpEnd);
+        swap(lhs.nextChunkSlots, rhs.nextChunkSlots);
+    }
+
+private:
+    [[no_unique_address]] SlotAllocator allocator;
+    // Chunks only this pool holds, linked through their first slot.
+    Slot* chunks{nullptr};
+    Group* shared{nullptr};
+    Slot* freeList{nullptr};
+    Slot* bumpBegin{nullptr};
+    Slot* bumpEnd{nullptr};
+    size_t nextChunkSlots{minChunkSlots};
+
+    void grow(const size_t capacity) {
+        auto* const chunk(SlotTraits::allocate(allocator, capacity));
+        chunk->chunk.next = chunks;
+        chunk->chunk.capacity = capacity;
+        chunks = chunk;
+        bumpBegin = chunk + 1;
+        bumpEnd = chunk + capacity;
+    }
+
+    void freeChunks(Slot* chunk) noexcept {
+        while(chunk != nullptr) {
+            auto* const next(chunk->chunk.next);
+            SlotTraits::deallocate(allocator, chunk, chunk->chunk.capacity);
+            chunk = next;
+        }
+    }
+
+    [[nodiscard]]
+    Group* createGroup(Slot* const groupChunks, Group* const first, Group* const second) {
+        GroupAllocator groupAllocator(allocator);
+        auto* const group(GroupTraits::allocate(groupAllocator, 1));
+        GroupTraits::construct(groupAllocator, group);
+        group->chunks = groupChunks;
+        group->nested = {first, second};
+        return group;
+    }
+
+    /**
+     * @brief Whether @p group is @p wanted or keeps it alive through the groups it nests.
+     */
+    [[nodiscard]]
+    static bool holds(const Group* group, const Group* const wanted) noexcept {
+        // A pool nests its previous group first, so long chains are followed in a loop rather than recursively.
+        for(; group != nullptr; group = group->nested[0]) {
+            if(group == wanted || holds(group->nested[1], wanted)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Let go of @p group, freeing it along with whatever only it kept alive.
+     */
+    void releaseGroup(Group* const group) noexcept {
+        Group* dead(nullptr);
+        const auto drop([&](Group* const released) {
+            // Acquiring on the last release orders every other pool's use of the chunks before they are freed.
+            if(released != nullptr && released->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                released->nextDead = dead;
+                dead = released;
+            }
+        });
+        drop(group);
+        while(dead != nullptr) {
+            auto* const freed(std::exchange(dead, dead->nextDead));
+            freeChunks(freed->chunks);
+            for(auto* const nested : freed->nested) {
+                drop(nested);
+            }
+            GroupAllocator groupAllocator(allocator);
+            GroupTraits::destroy(groupAllocator, freed);
+            GroupTraits::deallocate(groupAllocator, freed, 1);
+        }
+    }
+};
+
+}
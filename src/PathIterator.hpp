@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <ostream>
+
+namespace algos {
+
+/**
+ * @brief A forward iterator over a binary search tree whose nodes have no parent pointers.
+ *
+ * It keeps the current node on top of every ancestor it lies to the left of, which are
+ * exactly the nodes that follow it, so advancing takes amortized constant time.
+ *
+ * @tparam Node A node with a value and left and right child pointers.
+ */
+template<typename Node>
+class PathIterator {
+    // An AVL tree 64 levels tall holds more than 2^44 elements, more than fit in memory.
+    static constexpr size_t maxHeight{64};
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = decltype(Node::value);
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    PathIterator() = default;
+
+    PathIterator& operator++() {
+        for(const auto* node(path[--depth]->right); node != nullptr; node = node->left) {
+            path[depth++] = node;
+        }
+        return *this;
+    }
+    PathIterator operator++(int) {
+        const PathIterator old(*this);
+        ++(*this);
+        return old;
+    }
+    [[nodiscard]]
+    const value_type& operator*() const {
+        return path[depth - 1]->value;
+    }
+    const value_type* operator->() const {
+        return &path[depth - 1]->value;
+    }
+    [[nodiscard]]
+    bool operator==(const PathIterator& rhs) const {
+        if(depth == 0 || rhs.depth == 0) {
+            return depth == rhs.depth;
+        }
+        return path[depth - 1] == rhs.path[rhs.depth - 1];
+    }
+    friend std::ostream& operator<<(std::ostream& out, const PathIterator& iter) {
+        if(iter.depth == 0) {
+            return out << "end";
+        }
+        return out << "(" << iter->first << ", " << iter->second << ")";
+    }
+
+    /**
+     * @brief The smallest element of the tree rooted at @p node.
+     */
+    [[nodiscard]]
+    static PathIterator first(const Node* node) {
+        PathIterator iter;
+        for(; node != nullptr; node = node->left) {
+            iter.path[iter.depth++] = node;
+        }
+        return iter;
+    }
+
+    /**
+     * @brief The first element of the tree rooted at @p node with a key not less than @p key.
+     */
+    template<typename Key, typename Compare>
+    [[nodiscard]]
+    static PathIterator lowerBound(const Node* node, const Key& key, const Compare& comp) {
+        PathIterator iter;
+        while(node != nullptr) {
+            if(comp(node->value.first, key)) {
+                node = node->right;
+            } else {
+                iter.path[iter.depth++] = node;
+                node = node->left;
+            }
+        }
+        return iter;
+    }
+
+    /**
+     * @brief The first element of the tree rooted at @p node with a key greater than @p key.
+     */
+    template<typename Key, typename Compare>
+    [[nodiscard]]
+    static PathIterator upperBound(const Node* node, const Key& key, const Compare& comp) {
+        PathIterator iter;
+        while(node != nullptr) {
+            if(comp(key, node->value.first)) {
+                iter.path[iter.depth++] = node;
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        return iter;
+    }
+
+    /**
+     * @brief The element of the tree rooted at @p node with a key equal to @p key, if any.
+     */
+    template<typename Key, typename Compare>
+    [[nodiscard]]
+    static PathIterator find(const Node* const node, const Key& key, const Compare& comp) {
+        auto iter(lowerBound(node, key, comp));
+        if(iter.depth != 0 && comp(key, iter->first)) {
+            return PathIterator{};
+        }
+        return iter;
+    }
+
+private:
+    std::array<const Node*, maxHeight> path{};
+    size_t depth{0};
+};
+
+}
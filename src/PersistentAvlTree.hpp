@@ -0,0 +1,522 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "PathIterator.hpp"
+
+namespace algos {
+
+/**
+ * @brief An AVL tree whose copies share their nodes, so copying it takes constant time.
+ *
+ * Nodes are reference counted and shared by every copy of the tree that can reach them. A
+ * write copies the shared nodes on the path from the root down to what it changes, which
+ * are O(log n) of them, and modifies the nodes no other copy can reach in place, so a tree
+ * that was never copied is written about as cheaply as one without sharing. Copies are
+ * therefore point-in-time snapshots: writes to one are never seen by the others.
+ *
+ * Copies may be handed to other threads. Reference counts are atomic and each node is
+ * allocated on its own rather than from a pool, as whichever copy releases a node last
+ * frees it, on whatever thread it runs. A single copy, like the standard containers, must
+ * not be written while it is being read. As writes copy shared elements, keys and values
+ * must be copyable.
+ *
+ * If copying an element, comparing keys or allocating a node throws, the tree is left
+ * valid and holds either its old or its new elements, though it may be less balanced.
+ *
+ * @tparam K The type of keys used to identify elements in the tree.
+ * @tparam V The type of value associated with each key.
+ * @tparam Compare A function used for ordering keys, it is stored in the tree and may carry state.
+ * @tparam Allocator The allocator used to obtain nodes. Copies of the tree free nodes
+ *                   allocated by each other, so copies of the allocator must compare equal.
+ */
+template<typename K, typename V, typename Compare=std::less<K>, typename Allocator=std::allocator<std::pair<K, V>>>
+class PersistentAvlTree {
+public:
+    using value_type = std::pair<K, V>;
+    using allocator_type = Allocator;
+private:
+    static constexpr bool isTransparent{requires { typename Compare::is_transparent; }};
+
+    struct Node {
+        template<typename... Args>
+        explicit Node(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+        value_type value;
+        Node* left{nullptr};
+        Node* right{nullptr};
+        int height{1};
+        // The number of parents and trees pointing at the node. Every reference is held by
+        // a live object, so it cannot realistically overflow.
+        std::atomic<std::uint32_t> refs{1};
+    };
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Node>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+public:
+    /**
+     * Iterators are invalidated by any write to the tree they were obtained from, but not by
+     * writes to its copies.
+     */
+    using iterator = PathIterator<Node>;
+    using const_iterator = PathIterator<Node>;
+
+    PersistentAvlTree() : PersistentAvlTree(Compare()) {}
+
+    explicit PersistentAvlTree(const Compare& comp, const Allocator& alloc = Allocator())
+        : alloc(alloc), comp(comp) {}
+
+    explicit PersistentAvlTree(const Allocator& alloc) : PersistentAvlTree(Compare(), alloc) {}
+
+    /**
+     * @brief Share every node of @p other, in constant time.
+     *
+     * The allocator is copied as is, since the copy frees nodes @p other allocated.
+     */
+    PersistentAvlTree(const PersistentAvlTree& other)
+        : root(acquire(other.root)), numElems(other.numElems), alloc(other.alloc), comp(other.comp) {}
+
+    PersistentAvlTree& operator=(const PersistentAvlTree& other) {
+        if(this != &other) {
+            auto* const shared(acquire(other.root));
+            release(root);
+            root = shared;
+            numElems = other.numElems;
+            alloc = other.alloc;
+            comp = other.comp;
+        }
+        return *this;
+    }
+
+    // The comparator is copied rather than moved so the moved-from tree remains usable.
+    PersistentAvlTree(PersistentAvlTree&& other) noexcept(std::is_nothrow_copy_constructible_v<Compare>)
+        : root(std::exchange(other.root, nullptr)),
+          numElems(std::exchange(other.numElems, 0)),
+          alloc(other.alloc),
+          comp(other.comp) {}
+
+    PersistentAvlTree& operator=(PersistentAvlTree&& other) noexcept(std::is_nothrow_copy_assignable_v<Compare>) {
+        if(this != &other) {
+            release(root);
+            root = std::exchange(other.root, nullptr);
+            numElems = std::exchange(other.numElems, 0);
+            alloc = other.alloc;
+            comp = other.comp;
+        }
+        return *this;
+    }
+
+    ~PersistentAvlTree() {
+        release(root);
+    }
+
+    /**
+     * @brief A copy of the tree as it is now, unaffected by later writes to either.
+     */
+    [[nodiscard]]
+    PersistentAvlTree snapshot() const {
+        return *this;
+    }
+
+    /**
+     * @brief Insert @p key with a copy of @p value, unless the key is already present.
+     *
+     * @return Whether the element was inserted.
+     */
+    bool insert(const K& key, const V& value) {
+        return insertAt(root, key, value, false, false);
+    }
+
+    /**
+     * @brief Insert @p key with a copy of @p value, or replace the value of an existing element.
+     *
+     * @return Whether the element was inserted rather than assigned to.
+     */
+    bool insert_or_assign(const K& key, const V& value) {
+        return insertAt(root, key, value, true, true);
+    }
+
+    /**
+     * @brief Erase the element with @p key if it exists.
+     *
+     * @return Whether an element was erased.
+     */
+    bool erase(const K& key) {
+        return eraseHelper(key);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    bool erase(const Key& key) {
+        return eraseHelper(key);
+    }
+
+    /**
+     * @brief Drop every element, copies of the tree keep theirs.
+     */
+    void clear() {
+        release(std::exchange(root, nullptr));
+        numElems = 0;
+    }
+
+    [[nodiscard]]
+    const_iterator cbegin() const {
+        return const_iterator::first(root);
+    }
+
+    [[nodiscard]]
+    const_iterator begin() const {
+        return cbegin();
+    }
+
+    [[nodiscard]]
+    const_iterator cend() const {
+        return const_iterator{};
+    }
+
+    [[nodiscard]]
+    const_iterator end() const {
+        return cend();
+    }
+
+    [[nodiscard]]
+    const_iterator find(const K& key) const {
+        return const_iterator::find(root, key, comp);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator find(const Key& key) const {
+        return const_iterator::find(root, key, comp);
+    }
+
+    /**
+     * @brief The first element with a key not less than @p key.
+     */
+    [[nodiscard]]
+    const_iterator lower_bound(const K& key) const {
+        return const_iterator::lowerBound(root, key, comp);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator lower_bound(const Key& key) const {
+        return const_iterator::lowerBound(root, key, comp);
+    }
+
+    /**
+     * @brief The first element with a key greater than @p key.
+     */
+    [[nodiscard]]
+    const_iterator upper_bound(const K& key) const {
+        return const_iterator::upperBound(root, key, comp);
+    }
+
+    template<typename Key>
+    requires isTransparent
+    [[nodiscard]]
+    const_iterator upper_bound(const Key& key) const {
+        return const_iterator::upperBound(root, key, comp);
+    }
+
+    [[nodiscard]]
+    size_t size() const {
+        return numElems;
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return numElems == 0;
+    }
+
+    [[nodiscard]]
+    allocator_type get_allocator() const {
+        return allocator_type(alloc);
+    }
+
+    [[nodiscard]]
+    Compare key_comp() const {
+        return comp;
+    }
+
+    friend void swap(PersistentAvlTree& lhs, PersistentAvlTree& rhs) noexcept(std::is_nothrow_swappable_v<Compare>) {
+        using std::swap;
+        swap(lhs.root, rhs.root);
+        swap(lhs.numElems, rhs.numElems);
+        swap(lhs.alloc, rhs.alloc);
+        swap(lhs.comp, rhs.comp);
+    }
+
+private:
+    Node* root{nullptr};
+    size_t numElems{0};
+    [[no_unique_address]] NodeAllocator alloc;
+    [[no_unique_address]] Compare comp;
+
+    template<typename... Args>
+    [[nodiscard]]
+    Node* create(Args&&... args) {
+        auto* const node(NodeTraits::allocate(alloc, 1));
+        try {
+            NodeTraits::construct(alloc, node, std::forward<Args>(args)...);
+        } catch(...) {
+            NodeTraits::deallocate(alloc, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    [[nodiscard]]
+    static Node* acquire(Node* const node) {
+        if(node != nullptr) {
+            node->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        return node;
+    }
+
+    /**
+     * @brief Drop a reference to @p node, freeing it and releasing its children if it was the last.
+     */
+    void release(Node* const node) noexcept {
+        // Acquiring on the last release orders every other copy's reads before the node is freed.
+        if(node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(node->left);
+            release(node->right);
+            NodeTraits::destroy(alloc, node);
+            NodeTraits::deallocate(alloc, node, 1);
+        }
+    }
+
+    /**
+     * @brief Whether @p node is shared and a write below it would find nothing to do, as the
+     *        key is absent when @p needsKey holds or present when it does not.
+     *
+     * Owning the shared rest of the path on the way down would then copy it for nothing.
+     */
+    template<typename Key>
+    [[nodiscard]]
+    bool changesNothing(const Node* node, const Key& key, const bool needsKey) const {
+        if(node->refs.load(std::memory_order_relaxed) == 1) {
+            return false;
+        }
+        while(node != nullptr) {
+            if(comp(key, node->value.first)) {
+                node = node->left;
+            } else if(comp(node->value.first, key)) {
+                node = node->right;
+            } else {
+                return !needsKey;
+            }
+        }
+        return needsKey;
+    }
+
+    /**
+     * @brief A version of @p node this tree may modify, which is a copy unless no other copy
+     *        of the tree can reach @p node.
+     *
+     * The reference the caller's link holds to @p node moves to the result. The link must be
+     * in a node the tree owns, or be the root, so that a count of one means no other copy
+     * can reach @p node through a shared ancestor.
+     */
+    [[nodiscard]]
+    Node* own(Node* const node) {
+        // Pairs with the release of the copy that dropped the count to one, so its reads of
+        // the node happen before it is modified.
+        if(node->refs.load(std::memory_order_acquire) == 1) {
+            return node;
+        }
+        auto* const copy(create(node->value));
+        copy->left = acquire(node->left);
+        copy->right = acquire(node->right);
+        copy->height = node->height;
+        release(node);
+        return copy;
+    }
+
+    /**
+     * @brief Insert into the subtree behind @p link, which must be owned by the tree.
+     *
+     * Every node on the path is owned and stored back into its link before going further
+     * down, so the tree stays valid if a later step throws.
+     *
+     * @param checked Whether the insertion is known to change the tree, which is always
+     *                the case when assigning.
+     * @return Whether an element was inserted rather than found.
+     */
+    bool insertAt(Node*& link, const K& key, const V& value, const bool assign, bool checked) {
+        if(link == nullptr) {
+            link = create(key, value);
+            ++numElems;
+            return true;
+        }
+        if(!checked && changesNothing(link, key, false)) {
+            return false;
+        }
+        checked = checked || link->refs.load(std::memory_order_relaxed) != 1;
+        link = own(link);
+        bool inserted;
+        if(comp(key, link->value.first)) {
+            inserted = insertAt(link->left, key, value, assign, checked);
+        } else if(comp(link->value.first, key)) {
+            inserted = insertAt(link->right, key, value, assign, checked);
+        } else {
+            if(assign) {
+                link->value.second = value;
+            }
+            return false;
+        }
+        if(inserted) {
+            link = rebalance(link);
+        }
+        return inserted;
+    }
+
+    template<typename Key>
+    bool eraseHelper(const Key& key) {
+        return eraseAt(root, key, false);
+    }
+
+    /**
+     * @param checked Whether the key is known to be present.
+     */
+    template<typename Key>
+    bool eraseAt(Node*& link, const Key& key, bool checked) {
+        if(link == nullptr) {
+            return false;
+        }
+        if(!checked && changesNothing(link, key, true)) {
+            return false;
+        }
+        checked = checked || link->refs.load(std::memory_order_relaxed) != 1;
+        link = own(link);
+        bool erased;
+        if(comp(key, link->value.first)) {
+            erased = eraseAt(link->left, key, checked);
+        } else if(comp(link->value.first, key)) {
+            erased = eraseAt(link->right, key, checked);
+        } else if(link->left == nullptr || link->right == nullptr) {
+            auto* const node(link);
+            link = node->left != nullptr ? node->left : node->right;
+            node->left = node->right = nullptr;
+            release(node);
+            --numElems;
+            return true;
+        } else {
+            eraseMin(link->right, link);
+            erased = true;
+        }
+        if(erased) {
+            link = rebalance(link);
+        }
+        return erased;
+    }
+
+    /**
+     * @brief Swap the value of @p target with the leftmost value behind @p link and erase
+     *        the node it ends up in, which is @p target's successor.
+     *
+     * Moving values rather than relinking the successor into place means the erased
+     * element is gone before anything on the way back up can throw.
+     */
+    void eraseMin(Node*& link, Node* const target) {
+        link = own(link);
+        if(link->left != nullptr) {
+            eraseMin(link->left, target);
+            link = rebalance(link);
+            return;
+        }
+        auto* const min(link);
+        using std::swap;
+        swap(target->value, min->value);
+        link = min->right;
+        min->right = nullptr;
+        release(min);
+        --numElems;
+    }
+
+    [[nodiscard]]
+    static int getHeight(const Node* const node) {
+        return node == nullptr ? 0 : node->height;
+    }
+
+    static void updateHeight(Node* const node) {
+        node->height = std::max(getHeight(node->left), getHeight(node->right)) + 1;
+    }
+
+    [[nodiscard]]
+    static int getBalanceFactor(const Node* const node) {
+        return getHeight(node->left) - getHeight(node->right);
+    }
+
+    /**
+     * @brief Right rotate the tree rooted at @p node, which must be owned along with its left child.
+     *
+     * @return The new root of the tree.
+     */
+    [[nodiscard]]
+    static Node* rotateRight(Node* const node) {
+        auto* const newRoot(node->left);
+        node->left = newRoot->right;
+        newRoot->right = node;
+        updateHeight(node);
+        updateHeight(newRoot);
+        return newRoot;
+    }
+
+    /**
+     * @brief Left rotate the tree rooted at @p node, which must be owned along with its right child.
+     *
+     * @return The new root of the tree.
+     */
+    [[nodiscard]]
+    static Node* rotateLeft(Node* const node) {
+        auto* const newRoot(node->right);
+        node->right = newRoot->left;
+        newRoot->left = node;
+        updateHeight(node);
+        updateHeight(newRoot);
+        return newRoot;
+    }
+
+    /**
+     * @brief Restore the balance of the owned @p node after one of its subtrees changed height,
+     *        owning whatever the rotations modify.
+     *
+     * @return The new root of the subtree.
+     */
+    [[nodiscard]]
+    Node* rebalance(Node* const node) {
+        updateHeight(node);
+        const auto balanceFactor(getBalanceFactor(node));
+        if(balanceFactor > 1) {
+            // Left leaning tree
+            node->left = own(node->left);
+            if(getBalanceFactor(node->left) < 0) {
+                node->left->right = own(node->left->right);
+                node->left = rotateLeft(node->left);
+            }
+            return rotateRight(node);
+        }
+        if(balanceFactor < -1) {
+            // Right leaning tree
+            node->right = own(node->right);
+            if(getBalanceFactor(node->right) > 0) {
+                node->right->left = own(node->right->left);
+                node->right = rotateRight(node->right);
+            }
+            return rotateLeft(node);
+        }
+        return node;
+    }
+};
+
+}
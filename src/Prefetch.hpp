@@ -0,0 +1,18 @@
+#pragma once
+
+namespace algos {
+
+/**
+ * @brief Hint that the cache line holding @p address is about to be read.
+ *
+ * Never faults, so it may be given addresses that are not dereferenceable.
+ */
+inline void prefetch(const void* const address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void) address;
+#endif
+}
+
+}
@@ -0,0 +1,482 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "AvlTree.hpp"
+
+namespace algos {
+
+/**
+ * @brief Spreads keys over the shards of a ShardedAvlTree by their hash, which evens out
+ *        the load whatever the keys are, at the cost of merging the shards to visit them in order.
+ */
+template<typename Hash>
+struct HashSharding {
+    static constexpr bool ordered{false};
+
+    template<typename K, typename Compare>
+    [[nodiscard]]
+    size_t shardOf(const K& key, const size_t shards, const Compare& /*unused*/) const {
+        // Multiplying spreads the low bits of hashes such as the identity std::hash gives integers.
+        const auto mixed(static_cast<std::uint64_t>(hash(key)) * 0x9E3779B97F4A7C15ULL);
+        return static_cast<size_t>((mixed ^ (mixed >> 32U)) % shards);
+    }
+
+    [[no_unique_address]] Hash hash;
+};
+
+/**
+ * @brief Gives every shard of a ShardedAvlTree a run of keys, so visiting them in order
+ *        visits the shards one after the other, but keys must be known up front to even out the load.
+ *
+ * Shard i holds the keys from bounds[i - 1] up to but not including bounds[i], the first shard
+ * everything before bounds[0] and the last everything from bounds.back() on.
+ */
+template<typename K>
+struct RangeSharding {
+    static constexpr bool ordered{true};
+
+    template<typename Compare>
+    [[nodiscard]]
+    size_t shardOf(const K& key, const size_t /*unused*/, const Compare& comp) const {
+        return static_cast<size_t>(std::upper_bound(bounds.begin(), bounds.end(), key, comp) - bounds.begin());
+    }
+
+    // Sorted, one fewer than there are shards.
+    std::vector<K> bounds;
+};
+
+/**
+ * @brief A map that many threads can write at once, which partitions its keys over @p N
+ *        AvlTrees that each have a lock of their own.
+ *
+ * Operations on a key lock only the shard the key belongs to, so writes to different shards
+ * proceed in parallel and reads of the same shard share its lock. Every shard sits on cache
+ * lines of its own, so locking one never contends with threads working on the others.
+ *
+ * Elements are read or visited under the lock of their shard, which is why lookups return
+ * copies of values rather than iterators. An OrderedView holds the locks of every shard to
+ * visit all elements in key order.
+ *
+ * @tparam K The type of keys used to identify elements in the tree.
+ * @tparam V The type of value associated with each key.
+ * @tparam Compare A function used for ordering keys, it is stored in every shard and may carry state.
+ * @tparam N The number of shards.
+ * @tparam Sharding Which shard holds a key, HashSharding or RangeSharding.
+ * @tparam Allocator The allocator used to obtain the chunks nodes are carved from.
+ */
+template<typename K, typename V, typename Compare=std::less<K>, size_t N=16, typename Sharding=HashSharding<std::hash<K>>,
+         typename Allocator=std::allocator<std::pair<K, V>>>
+class ShardedAvlTree {
+    static_assert(N > 0, "A sharded tree needs at least one shard");
+public:
+    using Tree = AvlTree<K, V, Compare, Allocator>;
+    using value_type = typename Tree::value_type;
+    using allocator_type = Allocator;
+private:
+    static constexpr size_t cacheLineSize{64};
+
+    struct alignas(cacheLineSize) Shard {
+        Shard(const Compare& comp, const Allocator& alloc) : tree(comp, alloc) {}
+
+        mutable std::shared_mutex mutex;
+        Tree tree;
+    };
+
+    using TreeIterator = typename Tree::const_iterator;
+
+    struct Cursor {
+        TreeIterator position;
+        TreeIterator end;
+    };
+public:
+    /**
+     * @brief A forward iterator over the elements of every shard in key order.
+     *
+     * With HashSharding it merges the shards, keeping the next element of each in a heap so that
+     * stepping takes O(log N). With RangeSharding it walks the shards one after the other.
+     */
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename Tree::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        Iterator() = default;
+
+        Iterator& operator++() {
+            if constexpr(Sharding::ordered) {
+                ++cursors[0].position;
+                skipExhausted();
+            } else {
+                std::pop_heap(cursors.begin(), cursors.begin() + static_cast<std::ptrdiff_t>(count), later());
+                auto& cursor(cursors[count - 1]);
+                if(++cursor.position != cursor.end) {
+                    std::push_heap(cursors.begin(), cursors.begin() + static_cast<std::ptrdiff_t>(count), later());
+                } else {
+                    --count;
+                }
+            }
+            return *this;
+        }
+        Iterator operator++(int) {
+            auto old(*this);
+            ++(*this);
+            return old;
+        }
+        [[nodiscard]]
+        reference operator*() const {
+            return *cursors[0].position;
+        }
+        pointer operator->() const {
+            return &*cursors[0].position;
+        }
+        [[nodiscard]]
+        bool operator==(const Iterator& rhs) const {
+            return count == rhs.count && (count == 0 || cursors[0].position == rhs.cursors[0].position);
+        }
+    private:
+        friend class ShardedAvlTree;
+
+        Iterator(const std::array<Shard, N>& shards, const Compare& comp) : comp(&comp) {
+            if constexpr(Sharding::ordered) {
+                // The cursor of the shard being walked comes first, those of the shards after it follow.
+                for(size_t index(0); index < N; ++index) {
+                    cursors[index] = {shards[index].tree.cbegin(), shards[index].tree.cend()};
+                }
+                count = N;
+                skipExhausted();
+            } else {
+                for(const auto& shard : shards) {
+                    if(!shard.tree.empty()) {
+                        cursors[count++] = {shard.tree.cbegin(), shard.tree.cend()};
+                    }
+                }
+                std::make_heap(cursors.begin(), cursors.begin() + static_cast<std::ptrdiff_t>(count), later());
+            }
+        }
+
+        /**
+         * @brief The heap order, which puts the cursor at the smallest key on top.
+         */
+        [[nodiscard]]
+        auto later() const {
+            return [comp = comp](const Cursor& lhs, const Cursor& rhs) {
+                return (*comp)(rhs.position->first, lhs.position->first);
+            };
+        }
+
+        void skipExhausted() {
+            while(count > 0 && cursors[0].position == cursors[0].end) {
+                std::shift_left(cursors.begin(), cursors.begin() + static_cast<std::ptrdiff_t>(count--), 1);
+            }
+        }
+
+        std::array<Cursor, N> cursors{};
+        // The number of cursors that still have elements ahead of them, 0 at the end.
+        size_t count{0};
+        const Compare* comp{nullptr};
+    };
+
+    using const_iterator = Iterator;
+
+    /**
+     * @brief Shared locks on every shard, which let the elements be visited in key order.
+     *
+     * Writes to any shard wait until the view is destroyed, so it should not be held for longer
+     * than needed. A thread holding a view must not write to the tree.
+     */
+    class OrderedView {
+    public:
+        [[nodiscard]]
+        const_iterator cbegin() const {
+            return const_iterator(tree->shards, tree->comp);
+        }
+
+        [[nodiscard]]
+        const_iterator begin() const {
+            return cbegin();
+        }
+
+        [[nodiscard]]
+        const_iterator cend() const {
+            return const_iterator{};
+        }
+
+        [[nodiscard]]
+        const_iterator end() const {
+            return cend();
+        }
+
+        [[nodiscard]]
+        size_t size() const {
+            size_t total(0);
+            for(const auto& shard : tree->shards) {
+                total += shard.tree.size();
+            }
+            return total;
+        }
+
+    private:
+        friend class ShardedAvlTree;
+
+        explicit OrderedView(const ShardedAvlTree& tree) : tree(&tree) {
+            // Every view locks the shards in the same order and writers hold a single lock, so no
+            // two threads ever wait on each other in a cycle.
+            for(size_t index(0); index < N; ++index) {
+                locks[index] = std::shared_lock(tree.shards[index].mutex);
+            }
+        }
+
+        const ShardedAvlTree* tree;
+        std::array<std::shared_lock<std::shared_mutex>, N> locks;
+    };
+
+    /**
+     * @param sharding Which shard holds a key, the bounds of a RangeSharding must number N - 1.
+     * @throws std::invalid_argument If the bounds of a RangeSharding are not N - 1 sorted keys.
+     */
+    explicit ShardedAvlTree(Sharding sharding = Sharding(), const Compare& comp = Compare(),
+                            const Allocator& alloc = Allocator())
+        : shards(makeShards(comp, alloc, std::make_index_sequence<N>{})), sharding(std::move(sharding)), comp(comp) {
+        if constexpr(Sharding::ordered) {
+            // Any other bounds would leave shards unused or send keys past the last one.
+            const auto& bounds(this->sharding.bounds);
+            if(bounds.size() != N - 1 || !std::is_sorted(bounds.begin(), bounds.end(), comp)) {
+                throw std::invalid_argument("the bounds of a RangeSharding must be N - 1 sorted keys");
+            }
+        }
+    }
+
+    ShardedAvlTree(const ShardedAvlTree&) = delete;
+    ShardedAvlTree& operator=(const ShardedAvlTree&) = delete;
+
+    /**
+     * @brief Insert @p key with a copy of @p value, unless the key is already present.
+     *
+     * @return Whether the element was inserted.
+     */
+    bool insert(const K& key, const V& value) {
+        auto& shard(shardOf(key));
+        const std::unique_lock lock(shard.mutex);
+        return shard.tree.insert(key, value).second;
+    }
+
+    /**
+     * @brief Insert @p key with a copy of @p value, or replace the value of an existing element.
+     *
+     * @return Whether the element was inserted rather than assigned to.
+     */
+    bool insert_or_assign(const K& key, const V& value) {
+        auto& shard(shardOf(key));
+        const std::unique_lock lock(shard.mutex);
+        return shard.tree.insert_or_assign(key, value).second;
+    }
+
+    /**
+     * @brief Erase the element with @p key if it exists.
+     *
+     * @return Whether an element was erased.
+     */
+    bool erase(const K& key) {
+        auto& shard(shardOf(key));
+        const std::unique_lock lock(shard.mutex);
+        return shard.tree.erase(key);
+    }
+
+    /**
+     * @brief A copy of the value associated with @p key, taken under the lock of its shard.
+     */
+    [[nodiscard]]
+    std::optional<V> find(const K& key) const {
+        const auto& shard(shardOf(key));
+        const std::shared_lock lock(shard.mutex);
+        const auto found(shard.tree.find(key));
+        if(found == shard.tree.cend()) {
+            return std::nullopt;
+        }
+        return found->second;
+    }
+
+    [[nodiscard]]
+    bool contains(const K& key) const {
+        const auto& shard(shardOf(key));
+        const std::shared_lock lock(shard.mutex);
+        return shard.tree.find(key) != shard.tree.cend();
+    }
+
+    /**
+     * @brief Lock every shard for reading, to visit all elements in key order.
+     */
+    [[nodiscard]]
+    OrderedView ordered() const {
+        return OrderedView(*this);
+    }
+
+    /**
+     * @brief Call @p function with every element, visiting shards in parallel on up to
+     *        @p threads threads, each shard under its exclusive lock.
+     *
+     * Elements of a shard are visited in key order, those of different shards in no particular
+     * order and at the same time, so @p function must be safe to call concurrently. It may modify
+     * values but not keys. If it throws, the first exception is rethrown once every thread is done.
+     */
+    template<typename Function>
+    void for_each(const Function& function, const unsigned threads = std::thread::hardware_concurrency()) {
+        forEachShard(threads, [&](Shard& shard) {
+            const std::unique_lock lock(shard.mutex);
+            for(auto& element : shard.tree) {
+                function(element);
+            }
+        });
+    }
+
+    /**
+     * @brief Like for_each(), but for reading, which shares the lock of each shard with other readers.
+     */
+    template<typename Function>
+    void for_each(const Function& function, const unsigned threads = std::thread::hardware_concurrency()) const {
+        forEachShard(threads, [&](const Shard& shard) {
+            const std::shared_lock lock(shard.mutex);
+            for(auto iter(shard.tree.cbegin()); iter != shard.tree.cend(); ++iter) {
+                function(*iter);
+            }
+        });
+    }
+
+    void clear() {
+        for(auto& shard : shards) {
+            const std::unique_lock lock(shard.mutex);
+            shard.tree.clear();
+        }
+    }
+
+    /**
+     * @brief The number of elements, counted one shard at a time, so writes made meanwhile
+     *        may be counted in some shards and not in others.
+     */
+    [[nodiscard]]
+    size_t size() const {
+        size_t total(0);
+        for(const auto& shard : shards) {
+            const std::shared_lock lock(shard.mutex);
+            total += shard.tree.size();
+        }
+        return total;
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return size() == 0;
+    }
+
+    [[nodiscard]]
+    static constexpr size_t shard_count() {
+        return N;
+    }
+
+    /**
+     * @brief The index of the shard that holds @p key.
+     */
+    [[nodiscard]]
+    size_t shard_index(const K& key) const {
+        return sharding.shardOf(key, N, comp);
+    }
+
+    [[nodiscard]]
+    Compare key_comp() const {
+        return comp;
+    }
+
+private:
+    std::array<Shard, N> shards;
+    Sharding sharding;
+    [[no_unique_address]] Compare comp;
+
+    template<size_t... Indices>
+    [[nodiscard]]
+    static std::array<Shard, N> makeShards(const Compare& comp, const Allocator& alloc,
+                                           std::index_sequence<Indices...> /*unused*/) {
+        // Shards hold a mutex, which cannot be moved, so each is built in place in the array.
+        return {{((void) Indices, Shard(comp, alloc))...}};
+    }
+
+    [[nodiscard]]
+    Shard& shardOf(const K& key) {
+        return shards[shard_index(key)];
+    }
+
+    [[nodiscard]]
+    const Shard& shardOf(const K& key) const {
+        return shards[shard_index(key)];
+    }
+
+    /**
+     * @brief Call @p visit with every shard, handing them out to up to @p threads threads one at a time.
+     */
+    template<typename Self, typename Visit>
+    static void forEachShardOf(Self& self, const unsigned threads, const Visit& visit) {
+        std::atomic<size_t> next(0);
+        const auto work([&] {
+            for(auto index(next.fetch_add(1, std::memory_order_relaxed)); index < N;
+                index = next.fetch_add(1, std::memory_order_relaxed)) {
+                visit(self.shards[index]);
+            }
+        });
+        // The calling thread works as well, so one thread more than it forks.
+        std::vector<std::future<void>> workers;
+        const auto forks(std::min<size_t>(std::max(threads, 1U), N) - 1);
+        workers.reserve(forks);
+        for(size_t i(0); i < forks; ++i) {
+            workers.push_back(std::async(std::launch::async, work));
+        }
+        std::exception_ptr failure;
+        try {
+            work();
+        } catch(...) {
+            failure = std::current_exception();
+        }
+        for(auto& worker : workers) {
+            try {
+                worker.get();
+            } catch(...) {
+                if(!failure) {
+                    failure = std::current_exception();
+                }
+            }
+        }
+        if(failure) {
+            std::rethrow_exception(failure);
+        }
+    }
+
+    template<typename Visit>
+    void forEachShard(const unsigned threads, const Visit& visit) {
+        forEachShardOf(*this, threads, visit);
+    }
+
+    template<typename Visit>
+    void forEachShard(const unsigned threads, const Visit& visit) const {
+        forEachShardOf(*this, threads, visit);
+    }
+};
+
+}
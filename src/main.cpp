@@ -8,8 +8,9 @@
 // NOLINTBEGIN(readability-magic-numbers)
 
 int main(int /*unused*/, char** /*unused*/) {
-    algos::AvlTree<std::string, int> ages;
-    auto [pos, wasInserted] = ages.insert("Joe", 25);
+    // std::less<> lets lookups compare string literals directly against the keys.
+    algos::AvlTree<std::string, int, std::less<>> ages;
+    [[maybe_unused]] auto [pos, wasInserted] = ages.insert("Joe", 25);
     assert(wasInserted);
     std::tie(pos, wasInserted) = ages.insert("Ben", 99);
     assert(wasInserted);
@@ -27,17 +28,17 @@ int main(int /*unused*/, char** /*unused*/) {
     for(const auto& [key, value] : ages) {
         std::cout << '(' << key << ", " << value << ")\n";
     }
-    bool wasErased(ages.erase(pos));
-    assert(wasErased);
+    pos = ages.erase(pos);
+    assert(pos == ages.find("Ben"));
     std::cout << "Contents of AVL tree:\n";
     for(const auto& [key, value] : ages) {
         std::cout << '(' << key << ", " << value << ")\n";
     }
     std::tie(pos, wasInserted) = ages.insert("Arthur", 142);
     assert(wasInserted);
-    const auto found(ages.find("Arthur"));
+    [[maybe_unused]] const auto found(ages.find("Arthur"));
     assert(found == pos);
-    wasErased = ages.erase("Ben");
+    [[maybe_unused]] bool wasErased(ages.erase("Ben"));
     assert(wasErased);
     std::cout << "Contents of AVL tree:\n";
     for(const auto& [key, value] : ages) {
@@ -4,11 +4,242 @@
 
 #include "AvlTree.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 using namespace algos;
 
+namespace {
+
+size_t allocatorCalls{0};
+
+template<typename T>
+struct CountingAllocator {
+    using value_type = T;
+    CountingAllocator() = default;
+    template<typename U>
+    CountingAllocator(const CountingAllocator<U>& /*unused*/) {}
+    T* allocate(size_t n) {
+        ++allocatorCalls;
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* ptr, size_t n) {
+        std::allocator<T>{}.deallocate(ptr, n);
+    }
+    template<typename U>
+    bool operator==(const CountingAllocator<U>& /*unused*/) const {
+        return true;
+    }
+};
+
+struct Tracked {
+    static inline int copies{0};
+    static inline int moves{0};
+    explicit Tracked(int payload) : payload(payload) {}
+    Tracked(const Tracked& other) : payload(other.payload) { ++copies; }
+    Tracked(Tracked&& other) noexcept : payload(other.payload) { ++moves; }
+    Tracked& operator=(const Tracked& other) { payload = other.payload; ++copies; return *this; }
+    Tracked& operator=(Tracked&& other) noexcept { payload = other.payload; ++moves; return *this; }
+    ~Tracked() = default;
+    static void reset() { copies = moves = 0; }
+    int payload;
+};
+
+int stringComparisons{0};
+
+struct ThrowsOnCopy {
+    static inline int copiesLeft{0};
+    explicit ThrowsOnCopy(std::string text) : text(std::move(text)) {}
+    ThrowsOnCopy(const ThrowsOnCopy& other) : text(other.text) {
+        if(--copiesLeft < 0) {
+            throw std::runtime_error("copy failed");
+        }
+    }
+    ThrowsOnCopy& operator=(const ThrowsOnCopy&) = delete;
+    ~ThrowsOnCopy() = default;
+    std::string text;
+};
+
+struct WithOrderStatistics : AvlTreeOptions {
+    static constexpr bool orderStatistics{true};
+};
+
+template<typename K, typename V>
+using OrderStatisticsTree = AvlTree<K, V, std::less<K>, std::allocator<std::pair<K, V>>, WithOrderStatistics>;
+
+struct WithCompactNodes : WithOrderStatistics {
+    static constexpr bool compactNodes{true};
+};
+
+struct WithLinkedNodes : WithOrderStatistics {
+    static constexpr bool linkedNodes{true};
+};
+
+struct WithStats : AvlTreeOptions {
+    static constexpr bool collectStats{true};
+};
+
+struct WithPrefixStats : WithStats {
+    static constexpr bool cacheKeyPrefix{true};
+};
+
+// The nodes visited by the descents recorded in @p stats, weighing each by its depth.
+std::uint64_t visitedNodes(const AvlTreeStats& stats) {
+    std::uint64_t visited = 0;
+    for(size_t depth = 0; depth < stats.descentDepths.size(); ++depth) {
+        visited += depth * stats.descentDepths[depth];
+    }
+    return visited;
+}
+
+// Sums values, which answers questions such as the total volume traded between two times.
+struct SumOfValues {
+    using value_type = std::int64_t;
+    static value_type identity() { return 0; }
+    static value_type lift(const int /*key*/, const std::int64_t value) { return value; }
+    static value_type combine(const value_type lhs, const value_type rhs) { return lhs + rhs; }
+};
+
+// Lists keys, which is associative but not commutative, so it tells whether elements are combined in order.
+struct ListOfKeys {
+    using value_type = std::string;
+    static value_type identity() { return {}; }
+    static value_type lift(const int key, const std::int64_t /*value*/) { return std::to_string(key) + ","; }
+    static value_type combine(const value_type& lhs, const value_type& rhs) { return lhs + rhs; }
+};
+
+struct WithSums : AvlTreeOptions {
+    using Monoid = SumOfValues;
+};
+
+struct WithKeyLists : WithOrderStatistics {
+    using Monoid = ListOfKeys;
+};
+
+template<typename Options>
+using AugmentedTree = AvlTree<int, std::int64_t, std::less<int>, std::allocator<std::pair<int, std::int64_t>>, Options>;
+
+// Checks every aggregate of @p tree against what folding the elements of @p expected gives.
+template<typename Options>
+void checkAggregates(const AugmentedTree<Options>& tree, const std::map<int, std::int64_t>& expected, std::mt19937& rng) {
+    using Monoid = typename Options::Monoid;
+    const auto fold = [&](const auto first, const auto last) {
+        auto result = Monoid::identity();
+        for(auto iter = first; iter != last; ++iter) {
+            result = Monoid::combine(result, Monoid::lift(iter->first, iter->second));
+        }
+        return result;
+    };
+    BOOST_TEST((tree.aggregate() == fold(expected.begin(), expected.end())));
+    for(int i = 0; i < 200; ++i) {
+        const int low = static_cast<int>(rng() % 1100) - 50;
+        const int high = low + static_cast<int>(rng() % 300) - 20;
+        const auto expectedAggregate = low < high ? fold(expected.lower_bound(low), expected.lower_bound(high))
+                                                  : Monoid::identity();
+        BOOST_TEST((tree.aggregate(low, high) == expectedAggregate));
+    }
+}
+
+// Random edits and then bulk operations, checking the aggregates of @p Options along the way.
+template<typename Options>
+void aggregatesAgainstStdMap() {
+    using Tree = AugmentedTree<Options>;
+    std::mt19937 rng(47);
+    Tree tree;
+    std::map<int, std::int64_t> expected;
+    BOOST_TEST((tree.aggregate(0, 10) == Options::Monoid::identity()));
+    for(int i = 0; i < 5000; ++i) {
+        const int key = static_cast<int>(rng() % 1000);
+        switch(rng() % 4) {
+        case 0:
+            BOOST_TEST(tree.insert(key, i).second == expected.emplace(key, i).second);
+            break;
+        case 1:
+            BOOST_TEST(tree.insert_or_assign(key, i).second == expected.insert_or_assign(key, i).second);
+            break;
+        default:
+            BOOST_TEST(tree.erase(key) == expected.erase(key));
+            break;
+        }
+        if(i % 500 == 0) {
+            checkAggregates(tree, expected, rng);
+        }
+    }
+    checkAggregates(tree, expected, rng);
+
+    // Bulk operations rebuild and relink subtrees, which have to carry their aggregates along.
+    auto [lower, upper] = std::move(tree).split(500);
+    std::map<int, std::int64_t> expectedLower(expected.begin(), expected.lower_bound(500));
+    std::map<int, std::int64_t> expectedUpper(expected.lower_bound(500), expected.end());
+    checkAggregates(lower, expectedLower, rng);
+    checkAggregates(upper, expectedUpper, rng);
+    tree = Tree::join(std::move(lower), std::move(upper));
+    checkAggregates(tree, expected, rng);
+
+    Tree other;
+    std::vector<std::pair<int, std::int64_t>> batch;
+    for(int key = -40; key < 1040; key += 3) {
+        batch.emplace_back(key, -key);
+    }
+    other.assign_sorted(batch.begin(), batch.end());
+    for(const auto& [key, value] : batch) {
+        (void) expected.emplace(key, value);
+    }
+    tree.merge(std::move(other));
+    checkAggregates(tree, expected, rng);
+
+    (void) tree.insert_batch(batch.begin(), batch.end());
+    checkAggregates(tree, expected, rng);
+
+    Tree second;
+    for(int key = 0; key < 2000; key += 7) {
+        (void) second.insert(key, 1);
+        (void) expected.emplace(key, 1);
+    }
+    tree = Tree::set_union(std::move(tree), std::move(second), 4);
+    checkAggregates(tree, expected, rng);
+
+    tree.parallel_for_each([](std::pair<int, std::int64_t>& element) { element.second *= 2; }, 4);
+    for(auto& [key, value] : expected) {
+        value *= 2;
+    }
+    checkAggregates(tree, expected, rng);
+}
+
+size_t statsComparisons{0};
+
+struct CountingLess {
+    bool operator()(const int lhs, const int rhs) const {
+        ++statsComparisons;
+        return lhs < rhs;
+    }
+};
+
+using LinkedTree = AvlTree<int, int, std::less<int>, std::allocator<std::pair<int, int>>, WithLinkedNodes>;
+
+// Walks @p tree both ways, which for a LinkedTree follows nothing but the list.
+void checkBothWays(const LinkedTree& tree, const std::map<int, int>& expected) {
+    const auto same = [](const auto& lhs, const auto& rhs) { return lhs.first == rhs.first && lhs.second == rhs.second; };
+    BOOST_TEST(tree.size() == expected.size());
+    BOOST_TEST(std::equal(tree.cbegin(), tree.cend(), expected.begin(), expected.end(), same));
+    BOOST_TEST(std::equal(tree.crbegin(), tree.crend(), expected.rbegin(), expected.rend(), same));
+}
+
+}
+
 BOOST_AUTO_TEST_SUITE(AvlTreeSuite)
 
 // NOLINTBEGIN(readability-magic-numbers)
@@ -64,6 +295,93 @@ BOOST_AUTO_TEST_CASE(InOrderTraversalAndIterators)
     BOOST_TEST(iter->first == 15);
 }
 
+BOOST_AUTO_TEST_CASE(ReverseIterationAndDecrement)
+{
+    static_assert(std::bidirectional_iterator<AvlTree<int, int>::iterator>);
+    static_assert(std::bidirectional_iterator<AvlTree<int, int>::const_iterator>);
+    using Tree = AvlTree<int, int, std::less<int>, std::allocator<std::pair<int, int>>, WithCompactNodes>;
+    Tree tree;
+    BOOST_TEST((tree.rbegin() == tree.rend()));
+    BOOST_TEST((tree.crbegin() == tree.crend()));
+
+    std::mt19937 rng(21);
+    std::map<int, int> expected;
+    for(int i = 0; i < 5000; ++i) {
+        const int key = static_cast<int>(rng() % 1000);
+        if(rng() % 3 == 0) {
+            BOOST_TEST(tree.erase(key) == (expected.erase(key) == 1));
+        } else {
+            (void) tree.insert(key, i);
+            (void) expected.emplace(key, i);
+        }
+        // The first and last element are tracked through every insert and erase.
+        if(!expected.empty()) {
+            BOOST_TEST(tree.begin()->first == expected.begin()->first);
+            BOOST_TEST(std::prev(tree.end())->first == expected.rbegin()->first);
+        }
+    }
+    const auto same = [](const auto& lhs, const auto& rhs) { return lhs.first == rhs.first && lhs.second == rhs.second; };
+    BOOST_TEST(std::equal(tree.rbegin(), tree.rend(), expected.rbegin(), expected.rend(), same));
+    BOOST_TEST(std::equal(tree.crbegin(), tree.crend(), expected.crbegin(), expected.crend(), same));
+    for(auto iter = tree.begin(); iter != tree.end(); ++iter) {
+        BOOST_TEST((std::prev(std::next(iter)) == iter));
+    }
+    auto iter = tree.end();
+    iter--;
+    BOOST_TEST((iter-- == std::prev(tree.end())));
+    BOOST_TEST(iter->first == std::next(expected.rbegin())->first);
+
+    // Erasing from the back keeps the last element current.
+    while(tree.size() > 1) {
+        (void) tree.erase(std::prev(tree.end()));
+        expected.erase(std::prev(expected.end()));
+        BOOST_TEST(tree.crbegin()->first == expected.rbegin()->first);
+    }
+    (void) tree.erase(tree.begin());
+    BOOST_TEST((tree.begin() == tree.end()));
+    BOOST_TEST((tree.rbegin() == tree.rend()));
+}
+
+BOOST_AUTO_TEST_CASE(EndsFollowTheElements)
+{
+    using Tree = OrderStatisticsTree<int, int>;
+    Tree tree;
+    for(int key = 0; key < 100; ++key) {
+        (void) tree.insert(tree.end(), {key, key});
+    }
+    BOOST_TEST(tree.rbegin()->first == 99);
+
+    // Moving and swapping hand over the first and last element, splitting and joining work them out.
+    Tree moved(std::move(tree));
+    BOOST_TEST((tree.begin() == tree.end()));
+    BOOST_TEST(moved.begin()->first == 0);
+    BOOST_TEST(moved.rbegin()->first == 99);
+    swap(tree, moved);
+    BOOST_TEST((moved.rbegin() == moved.rend()));
+    BOOST_TEST(tree.rbegin()->first == 99);
+    moved = std::move(tree);
+    BOOST_TEST(std::prev(moved.end())->first == 99);
+
+    auto [less, rest] = std::move(moved).split(40);
+    BOOST_TEST(less.rbegin()->first == 39);
+    BOOST_TEST(rest.begin()->first == 40);
+    BOOST_TEST(rest.rbegin()->first == 99);
+    BOOST_TEST((moved.begin() == moved.end()));
+    auto joined = Tree::join(std::move(less), std::move(rest));
+    BOOST_TEST(joined.begin()->first == 0);
+    BOOST_TEST(joined.rbegin()->first == 99);
+    (void) joined.insert(joined.begin(), {-1, -1});
+    BOOST_TEST(joined.begin()->first == -1);
+    const std::array<std::pair<int, int>, 2> batch{{{100, 100}, {101, 101}}};
+    BOOST_TEST(joined.insert_batch(batch.begin(), batch.end()) == 2);
+    BOOST_TEST(joined.rbegin()->first == 101);
+    joined.clear();
+    BOOST_TEST((joined.rbegin() == joined.rend()));
+    (void) joined.insert(7, 7);
+    BOOST_TEST(joined.begin()->first == 7);
+    BOOST_TEST(joined.rbegin()->first == 7);
+}
+
 BOOST_AUTO_TEST_CASE(RotationCases)
 {
     // LL rotation: insert descending
@@ -151,9 +469,12 @@ BOOST_AUTO_TEST_CASE(EraseByIteratorAndClear)
     (void) tree.insert(3, "c");
     auto iter = tree.find(2);
     BOOST_TEST(iter != tree.end());
-    BOOST_TEST(tree.erase(iter));
+    iter = tree.erase(iter);
+    BOOST_TEST(iter == tree.find(3));
     BOOST_TEST(tree.find(2) == tree.end());
     BOOST_TEST(tree.size() == 2);
+    BOOST_TEST(tree.erase(iter) == tree.end());
+    BOOST_TEST(tree.size() == 1);
 
     tree.clear();
     BOOST_TEST(tree.empty());
@@ -176,6 +497,1234 @@ BOOST_AUTO_TEST_CASE(ConstFindAndConstIterator)
     BOOST_TEST(constBegin != constTree.cend());
 }
 
+BOOST_AUTO_TEST_CASE(ChurnReusesPooledNodes)
+{
+    using Tree = AvlTree<int, std::string, std::less<int>, CountingAllocator<std::pair<int, std::string>>>;
+    Tree tree;
+    for(int i = 0; i < 1000; ++i) {
+        (void) tree.insert(i, std::to_string(i));
+    }
+    const auto callsAfterFill = allocatorCalls;
+    BOOST_TEST(callsAfterFill < 20);
+
+    // Erasing and re-inserting the same number of keys only recycles freed nodes.
+    for(int round = 0; round < 10; ++round) {
+        for(int i = 0; i < 1000; i += 2) {
+            BOOST_TEST(tree.erase(i));
+        }
+        for(int i = 0; i < 1000; i += 2) {
+            BOOST_TEST(tree.insert(i, "again").second);
+        }
+    }
+    BOOST_TEST(allocatorCalls == callsAfterFill);
+    BOOST_TEST(tree.size() == 1000);
+    BOOST_TEST(tree.find(0)->second == "again");
+    BOOST_TEST(tree.find(999)->second == "999");
+
+    tree.clear();
+    BOOST_TEST(tree.empty());
+    (void) tree.insert(5, "five");
+    BOOST_TEST(tree.find(5)->second == "five");
+}
+
+BOOST_AUTO_TEST_CASE(MoveTransfersOwnership)
+{
+    AvlTree<int, std::string> tree;
+    for(int i = 0; i < 100; ++i) {
+        (void) tree.insert(i, std::to_string(i));
+    }
+    AvlTree<int, std::string> moved(std::move(tree));
+    BOOST_TEST(moved.size() == 100);
+    BOOST_TEST(moved.find(42)->second == "42");
+
+    AvlTree<int, std::string> assigned;
+    (void) assigned.insert(-1, "gone");
+    assigned = std::move(moved);
+    BOOST_TEST(assigned.size() == 100);
+    BOOST_TEST(assigned.find(-1) == assigned.end());
+
+    std::map<int, std::string> expected;
+    for(int i = 0; i < 100; ++i) {
+        expected.emplace(i, std::to_string(i));
+    }
+    auto expectedIter = expected.begin();
+    for(const auto& [key, value] : assigned) {
+        BOOST_TEST(key == expectedIter->first);
+        BOOST_TEST(value == expectedIter->second);
+        ++expectedIter;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RandomizedAgainstStdMap)
+{
+    std::mt19937 rng(7);
+    AvlTree<int, int> tree;
+    std::map<int, int> expected;
+    for(int i = 0; i < 20000; ++i) {
+        const int key = static_cast<int>(rng() % 2000);
+        if(rng() % 3 != 0) {
+            const auto [iter, wasInserted] = tree.insert(key, i);
+            const auto [expectedIter, expectedInserted] = expected.emplace(key, i);
+            BOOST_TEST(wasInserted == expectedInserted);
+            BOOST_TEST(iter->second == expectedIter->second);
+        } else {
+            BOOST_TEST(tree.erase(key) == (expected.erase(key) == 1));
+        }
+    }
+    BOOST_TEST(tree.size() == expected.size());
+    auto expectedIter = expected.begin();
+    for(const auto& [key, value] : tree) {
+        BOOST_TEST(key == expectedIter->first);
+        BOOST_TEST(value == expectedIter->second);
+        ++expectedIter;
+    }
+    BOOST_TEST((expectedIter == expected.end()));
+}
+
+BOOST_AUTO_TEST_CASE(EmplaceBuildsValuesInPlace)
+{
+    using Tree = AvlTree<int, Tracked, std::less<int>, CountingAllocator<std::pair<int, Tracked>>>;
+    Tree tree;
+    Tracked::reset();
+    BOOST_TEST(tree.try_emplace(1, 10).second);
+    BOOST_TEST(tree.emplace(2, Tracked(20)).second);
+    BOOST_TEST(tree.insert({3, Tracked(30)}).second);
+    BOOST_TEST(Tracked::copies == 0);
+
+    // Rejected duplicates neither allocate nor touch the value passed in.
+    const auto allocationsBefore = allocatorCalls;
+    Tracked::reset();
+    Tracked duplicate(99);
+    BOOST_TEST(!tree.try_emplace(1, std::move(duplicate)).second);
+    BOOST_TEST(!tree.emplace(2, duplicate).second);
+    BOOST_TEST(!tree.insert(std::pair<int, Tracked>(3, duplicate)).second);
+    BOOST_TEST(Tracked::copies == 1);  // Only the pair built by the caller above.
+    BOOST_TEST(Tracked::moves == 0);
+    BOOST_TEST(allocatorCalls == allocationsBefore);
+    BOOST_TEST(tree.find(1)->second.payload == 10);
+    BOOST_TEST(tree.find(2)->second.payload == 20);
+    BOOST_TEST(tree.find(3)->second.payload == 30);
+}
+
+BOOST_AUTO_TEST_CASE(EmplaceAndTryEmplaceMoveKeys)
+{
+    AvlTree<std::string, std::unique_ptr<int>> tree;
+    std::string key(64, 'k');
+    auto [iter, wasInserted] = tree.try_emplace(std::move(key), std::make_unique<int>(1));
+    BOOST_TEST(wasInserted);
+    BOOST_TEST(*iter->second == 1);
+
+    // A key that is already present is left alone, as is the value.
+    std::string sameKey(64, 'k');
+    auto value = std::make_unique<int>(2);
+    BOOST_TEST(!tree.try_emplace(std::move(sameKey), std::move(value)).second);
+    BOOST_TEST(sameKey.size() == 64);
+    BOOST_TEST(value != nullptr);
+
+    // Keys that have to be converted are constructed in the node first.
+    BOOST_TEST(tree.emplace("short", std::make_unique<int>(3)).second);
+    BOOST_TEST(!tree.emplace("short", std::make_unique<int>(4)).second);
+    BOOST_TEST(*tree.find("short")->second == 3);
+    BOOST_TEST(tree.size() == 2);
+}
+
+BOOST_AUTO_TEST_CASE(InsertOrAssign)
+{
+    AvlTree<std::string, std::string> tree;
+    auto [iter, wasInserted] = tree.insert_or_assign("key", "first");
+    BOOST_TEST(wasInserted);
+    BOOST_TEST(iter->second == "first");
+    std::tie(iter, wasInserted) = tree.insert_or_assign("key", "second");
+    BOOST_TEST(!wasInserted);
+    BOOST_TEST(iter->second == "second");
+    BOOST_TEST(tree.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(EraseFromBeginUntilEmpty)
+{
+    AvlTree<int, int> tree;
+    for(int i = 0; i < 500; ++i) {
+        (void) tree.insert((i * 37) % 500, i);
+    }
+    int expected = 0;
+    for(auto iter = tree.begin(); iter != tree.end(); ++expected) {
+        BOOST_TEST(iter->first == expected);
+        iter = tree.erase(iter);
+        BOOST_TEST(tree.size() == static_cast<size_t>(499 - expected));
+    }
+    BOOST_TEST(expected == 500);
+    BOOST_TEST(tree.empty());
+
+    // Erasing every other element while walking keeps the iterator in step.
+    for(int i = 0; i < 100; ++i) {
+        (void) tree.insert(i, i);
+    }
+    for(auto iter = tree.begin(); iter != tree.end();) {
+        if(iter->first % 2 == 0) {
+            iter = tree.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    BOOST_TEST(tree.size() == 50);
+    for(const auto& [key, value] : tree) {
+        BOOST_TEST(key % 2 == 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EraseRelinksNodesWithoutTouchingValues)
+{
+    AvlTree<int, Tracked> tree;
+    for(int i = 0; i < 64; ++i) {
+        (void) tree.try_emplace(i, i);
+    }
+    Tracked::reset();
+    std::vector<AvlTree<int, Tracked>::iterator> iters;
+    for(int i = 0; i < 64; ++i) {
+        iters.push_back(tree.find(i));
+    }
+    // Erase inner nodes first so most of them have two children.
+    for(int i : {31, 15, 47, 7, 23, 39, 55, 32, 16}) {
+        const auto next = tree.erase(tree.find(i));
+        BOOST_TEST((next == iters[i + 1]));
+    }
+    BOOST_TEST(Tracked::copies == 0);
+    BOOST_TEST(Tracked::moves == 0);
+    for(int i = 0; i < 64; ++i) {
+        if(tree.find(i) != tree.end()) {
+            // Surviving iterators still point at their original element.
+            BOOST_TEST(iters[i]->first == i);
+            BOOST_TEST(iters[i]->second.payload == i);
+        }
+    }
+    BOOST_TEST(tree.size() == 55);
+}
+
+BOOST_AUTO_TEST_CASE(EraseMoveOnlyValues)
+{
+    AvlTree<int, std::unique_ptr<int>> tree;
+    for(int i = 0; i < 32; ++i) {
+        (void) tree.try_emplace(i, std::make_unique<int>(i));
+    }
+    for(int i = 0; i < 32; i += 3) {
+        BOOST_TEST(tree.erase(i));
+    }
+    for(const auto& [key, value] : tree) {
+        BOOST_TEST(*value == key);
+        BOOST_TEST(key % 3 != 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BoundsAndEqualRange)
+{
+    AvlTree<int, int> tree;
+    for(int key = 0; key < 100; key += 10) {
+        (void) tree.insert(key, key);
+    }
+    BOOST_TEST(tree.lower_bound(-5)->first == 0);
+    BOOST_TEST(tree.lower_bound(20)->first == 20);
+    BOOST_TEST(tree.lower_bound(21)->first == 30);
+    BOOST_TEST(tree.lower_bound(95) == tree.end());
+    BOOST_TEST(tree.upper_bound(-5)->first == 0);
+    BOOST_TEST(tree.upper_bound(20)->first == 30);
+    BOOST_TEST(tree.upper_bound(90) == tree.end());
+
+    auto [first, last] = tree.equal_range(40);
+    BOOST_TEST(first->first == 40);
+    BOOST_TEST(last->first == 50);
+    std::tie(first, last) = tree.equal_range(45);
+    BOOST_TEST(first == last);
+    BOOST_TEST(first->first == 50);
+
+    const AvlTree<int, int>& constTree = tree;
+    BOOST_TEST(constTree.lower_bound(21)->first == 30);
+    BOOST_TEST(constTree.upper_bound(30)->first == 40);
+    const auto [constFirst, constLast] = constTree.equal_range(90);
+    BOOST_TEST(constFirst->first == 90);
+    BOOST_TEST(constLast == constTree.cend());
+}
+
+BOOST_AUTO_TEST_CASE(RangeViewIsHalfOpen)
+{
+    AvlTree<int, int> tree;
+    for(int key = 0; key < 1000; ++key) {
+        (void) tree.insert(key * 2, key);
+    }
+    std::vector<int> keys;
+    for(const auto& [key, value] : tree.range(101, 121)) {
+        keys.push_back(key);
+    }
+    BOOST_TEST(keys == std::vector<int>({102, 104, 106, 108, 110, 112, 114, 116, 118, 120}));
+
+    keys.clear();
+    const AvlTree<int, int>& constTree = tree;
+    for(const auto& [key, value] : constTree.range(1990, 5000)) {
+        keys.push_back(key);
+    }
+    BOOST_TEST(keys == std::vector<int>({1990, 1992, 1994, 1996, 1998}));
+    BOOST_TEST(tree.range(50, 50).empty());
+    BOOST_TEST(tree.range(5000, 6000).empty());
+}
+
+BOOST_AUTO_TEST_CASE(OrderStatistics)
+{
+    OrderStatisticsTree<int, int> tree;
+    BOOST_TEST(tree.select(0) == tree.end());
+    BOOST_TEST(tree.rank(5) == 0);
+
+    std::mt19937 rng(11);
+    std::map<int, int> expected;
+    for(int i = 0; i < 5000; ++i) {
+        const int key = static_cast<int>(rng() % 1000);
+        if(rng() % 4 != 0) {
+            (void) tree.insert(key, i);
+            expected.emplace(key, i);
+        } else if(auto iter = tree.find(key); iter != tree.end()) {
+            (void) tree.erase(iter);
+            expected.erase(key);
+        }
+    }
+    std::vector<int> keys;
+    for(const auto& [key, value] : expected) {
+        keys.push_back(key);
+    }
+    for(size_t index = 0; index < keys.size(); ++index) {
+        BOOST_TEST(tree.select(index)->first == keys[index]);
+    }
+    BOOST_TEST(tree.select(keys.size()) == tree.end());
+    for(int key = -1; key <= 1001; ++key) {
+        const auto expectedRank = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        BOOST_TEST(tree.rank(key) == static_cast<size_t>(expectedRank));
+    }
+    const OrderStatisticsTree<int, int>& constTree = tree;
+    BOOST_TEST(constTree.select(0)->first == keys.front());
+    BOOST_TEST(constTree.count_range(-100, 2000) == keys.size());
+    BOOST_TEST(constTree.count_range(500, 100) == 0);
+    const auto inWindow = std::count_if(keys.begin(), keys.end(), [](int key) { return key >= 250 && key < 750; });
+    BOOST_TEST(constTree.count_range(250, 750) == static_cast<size_t>(inWindow));
+}
+
+BOOST_AUTO_TEST_CASE(AssignSortedBuildsBalancedTree)
+{
+    for(int count : {0, 1, 2, 3, 7, 8, 1000}) {
+        std::vector<std::pair<int, int>> sorted;
+        for(int i = 0; i < count; ++i) {
+            sorted.emplace_back(i * 3, i);
+        }
+        OrderStatisticsTree<int, int> tree;
+        (void) tree.insert(-1, -1);
+        tree.assign_sorted(sorted.begin(), sorted.end());
+        BOOST_TEST(tree.size() == sorted.size());
+        BOOST_TEST(tree.find(-1) == tree.end());
+        auto sortedIter = sorted.begin();
+        for(const auto& [key, value] : tree) {
+            BOOST_TEST(key == sortedIter->first);
+            BOOST_TEST(value == sortedIter->second);
+            ++sortedIter;
+        }
+        for(int i = 0; i < count; ++i) {
+            BOOST_TEST(tree.select(static_cast<size_t>(i))->first == i * 3);
+        }
+        // The tree remains fully usable afterwards.
+        (void) tree.insert(1, 1);
+        BOOST_TEST(tree.erase(0) == (count > 0));
+        BOOST_TEST(tree.rank(2) == 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AssignSortedAllocatesOneChunk)
+{
+    using Tree = AvlTree<int, std::string, std::less<int>, CountingAllocator<std::pair<int, std::string>>>;
+    std::vector<std::pair<int, std::string>> sorted;
+    for(int i = 0; i < 100000; ++i) {
+        sorted.emplace_back(i, std::to_string(i));
+    }
+    Tree tree;
+    const auto allocationsBefore = allocatorCalls;
+    tree.assign_sorted(sorted.begin(), sorted.end());
+    BOOST_TEST(allocatorCalls == allocationsBefore + 1);
+    BOOST_TEST(tree.find(54321)->second == "54321");
+    BOOST_TEST(tree.erase(54321));
+    BOOST_TEST(tree.size() == 99999);
+}
+
+BOOST_AUTO_TEST_CASE(AssignSortedIsExceptionSafe)
+{
+    ThrowsOnCopy::copiesLeft = 1000;
+    std::vector<std::pair<int, ThrowsOnCopy>> sorted;
+    sorted.reserve(100);
+    for(int i = 0; i < 100; ++i) {
+        sorted.emplace_back(i, ThrowsOnCopy(std::string(32, 'v')));
+    }
+    AvlTree<int, ThrowsOnCopy> tree;
+    ThrowsOnCopy::copiesLeft = 60;
+    BOOST_CHECK_THROW(tree.assign_sorted(sorted.begin(), sorted.end()), std::runtime_error);
+    BOOST_TEST(tree.empty());
+    BOOST_TEST((tree.begin() == tree.end()));
+}
+
+BOOST_AUTO_TEST_CASE(TransparentLookupAvoidsTemporaryKeys)
+{
+    // Compares like std::less<> but counts how often a std::string has to be built.
+    struct CountingLess : std::less<> {
+        bool operator()(const std::string& lhs, const std::string& rhs) const {
+            ++stringComparisons;
+            return lhs < rhs;
+        }
+        using std::less<>::operator();
+    };
+    AvlTree<std::string, int, CountingLess> tree;
+    for(const char* name : {"Joe", "Ben", "Arthur", "Zoe", "Mia"}) {
+        (void) tree.insert(name, 1);
+    }
+    stringComparisons = 0;
+    const std::string_view arthur("Arthur");
+    BOOST_TEST(tree.find(arthur)->first == "Arthur");
+    BOOST_TEST((tree.find("Nobody") == tree.end()));
+    BOOST_TEST(tree.lower_bound("B")->first == "Ben");
+    BOOST_TEST(tree.upper_bound(std::string_view("Joe"))->first == "Mia");
+    const auto [first, last] = tree.equal_range("Mia");
+    BOOST_TEST(first->first == "Mia");
+    BOOST_TEST(last->first == "Zoe");
+    std::vector<std::string> names;
+    for(const auto& [name, value] : tree.range("Bz", "N")) {
+        names.push_back(name);
+    }
+    BOOST_TEST(names == std::vector<std::string>({"Joe", "Mia"}));
+    const auto& constTree = tree;
+    BOOST_TEST(constTree.find("Zoe")->first == "Zoe");
+    BOOST_TEST(tree.erase("Zoe"));
+    BOOST_TEST(!tree.erase(std::string_view("Zoe")));
+
+    // A duplicate key given as a string literal is rejected without building a std::string.
+    BOOST_TEST(!tree.try_emplace("Joe", 2).second);
+    BOOST_TEST(tree.try_emplace("Ann", 3).second);
+    BOOST_TEST(tree.find("Ann")->second == 3);
+    BOOST_TEST(stringComparisons == 0);
+}
+
+BOOST_AUTO_TEST_CASE(TransparentOrderStatistics)
+{
+    AvlTree<std::string, int, std::less<>, std::allocator<std::pair<std::string, int>>, WithOrderStatistics> tree;
+    for(const char* name : {"a", "b", "c", "d"}) {
+        (void) tree.insert(name, 0);
+    }
+    BOOST_TEST(tree.rank("c") == 2);
+    BOOST_TEST(tree.count_range("b", std::string_view("d")) == 2);
+}
+
+BOOST_AUTO_TEST_CASE(StatefulComparator)
+{
+    // Orders keys by a lookup table, the way an interned-string pool orders its ids.
+    struct ByRank {
+        const std::vector<int>* ranks;
+        bool operator()(int lhs, int rhs) const {
+            return (*ranks)[static_cast<size_t>(lhs)] < (*ranks)[static_cast<size_t>(rhs)];
+        }
+    };
+    const std::vector<int> ranks = {3, 0, 4, 1, 2};
+    AvlTree<int, std::string, ByRank> tree(ByRank{&ranks});
+    for(int key = 0; key < 5; ++key) {
+        (void) tree.insert(key, std::to_string(key));
+    }
+    std::vector<int> keys;
+    for(const auto& [key, value] : tree) {
+        keys.push_back(key);
+    }
+    BOOST_TEST(keys == std::vector<int>({1, 3, 4, 0, 2}));
+    BOOST_TEST(tree.find(4)->second == "4");
+    BOOST_TEST(tree.lower_bound(0)->first == 0);
+    BOOST_TEST(tree.key_comp().ranks == &ranks);
+
+    // The comparator travels with the elements.
+    AvlTree<int, std::string, ByRank> moved(std::move(tree));
+    BOOST_TEST(moved.erase(3));
+    BOOST_TEST(moved.begin()->first == 1);
+    BOOST_TEST((++moved.begin())->first == 4);
+
+    // Stateless comparators add nothing to the size of the tree.
+    static_assert(sizeof(AvlTree<int, int>) < sizeof(AvlTree<int, int, ByRank>));
+    static_assert(sizeof(AvlTree<int, int>) == sizeof(AvlTree<int, int, std::greater<int>>));
+}
+
+BOOST_AUTO_TEST_CASE(CompactNodesAgainstStdMap)
+{
+    using CompactTree = AvlTree<int, int, std::less<int>, std::allocator<std::pair<int, int>>, WithCompactNodes>;
+    // The balance factor lives in the parent pointer, leaving just the value and three links.
+    static_assert(CompactTree::node_size == sizeof(std::pair<int, int>) + 3 * sizeof(void*) + sizeof(size_t));
+    static_assert(CompactTree::node_size < OrderStatisticsTree<int, int>::node_size);
+
+    std::mt19937 rng(11);
+    CompactTree tree;
+    std::map<int, int> expected;
+    for(int i = 0; i < 20000; ++i) {
+        const int key = static_cast<int>(rng() % 2000);
+        if(rng() % 3 != 0) {
+            BOOST_TEST(tree.insert(key, i).second == expected.emplace(key, i).second);
+        } else {
+            BOOST_TEST(tree.erase(key) == (expected.erase(key) == 1));
+        }
+    }
+    BOOST_TEST(tree.size() == expected.size());
+    size_t index = 0;
+    for(const auto& [key, value] : expected) {
+        BOOST_TEST(tree.find(key)->second == value);
+        BOOST_TEST(tree.rank(key) == index);
+        BOOST_TEST(tree.select(index)->first == key);
+        ++index;
+    }
+
+    std::vector<std::pair<int, int>> sorted(expected.begin(), expected.end());
+    tree.assign_sorted(sorted.begin(), sorted.end());
+    BOOST_TEST(tree.size() == sorted.size());
+    auto sortedIter = sorted.begin();
+    for(const auto& element : tree) {
+        BOOST_TEST((element == *sortedIter++));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(LinkedNodesAgainstStdMap)
+{
+    // Two more links per node buy iteration that never touches the tree structure.
+    static_assert(LinkedTree::node_size == OrderStatisticsTree<int, int>::node_size + 2 * sizeof(void*));
+    static_assert(std::bidirectional_iterator<LinkedTree::const_iterator>);
+
+    std::mt19937 rng(23);
+    LinkedTree tree;
+    std::map<int, int> expected;
+    for(int i = 0; i < 20000; ++i) {
+        const int key = static_cast<int>(rng() % 2000);
+        switch(rng() % 4) {
+        case 0:
+            BOOST_TEST(tree.insert(key, i).second == expected.emplace(key, i).second);
+            break;
+        case 1: {
+            // A hint next to the key links the node without a search, which has to keep the list in step too.
+            const auto hint = tree.lower_bound(key);
+            const auto sizeBefore = tree.size();
+            const auto inserted = tree.emplace_hint(hint, key, i);
+            BOOST_TEST((tree.size() > sizeBefore) == expected.emplace(key, i).second);
+            BOOST_TEST(inserted->first == key);
+            break;
+        }
+        case 2: {
+            const auto found = tree.find(key);
+            if(found != tree.end()) {
+                const auto next = tree.erase(found);
+                const auto expectedNext = expected.erase(expected.find(key));
+                BOOST_TEST((next == tree.end()) == (expectedNext == expected.end()));
+                if(next != tree.end()) {
+                    BOOST_TEST(next->first == expectedNext->first);
+                }
+            }
+            break;
+        }
+        default:
+            BOOST_TEST(tree.erase(key) == (expected.erase(key) == 1));
+            break;
+        }
+    }
+    checkBothWays(tree, expected);
+    BOOST_TEST(std::prev(tree.end())->first == expected.rbegin()->first);
+}
+
+BOOST_AUTO_TEST_CASE(LinkedNodesFollowBulkOperations)
+{
+    std::map<int, int> expected;
+    std::vector<std::pair<int, int>> sorted;
+    for(int key = 0; key < 3000; key += 3) {
+        sorted.emplace_back(key, key);
+        expected.emplace(key, key);
+    }
+    LinkedTree tree;
+    tree.assign_sorted(sorted.begin(), sorted.end());
+    checkBothWays(tree, expected);
+
+    // Every multiple of two joins the tree, interleaved with what it holds already.
+    std::vector<std::pair<int, int>> batch;
+    for(int key = 0; key < 4000; key += 2) {
+        batch.emplace_back(key, -key);
+        (void) expected.emplace(key, -key);
+    }
+    BOOST_TEST(tree.insert_batch(batch.begin(), batch.end()) == 1500);
+    checkBothWays(tree, expected);
+    batch = {{5000, 0}, {5001, 1}};
+    (void) tree.insert_batch(batch.begin(), batch.end());
+    expected.insert(batch.begin(), batch.end());
+    checkBothWays(tree, expected);
+
+    auto [less, greater] = std::move(tree).split(1500);
+    checkBothWays(tree, {});
+    checkBothWays(less, {expected.begin(), expected.lower_bound(1500)});
+    checkBothWays(greater, {expected.lower_bound(1500), expected.end()});
+    tree = LinkedTree::join(std::move(less), std::move(greater));
+    checkBothWays(less, {});
+    checkBothWays(greater, {});
+    checkBothWays(tree, expected);
+
+    LinkedTree other;
+    std::map<int, int> otherExpected;
+    for(int key = 1; key < 6000; key += 7) {
+        (void) other.insert(key, key);
+        otherExpected.emplace(key, key);
+    }
+    std::map<int, int> intersection;
+    std::map<int, int> difference;
+    for(const auto& element : expected) {
+        (otherExpected.contains(element.first) ? intersection : difference).insert(element);
+    }
+    std::map<int, int> united(expected);
+    united.insert(otherExpected.begin(), otherExpected.end());
+
+    const auto build = [](const std::map<int, int>& elements) {
+        LinkedTree result;
+        for(const auto& [key, value] : elements) {
+            (void) result.insert(key, value);
+        }
+        return result;
+    };
+    checkBothWays(LinkedTree::set_intersection(build(expected), build(otherExpected), 4), intersection);
+    checkBothWays(LinkedTree::set_difference(build(expected), build(otherExpected), 4), difference);
+    checkBothWays(LinkedTree::set_union(build(expected), build(otherExpected), 4), united);
+    // Tall enough to fork, where a small second tree is woven in and a large one rebuilds the list.
+    for(const int otherStep : {5, 997}) {
+        std::map<int, int> large;
+        std::map<int, int> small;
+        for(int key = 0; key < 60000; key += 2) {
+            large.emplace(key, key);
+        }
+        for(int key = 0; key < 60000; key += otherStep) {
+            small.emplace(key, -key);
+        }
+        std::map<int, int> largeUnited(large);
+        largeUnited.insert(small.begin(), small.end());
+        checkBothWays(LinkedTree::set_union(build(large), build(small), 4), largeUnited);
+        std::map<int, int> largeDifference;
+        for(const auto& element : large) {
+            if(!small.contains(element.first)) {
+                largeDifference.insert(element);
+            }
+        }
+        checkBothWays(LinkedTree::set_difference(build(large), build(small), 4), largeDifference);
+    }
+    tree.merge(std::move(other));
+    checkBothWays(other, {});
+    checkBothWays(tree, united);
+
+    // Moving and swapping have to carry the ends of the list over to the other header.
+    (void) other.insert(-1, -1);
+    swap(tree, other);
+    checkBothWays(tree, {{-1, -1}});
+    checkBothWays(other, united);
+    LinkedTree moved(std::move(other));
+    checkBothWays(other, {});
+    checkBothWays(moved, united);
+    moved.clear();
+    checkBothWays(moved, {});
+}
+
+BOOST_AUTO_TEST_CASE(BatchLookups)
+{
+    AvlTree<int, int> tree;
+    std::vector<int> probes(100);
+    std::vector<AvlTree<int, int>::iterator> found(probes.size());
+    const auto present = std::make_unique<bool[]>(probes.size());
+    tree.find_batch(probes, found);
+    BOOST_TEST(tree.contains_batch(probes, {present.get(), probes.size()}) == 0);
+    BOOST_TEST((found.front() == tree.end()));
+
+    std::mt19937 rng(5);
+    for(int i = 0; i < 1000; ++i) {
+        (void) tree.insert(static_cast<int>(rng() % 2000), i);
+    }
+    // Not a multiple of the batch group, so the last group is partial.
+    probes.resize(1234);
+    for(auto& probe : probes) {
+        probe = static_cast<int>(rng() % 2000);
+    }
+    found.resize(probes.size());
+    tree.find_batch(probes, found);
+    const auto morePresent = std::make_unique<bool[]>(probes.size());
+    const auto hits = tree.contains_batch(probes, {morePresent.get(), probes.size()});
+    size_t expectedHits = 0;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        const auto expected = tree.find(probes[i]);
+        BOOST_TEST((found[i] == expected));
+        BOOST_TEST(morePresent[i] == (expected != tree.end()));
+        expectedHits += expected != tree.end() ? 1 : 0;
+    }
+    BOOST_TEST(hits == expectedHits);
+
+    const auto& constTree = tree;
+    std::vector<AvlTree<int, int>::const_iterator> constFound(probes.size());
+    constTree.find_batch(probes, constFound);
+    BOOST_TEST((constFound[0] == found[0]));
+}
+
+BOOST_AUTO_TEST_CASE(SplitAndJoin)
+{
+    for(int count = 0; count <= 40; ++count) {
+        for(int key = -1; key <= 2 * count + 1; ++key) {
+            OrderStatisticsTree<int, int> tree;
+            for(int i = 0; i < count; ++i) {
+                (void) tree.insert(2 * i, i);
+            }
+            const auto kept = tree.find(key);
+            auto [less, rest] = std::move(tree).split(key);
+            BOOST_TEST(tree.empty());
+            BOOST_TEST(less.size() + rest.size() == static_cast<size_t>(count));
+            BOOST_TEST(less.size() == static_cast<size_t>(std::clamp((key + 1) / 2, 0, count)));
+            for(size_t index = 0; index < less.size(); ++index) {
+                BOOST_TEST(less.select(index)->first == static_cast<int>(2 * index));
+            }
+            for(size_t index = 0; index < rest.size(); ++index) {
+                BOOST_TEST(rest.select(index)->first == static_cast<int>(2 * (less.size() + index)));
+            }
+            // Nodes are relinked, so iterators follow their element into its half.
+            if(kept != tree.end()) {
+                BOOST_TEST((kept == rest.begin()));
+            }
+
+            auto joined = OrderStatisticsTree<int, int>::join(std::move(less), std::move(rest));
+            BOOST_TEST(less.empty());
+            BOOST_TEST(rest.empty());
+            BOOST_TEST(joined.size() == static_cast<size_t>(count));
+            for(int i = 0; i < count; ++i) {
+                BOOST_TEST(joined.rank(2 * i) == static_cast<size_t>(i));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SplitHalvesOutliveEachOther)
+{
+    std::mt19937 rng(21);
+    AvlTree<int, std::string> tree;
+    for(int i = 0; i < 5000; ++i) {
+        (void) tree.insert(static_cast<int>(rng() % 10000), std::to_string(i));
+    }
+    const auto size = tree.size();
+    auto [less, rest] = std::move(tree).split(3000);
+    BOOST_TEST(less.size() + rest.size() == size);
+    less.clear();
+    // The other half still owns its nodes, and keeps reusing and allocating them.
+    for(int i = 0; i < 2000; ++i) {
+        (void) rest.erase(static_cast<int>(rng() % 10000));
+        (void) rest.insert(static_cast<int>(rng() % 10000), "again");
+    }
+    int previous = -1;
+    for(const auto& [key, value] : rest) {
+        BOOST_TEST(key > previous);
+        previous = key;
+    }
+
+    // Trees grown apart can be joined when their keys do not overlap.
+    AvlTree<int, std::string> low;
+    for(int key = -100; key < 0; ++key) {
+        (void) low.insert(key, "low");
+    }
+    rest.merge(std::move(low));
+    BOOST_TEST(low.empty());
+    BOOST_TEST(rest.begin()->first == -100);
+    BOOST_TEST(rest.find(-1)->second == "low");
+}
+
+BOOST_AUTO_TEST_CASE(MergeKeepsExistingElements)
+{
+    std::mt19937 rng(8);
+    using Tree = AvlTree<int, int, std::less<int>, std::allocator<std::pair<int, int>>, WithCompactNodes>;
+    for(const auto otherSize : {0, 1, 10, 1000}) {
+        Tree tree;
+        Tree other;
+        std::map<int, int> expected;
+        for(int i = 0; i < 1000; ++i) {
+            const int key = static_cast<int>(rng() % 3000);
+            (void) tree.insert(key, i);
+            (void) expected.emplace(key, i);
+        }
+        for(int i = 0; i < otherSize; ++i) {
+            const int key = static_cast<int>(rng() % 3000);
+            (void) other.insert(key, -i);
+            (void) expected.emplace(key, -i);
+        }
+        tree.merge(std::move(other));
+        BOOST_TEST(other.empty());
+        BOOST_TEST(tree.size() == expected.size());
+        size_t index = 0;
+        for(const auto& [key, value] : expected) {
+            BOOST_TEST(tree.select(index)->first == key);
+            BOOST_TEST(tree.find(key)->second == value);
+            ++index;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(InsertBatchKeepsExistingElements)
+{
+    std::mt19937 rng(12);
+    OrderStatisticsTree<int, int> tree;
+    std::map<int, int> expected;
+    // Batches that overlap the tree, and ones that order entirely before or after it.
+    for(int round = 0; round < 60; ++round) {
+        const int low = round % 3 == 0 ? -10000 * round : round % 3 == 1 ? 10000 * round : 0;
+        std::map<int, int> batch;
+        const auto batchSize = rng() % 500;
+        for(unsigned i = 0; i < batchSize; ++i) {
+            (void) batch.emplace(low + static_cast<int>(rng() % 5000), round);
+        }
+        const std::vector<std::pair<int, int>> sorted(batch.begin(), batch.end());
+        size_t added = 0;
+        for(const auto& element : sorted) {
+            added += expected.insert(element).second ? 1 : 0;
+        }
+        BOOST_TEST(tree.insert_batch(sorted.begin(), sorted.end()) == added);
+        BOOST_TEST(tree.size() == expected.size());
+    }
+    size_t index = 0;
+    for(const auto& [key, value] : expected) {
+        BOOST_TEST(tree.select(index)->first == key);
+        BOOST_TEST(tree.find(key)->second == value);
+        ++index;
+    }
+    // The tree still takes single insertions and erasures after being merged into.
+    for(const auto& [key, value] : expected) {
+        BOOST_TEST(tree.erase(key));
+    }
+    BOOST_TEST(tree.empty());
+}
+
+BOOST_AUTO_TEST_CASE(InsertBatchIsExceptionSafe)
+{
+    ThrowsOnCopy::copiesLeft = 1000;
+    AvlTree<int, ThrowsOnCopy> tree;
+    (void) tree.try_emplace(5, ThrowsOnCopy("five"));
+    const std::array<std::pair<int, ThrowsOnCopy>, 3> batch{
+        {{1, ThrowsOnCopy("one")}, {5, ThrowsOnCopy("other five")}, {9, ThrowsOnCopy("nine")}}};
+    ThrowsOnCopy::copiesLeft = 2;
+    BOOST_CHECK_THROW((void) tree.insert_batch(batch.begin(), batch.end()), std::runtime_error);
+    BOOST_TEST(tree.size() == 1);
+    BOOST_TEST(tree.find(5)->second.text == "five");
+    ThrowsOnCopy::copiesLeft = 3;
+    BOOST_TEST(tree.insert_batch(batch.begin(), batch.end()) == 2);
+    BOOST_TEST(tree.find(5)->second.text == "five");
+    BOOST_TEST(tree.find(9)->second.text == "nine");
+}
+
+BOOST_AUTO_TEST_CASE(HintedInsertAndFingerSearch)
+{
+    // Orders like std::less<> while counting the comparisons made.
+    struct CountingLess : std::less<> {
+        int* comparisons;
+        bool operator()(int lhs, int rhs) const {
+            ++*comparisons;
+            return lhs < rhs;
+        }
+    };
+    using Tree = AvlTree<int, int, CountingLess, std::allocator<std::pair<int, int>>, WithCompactNodes>;
+    int hintedComparisons = 0;
+    int plainComparisons = 0;
+    Tree hinted(CountingLess{{}, &hintedComparisons});
+    Tree plain(CountingLess{{}, &plainComparisons});
+    std::map<int, int> expected;
+
+    // Timestamps that mostly increase, with some arriving a little out of order.
+    std::mt19937 rng(20);
+    auto last = hinted.end();
+    for(int i = 0; i < 20000; ++i) {
+        const int key = 10 * i + static_cast<int>(rng() % 31) - 15;
+        const bool inserted = expected.emplace(key, i).second;
+        const auto at = hinted.insert(last, {key, i});
+        BOOST_TEST(at->first == key);
+        BOOST_TEST(at->second == expected[key]);
+        BOOST_TEST(plain.insert(key, i).second == inserted);
+        last = at;
+    }
+    BOOST_TEST(hinted.size() == expected.size());
+    BOOST_TEST(hintedComparisons * 3 < plainComparisons);
+    size_t index = 0;
+    for(const auto& [key, value] : expected) {
+        BOOST_TEST(hinted.select(index)->first == key);
+        ++index;
+    }
+
+    // Finger searches from every kind of hint find what a search from the root finds.
+    const auto& constTree = hinted;
+    for(int i = 0; i < 5000; ++i) {
+        const int hintKey = static_cast<int>(rng() % 200000);
+        const int key = hintKey + static_cast<int>(rng() % 201) - 100;
+        const auto hint = rng() % 8 == 0 ? hinted.end() : hinted.lower_bound(hintKey);
+        const auto found = hinted.find(hint, key);
+        BOOST_TEST((found == hinted.find(key)));
+        BOOST_TEST((constTree.find(hint, key) == found));
+    }
+    // Searching for a neighbour of the hint takes far fewer comparisons than from the root.
+    int fingerComparisons = 0;
+    int rootComparisons = 0;
+    for(int key = 50000; key < 150000; key += 10) {
+        const auto hint = hinted.lower_bound(key);
+        hintedComparisons = 0;
+        (void) hinted.find(hint, key + 10);
+        fingerComparisons += std::exchange(hintedComparisons, 0);
+        (void) hinted.find(key + 10);
+        rootComparisons += hintedComparisons;
+    }
+    BOOST_TEST(fingerComparisons * 2 < rootComparisons);
+
+    // Hints anywhere still place the key correctly, emplace_hint builds the value in place.
+    for(int i = 0; i < 2000; ++i) {
+        const int key = static_cast<int>(rng() % 250000);
+        const auto hint = hinted.select(rng() % hinted.size());
+        (void) expected.emplace(key, -i);
+        BOOST_TEST(hinted.emplace_hint(hint, key, -i)->second == expected[key]);
+    }
+    BOOST_TEST(hinted.size() == expected.size());
+    index = 0;
+    for(const auto& [key, value] : expected) {
+        BOOST_TEST(hinted.select(index)->first == key);
+        BOOST_TEST(hinted.select(index)->second == value);
+        ++index;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(HintedTransparentFind)
+{
+    AvlTree<std::string, int, std::less<>> tree;
+    const auto ben = tree.insert(tree.cend(), {"Ben", 2});
+    (void) tree.emplace_hint(ben, std::piecewise_construct, std::forward_as_tuple("Arthur"),
+                             std::forward_as_tuple(1));
+    (void) tree.insert(ben, std::pair<std::string, int>("Carl", 3));
+    BOOST_TEST(tree.find(ben, std::string_view("Arthur"))->second == 1);
+    BOOST_TEST(tree.find(tree.begin(), "Carl")->second == 3);
+    BOOST_TEST((tree.find(ben, "Dana") == tree.end()));
+    BOOST_TEST(tree.size() == 3);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelSetOperations)
+{
+    using Tree = OrderStatisticsTree<int, std::string>;
+    using Operation = Tree (*)(Tree&&, Tree&&, unsigned);
+    using Element = std::pair<int, std::string>;
+    const auto byKey = [](const Element& lhs, const Element& rhs) { return lhs.first < rhs.first; };
+    // The standard algorithms keep the element of the first range where keys are equal, as the trees do.
+    const auto unite = [&](const auto& lhs, const auto& rhs, auto out) {
+        std::set_union(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), out, byKey);
+    };
+    const auto intersect = [&](const auto& lhs, const auto& rhs, auto out) {
+        std::set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), out, byKey);
+    };
+    const auto subtract = [&](const auto& lhs, const auto& rhs, auto out) {
+        std::set_difference(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), out, byKey);
+    };
+
+    std::mt19937 rng(31);
+    const auto check = [&](const int firstSize, const int secondSize, const unsigned threads,
+                           const Operation operation, const auto& expectedOperation) {
+        std::array<Tree, 2> trees;
+        std::array<std::map<int, std::string>, 2> expected;
+        for(int side = 0; side < 2; ++side) {
+            for(int i = 0; i < (side == 0 ? firstSize : secondSize); ++i) {
+                const int key = static_cast<int>(rng() % 100000);
+                (void) trees[side].insert(key, std::to_string(i));
+                (void) expected[side].emplace(key, std::to_string(i));
+            }
+        }
+        std::vector<Element> result;
+        expectedOperation(expected[0], expected[1], std::back_inserter(result));
+        const auto tree = operation(std::move(trees[0]), std::move(trees[1]), threads);
+        BOOST_TEST(trees[1].empty());
+        BOOST_TEST(tree.size() == result.size());
+        for(size_t index = 0; index < result.size(); ++index) {
+            BOOST_TEST((*tree.select(index) == result[index]));
+        }
+    };
+
+    // The larger inputs are tall enough for the operations to fork onto other threads.
+    for(const auto& [firstSize, secondSize] : {std::pair(0, 100), std::pair(100, 0), std::pair(50, 40000),
+                                               std::pair(40000, 50), std::pair(30000, 30000)}) {
+        for(const unsigned threads : {1U, 4U}) {
+            check(firstSize, secondSize, threads, &Tree::set_union, unite);
+            check(firstSize, secondSize, threads, &Tree::set_intersection, intersect);
+            check(firstSize, secondSize, threads, &Tree::set_difference, subtract);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(StatsCountTheWork)
+{
+    using Tree = AvlTree<int, int, CountingLess, std::allocator<std::pair<int, int>>, WithStats>;
+    const auto total = [](const auto& buckets) { return std::accumulate(buckets.begin(), buckets.end(), std::uint64_t{0}); };
+    statsComparisons = 0;
+    Tree tree;
+    BOOST_TEST(tree.stats().comparisons == 0);
+    // Ascending keys lean every new node to the right, so inserting them keeps rotating.
+    for(int key = 0; key < 1000; ++key) {
+        (void) tree.insert(key, key);
+    }
+    auto stats = tree.stats();
+    BOOST_TEST(stats.allocations == 1000);
+    BOOST_TEST(stats.frees == 0);
+    BOOST_TEST(stats.rotations > 0);
+    BOOST_TEST(stats.rotations < 1000);
+    BOOST_TEST(stats.comparisons == statsComparisons);
+    BOOST_TEST(total(stats.descentDepths) == 1000);
+
+    for(int key = 0; key < 1000; ++key) {
+        BOOST_TEST(tree.find(key)->second == key);
+    }
+    stats = tree.stats();
+    BOOST_TEST(total(stats.descentDepths) == 2000);
+    // An AVL tree of 1000 nodes is at most 14 levels tall.
+    BOOST_TEST(std::all_of(stats.descentDepths.begin() + 15, stats.descentDepths.end(),
+                           [](const std::uint64_t count) { return count == 0; }));
+    BOOST_TEST(stats.comparisons == statsComparisons);
+
+    // Iterator steps are counted for every tree of this type, so only the difference belongs to this one.
+    const auto stepsBefore = tree.stats().stepLengths;
+    BOOST_TEST(std::distance(tree.cbegin(), tree.cend()) == 1000);
+    stats = tree.stats();
+    BOOST_TEST(total(stats.stepLengths) - total(stepsBefore) == 1000);
+    // Half of the nodes are leaves whose successor is their parent, one link away.
+    BOOST_TEST(stats.stepLengths[0] - stepsBefore[0] >= 500);
+
+    for(int key = 0; key < 10; ++key) {
+        BOOST_TEST(tree.erase(key));
+    }
+    BOOST_TEST(tree.stats().frees == 10);
+    tree.clear();
+    stats = tree.stats();
+    BOOST_TEST(stats.frees == 1000);
+    BOOST_TEST(stats.allocations == 1000);
+}
+
+BOOST_AUTO_TEST_CASE(StatsIteratorsOutliveTheirTree)
+{
+    using Tree = AvlTree<int, int, std::less<int>, std::allocator<std::pair<int, int>>, WithStats>;
+    const auto total = [](const auto& buckets) { return std::accumulate(buckets.begin(), buckets.end(), std::uint64_t{0}); };
+    auto tree = std::make_unique<Tree>();
+    for(int key = 0; key < 10; ++key) {
+        (void) tree->insert(key, key);
+    }
+    auto iter = tree->find(6);
+    // The element carries the iterator into the upper half, which outlives the tree it came from.
+    auto [lower, upper] = std::move(*tree).split(5);
+    tree.reset();
+    const auto before = upper.stats();
+    ++iter;
+    BOOST_TEST(iter->first == 7);
+    BOOST_TEST(total(upper.stats().stepLengths) == total(before.stepLengths) + 1);
+}
+
+BOOST_AUTO_TEST_CASE(DefaultOrderComparesOncePerLevel)
+{
+    AvlTree<std::string, int, std::less<std::string>, std::allocator<std::pair<std::string, int>>, WithStats> tree;
+    std::mt19937 rng(37);
+    for(int i = 0; i < 2000; ++i) {
+        (void) tree.insert("key" + std::to_string(rng() % 5000), i);
+    }
+    const auto before = tree.stats();
+    for(int i = 0; i < 5000; ++i) {
+        (void) tree.find("key" + std::to_string(i));
+    }
+    const auto after = tree.stats();
+    BOOST_TEST(after.comparisons - before.comparisons == visitedNodes(after) - visitedNodes(before));
+}
+
+BOOST_AUTO_TEST_CASE(KeyPrefixAgainstStdMap)
+{
+    using Tree = AvlTree<std::string, int, std::less<std::string>, std::allocator<std::pair<std::string, int>>, WithPrefixStats>;
+    // Few distinct characters, including ones that a signed char would order first, and lengths
+    // around that of a prefix, so keys often share it or are padded to it.
+    const std::string alphabet("\0a\xff", 3);
+    std::mt19937 rng(41);
+    const auto randomKey = [&] {
+        std::string key(rng() % 12, 'a');
+        for(auto& character : key) {
+            character = alphabet[rng() % alphabet.size()];
+        }
+        return key;
+    };
+    Tree tree;
+    std::map<std::string, int> expected;
+    for(int i = 0; i < 20000; ++i) {
+        const auto key = randomKey();
+        switch(rng() % 3) {
+        case 0:
+            BOOST_TEST(tree.insert(key, i).second == expected.emplace(key, i).second);
+            break;
+        case 1:
+            BOOST_TEST(tree.erase(key) == expected.erase(key));
+            break;
+        default:
+            BOOST_TEST((tree.find(key) == tree.cend()) == !expected.contains(key));
+            BOOST_TEST((tree.lower_bound(key) == tree.cend()) == (expected.lower_bound(key) == expected.end()));
+            break;
+        }
+    }
+    const auto same = [](const auto& lhs, const auto& rhs) { return lhs.first == rhs.first && lhs.second == rhs.second; };
+    BOOST_TEST(std::equal(tree.cbegin(), tree.cend(), expected.begin(), expected.end(), same));
+
+    // Keys that differ in their first eight bytes are told apart without comparing the strings.
+    Tree distinct;
+    for(int i = 0; i < 1000; ++i) {
+        (void) distinct.insert(std::to_string(i * 7919 % 1000) + "-suffix", i);
+    }
+    const auto before = distinct.stats();
+    for(int i = 0; i < 1000; ++i) {
+        BOOST_TEST(distinct.find(std::to_string(i) + "-suffix")->second * 7919 % 1000 == i);
+    }
+    const auto after = distinct.stats();
+    const auto visited = visitedNodes(after) - visitedNodes(before);
+    BOOST_TEST(after.comparisons - before.comparisons < visited / 2);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelForEachAndReduce)
+{
+    // Tall enough for the top levels to be split over threads.
+    AvlTree<int, std::int64_t> tree;
+    std::vector<std::pair<int, std::int64_t>> sorted;
+    for(int key = 0; key < 100000; ++key) {
+        sorted.emplace_back(key, key);
+    }
+    tree.assign_sorted(sorted.begin(), sorted.end());
+    const auto value = [](const std::pair<const int, std::int64_t>& element) { return element.second; };
+    const auto sum = [](const std::int64_t lhs, const std::int64_t rhs) { return lhs + rhs; };
+    for(const unsigned threads : {1U, 4U, 16U}) {
+        tree.parallel_for_each([](std::pair<int, std::int64_t>& element) { element.second = 3 * element.first; }, threads);
+        BOOST_TEST(tree.parallel_reduce(std::int64_t{7}, value, sum, threads) == 7 + std::int64_t{3} * 99999 * 50000);
+
+        std::atomic<std::int64_t> visited(0);
+        std::as_const(tree).parallel_for_each([&](const std::pair<int, std::int64_t>& element) {
+            visited += element.second;
+        }, threads);
+        BOOST_TEST(visited.load() == std::int64_t{3} * 99999 * 50000);
+    }
+
+    // Concatenating is associative but not commutative, so every element must be combined in key order.
+    AvlTree<int, std::string> letters;
+    for(int i = 0; i < 26; ++i) {
+        (void) letters.insert(i, std::string(1, static_cast<char>('a' + i)));
+    }
+    const auto text = [](const std::pair<const int, std::string>& element) { return element.second; };
+    BOOST_TEST(letters.parallel_reduce(std::string(">"), text, std::plus<>(), 4) == ">abcdefghijklmnopqrstuvwxyz");
+    letters.clear();
+    BOOST_TEST(letters.parallel_reduce(std::string(">"), text, std::plus<>()) == ">");
+
+    // A first throw is rethrown after every thread is done.
+    BOOST_CHECK_THROW(tree.parallel_for_each([](const std::pair<int, std::int64_t>& element) {
+        if(element.first % 1000 == 0) {
+            throw std::runtime_error("visit failed");
+        }
+    }, 4), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(AggregatesAgainstStdMap)
+{
+    aggregatesAgainstStdMap<WithSums>();
+    aggregatesAgainstStdMap<WithKeyLists>();
+}
+
+BOOST_AUTO_TEST_CASE(NodeHandlesMoveWithoutAllocating)
+{
+    using Tree = AvlTree<int, Tracked, std::less<int>, CountingAllocator<std::pair<int, Tracked>>>;
+    Tree source;
+    Tree target;
+    for(int key = 0; key < 100; ++key) {
+        (void) source.emplace(key, key);
+        (void) target.emplace(key + 1000, key);
+    }
+    // The first trip each way lets both trees share their chunks.
+    (void) target.insert(source.extract(0));
+    (void) source.insert(target.extract(1000));
+    Tracked::reset();
+    const auto allocationsBefore = allocatorCalls;
+    for(int key = 1; key < 100; ++key) {
+        auto handle = source.extract(key);
+        BOOST_TEST(!handle.empty());
+        BOOST_TEST(handle.key() == key);
+        const auto [position, inserted, node] = target.insert(std::move(handle));
+        BOOST_TEST(inserted);
+        BOOST_TEST(node.empty());
+        BOOST_TEST(position->second.payload == key);
+        (void) source.insert(source.cend(), target.extract(target.find(key + 1000)));
+    }
+    BOOST_TEST(allocatorCalls == allocationsBefore);
+    BOOST_TEST(Tracked::copies == 0);
+    BOOST_TEST(Tracked::moves == 0);
+    BOOST_TEST(source.size() == 100);
+    BOOST_TEST(target.size() == 100);
+    BOOST_TEST(source.begin()->first == 1000);
+    BOOST_TEST(target.rbegin()->first == 99);
+
+    // A key that is present leaves the node with the handle, a key that is not gives an empty one.
+    auto duplicate = target.extract(5);
+    (void) target.emplace(5, -5);
+    auto result = target.insert(std::move(duplicate));
+    BOOST_TEST(!result.inserted);
+    BOOST_TEST(result.position->second.payload == -5);
+    BOOST_TEST(result.node.mapped().payload == 5);
+    // So does a hinted insert, which only reports where the element with the key is.
+    BOOST_TEST((target.insert(target.cbegin(), std::move(result.node)) == target.find(5)));
+    BOOST_TEST(!result.node.empty());
+    BOOST_TEST(result.node.mapped().payload == 5);
+    BOOST_TEST(source.extract(5).empty());
+    BOOST_TEST(!target.insert(Tree::node_type()).inserted);
+
+    // Changing the key of a handle moves the element to wherever the new key belongs.
+    result.node.key() = -1;
+    BOOST_TEST(target.insert(std::move(result.node)).inserted);
+    BOOST_TEST(target.begin()->first == -1);
+    BOOST_TEST(target.begin()->second.payload == 5);
+
+    // A handle keeps its node alive after the tree it came from is gone.
+    AvlTree<int, std::string>::node_type kept;
+    AvlTree<int, std::string>::node_type dropped;
+    {
+        AvlTree<int, std::string> gone;
+        for(int key = 0; key < 100; ++key) {
+            (void) gone.insert(key, "a string too long to be stored inline " + std::to_string(key));
+        }
+        kept = gone.extract(42);
+        dropped = gone.extract(gone.cbegin());
+    }
+    BOOST_TEST(dropped.key() == 0);
+    AvlTree<int, std::string> other;
+    (void) other.insert(1, "one");
+    BOOST_TEST(other.insert(std::move(kept)).inserted);
+    BOOST_TEST(kept.empty());
+    BOOST_TEST(other.find(42)->second.ends_with(" 42"));
+
+    // Order statistics, aggregates and the links between neighbours follow the nodes.
+    const auto moveKey = [](auto& first, auto& second, auto& expectedFirst, auto& expectedSecond, const int key) {
+        const bool inFirst = expectedFirst.contains(key);
+        BOOST_TEST((inFirst ? second : first).insert((inFirst ? first : second).extract(key)).inserted);
+        (void) (inFirst ? expectedSecond : expectedFirst).insert((inFirst ? expectedFirst : expectedSecond).extract(key));
+    };
+    std::mt19937 rng(30);
+    AugmentedTree<WithKeyLists> lists;
+    AugmentedTree<WithKeyLists> moved;
+    std::map<int, std::int64_t> expectedLists;
+    std::map<int, std::int64_t> expectedMoved;
+    LinkedTree linked;
+    LinkedTree linkedMoved;
+    std::map<int, int> expectedLinked;
+    std::map<int, int> expectedLinkedMoved;
+    for(int key = 0; key < 500; ++key) {
+        (void) lists.insert(key, key);
+        expectedLists.emplace(key, key);
+        (void) linked.insert(key, key);
+        expectedLinked.emplace(key, key);
+    }
+    for(int i = 0; i < 400; ++i) {
+        const int key = static_cast<int>(rng() % 500);
+        moveKey(lists, moved, expectedLists, expectedMoved, key);
+        moveKey(linked, linkedMoved, expectedLinked, expectedLinkedMoved, key);
+    }
+    checkAggregates(lists, expectedLists, rng);
+    checkAggregates(moved, expectedMoved, rng);
+    checkBothWays(linked, expectedLinked);
+    checkBothWays(linkedMoved, expectedLinkedMoved);
+}
+
 // NOLINTEND(readability-magic-numbers)
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,229 @@
+#include <boost/test/unit_test.hpp>
+
+#include "ConcurrentAvlTree.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace algos;
+
+namespace {
+
+// Counts the values alive, to tell when retired nodes are reclaimed.
+struct Counted {
+    static inline int alive{0};
+    explicit Counted(int value) : value(value) {
+        ++alive;
+    }
+    Counted(const Counted& other) : value(other.value) {
+        ++alive;
+    }
+    Counted& operator=(const Counted&) = default;
+    ~Counted() {
+        --alive;
+    }
+    int value;
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(ConcurrentAvlTreeSuite)
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+BOOST_AUTO_TEST_CASE(RandomizedAgainstStdMap)
+{
+    std::mt19937 rng(13);
+    ConcurrentAvlTree<int, int> tree;
+    std::map<int, int> expected;
+    for(int i = 0; i < 20000; ++i) {
+        const int key = static_cast<int>(rng() % 1000);
+        switch(rng() % 4) {
+        case 0:
+            BOOST_TEST(tree.insert(key, i) == expected.emplace(key, i).second);
+            break;
+        case 1:
+            BOOST_TEST(tree.insert_or_assign(key, i) == expected.insert_or_assign(key, i).second);
+            break;
+        default:
+            BOOST_TEST(tree.erase(key) == (expected.erase(key) == 1));
+            break;
+        }
+    }
+    BOOST_TEST(tree.size() == expected.size());
+
+    const auto snapshot = tree.snapshot();
+    auto expectedIter = expected.begin();
+    for(const auto& [key, value] : snapshot) {
+        BOOST_TEST(key == expectedIter->first);
+        BOOST_TEST(value == expectedIter->second);
+        ++expectedIter;
+    }
+    BOOST_TEST((expectedIter == expected.end()));
+    for(int key = -1; key <= 1000; ++key) {
+        const auto found = snapshot.find(key);
+        BOOST_TEST((found == snapshot.end()) == (expected.find(key) == expected.end()));
+        const auto lower = snapshot.lower_bound(key);
+        const auto expectedLower = expected.lower_bound(key);
+        BOOST_TEST((lower == snapshot.end()) == (expectedLower == expected.end()));
+        if(expectedLower != expected.end()) {
+            BOOST_TEST(lower->first == expectedLower->first);
+        }
+        const auto upper = snapshot.upper_bound(key);
+        const auto expectedUpper = expected.upper_bound(key);
+        BOOST_TEST((upper == snapshot.end()) == (expectedUpper == expected.end()));
+        if(expectedUpper != expected.end()) {
+            BOOST_TEST(upper->first == expectedUpper->first);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SnapshotsAreIsolatedFromLaterWrites)
+{
+    ConcurrentAvlTree<std::string, int, std::less<>> tree;
+    (void) tree.insert("Alice", 1);
+    (void) tree.insert("Ben", 2);
+    const auto before = tree.snapshot();
+
+    (void) tree.insert_or_assign("Alice", 10);
+    (void) tree.erase(std::string_view("Ben"));
+    (void) tree.insert("Carl", 3);
+
+    BOOST_TEST(before.find(std::string_view("Alice"))->second == 1);
+    BOOST_TEST(before.find("Ben")->second == 2);
+    BOOST_TEST((before.find("Carl") == before.end()));
+
+    const auto after = tree.snapshot();
+    BOOST_TEST(after.find("Alice")->second == 10);
+    BOOST_TEST((after.find("Ben") == after.end()));
+    BOOST_TEST(after.begin()->first == "Alice");
+    BOOST_TEST((++after.begin())->first == "Carl");
+    BOOST_TEST(tree.size() == 2);
+
+    tree.clear();
+    BOOST_TEST(tree.empty());
+    BOOST_TEST(tree.snapshot().empty());
+    BOOST_TEST(!after.empty());
+}
+
+BOOST_AUTO_TEST_CASE(RetiredNodesOutliveTheirSnapshotsOnly)
+{
+    Counted::alive = 0;
+    {
+        // With two reader slots, the slots are scanned every other node retired.
+        ConcurrentAvlTree<int, Counted> tree(std::less<int>(), std::allocator<std::pair<int, Counted>>(), 2);
+        for(int key = 0; key < 100; ++key) {
+            (void) tree.insert(key, Counted(key));
+        }
+        BOOST_TEST(Counted::alive <= 101);
+        auto snapshot = tree.snapshot();
+        for(int key = 0; key < 100; ++key) {
+            (void) tree.erase(key);
+        }
+        // Everything the snapshot can reach is still alive.
+        BOOST_TEST(Counted::alive >= 100);
+        int sum = 0;
+        for(const auto& [key, value] : snapshot) {
+            sum += value.value;
+        }
+        BOOST_TEST(sum == 4950);
+
+        // Once the snapshot is gone, the next scan of the readers reclaims what it held on to.
+        {
+            auto released = std::move(snapshot);
+            released = tree.snapshot();
+        }
+        for(int write = 0; write < 1000 && Counted::alive > 1; ++write) {
+            (void) tree.erase(1);
+            (void) tree.insert(1, Counted(1));
+        }
+        BOOST_TEST(Counted::alive == 1);
+    }
+    BOOST_TEST(Counted::alive == 0);
+}
+
+BOOST_AUTO_TEST_CASE(SnapshotsBeyondTheSlotsOfOneThreadThrow)
+{
+    ConcurrentAvlTree<int, int> tree(std::less<int>(), std::allocator<std::pair<int, int>>(), 2);
+    (void) tree.insert(1, 1);
+    const auto first = tree.snapshot();
+    {
+        const auto second = tree.snapshot();
+        // Waiting for a slot would wait for this thread itself.
+        BOOST_CHECK_THROW((void) tree.snapshot(), std::runtime_error);
+    }
+    BOOST_TEST(tree.snapshot().find(1)->second == 1);
+
+    // Slots held by other threads are waited for.
+    std::atomic<bool> taken(false);
+    std::thread holder([&] {
+        const auto held = tree.snapshot();
+        taken.store(true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    });
+    while(!taken.load()) {
+        std::this_thread::yield();
+    }
+    BOOST_TEST(tree.snapshot().find(1)->second == 1);
+    holder.join();
+}
+
+BOOST_AUTO_TEST_CASE(ReadersRunAlongsideAWriter)
+{
+    // Even keys are always present, odd keys come and go, and every value is twice its key.
+    ConcurrentAvlTree<int, int> tree;
+    for(int key = 0; key < 2000; key += 2) {
+        (void) tree.insert(key, 2 * key);
+    }
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> readers;
+    for(int reader = 0; reader < 4; ++reader) {
+        readers.emplace_back([&, reader] {
+            std::mt19937 rng(static_cast<unsigned>(reader));
+            int passes = 0;
+            while(!done.load() || passes < 10) {
+                const auto snapshot = tree.snapshot();
+                int previous = -1;
+                size_t evens = 0;
+                for(const auto& [key, value] : snapshot) {
+                    failures += (key <= previous || value != 2 * key) ? 1 : 0;
+                    evens += key % 2 == 0 ? 1 : 0;
+                    previous = key;
+                }
+                failures += evens != 1000 ? 1 : 0;
+                const int key = 2 * static_cast<int>(rng() % 1000);
+                failures += snapshot.find(key) == snapshot.end() ? 1 : 0;
+                ++passes;
+            }
+        });
+    }
+    std::mt19937 rng(99);
+    for(int i = 0; i < 20000; ++i) {
+        const int key = 2 * static_cast<int>(rng() % 1000) + 1;
+        if(rng() % 2 == 0) {
+            (void) tree.insert_or_assign(key, 2 * key);
+        } else {
+            (void) tree.erase(key);
+        }
+    }
+    done = true;
+    for(auto& reader : readers) {
+        reader.join();
+    }
+    BOOST_TEST(failures.load() == 0);
+}
+
+// NOLINTEND(readability-magic-numbers)
+
+BOOST_AUTO_TEST_SUITE_END()
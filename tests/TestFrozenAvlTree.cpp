@@ -0,0 +1,197 @@
+#include <boost/test/unit_test.hpp>
+
+#include "FrozenAvlTree.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace algos;
+
+namespace {
+
+/**
+ * @brief Check find_batch() and contains_batch() against find() for a frozen tree of
+ *        @p count even keys, probing with every key from -1 up to twice @p count.
+ */
+template<typename K>
+void checkBatchLookups(int count) {
+    std::vector<std::pair<K, int>> sorted;
+    for(int i = 0; i < count; ++i) {
+        sorted.emplace_back(static_cast<K>(2 * i), i);
+    }
+    const FrozenAvlTree<K, int> frozen(sorted.begin(), sorted.end());
+    std::vector<K> probes;
+    for(int i = -1; i <= 2 * count; ++i) {
+        probes.push_back(static_cast<K>(i));
+    }
+    std::vector<typename FrozenAvlTree<K, int>::const_iterator> found(probes.size());
+    frozen.find_batch(probes, found);
+    const auto present = std::make_unique<bool[]>(probes.size());
+    const auto hits = frozen.contains_batch(probes, {present.get(), probes.size()});
+    size_t expectedHits = 0;
+    for(size_t i = 0; i < probes.size(); ++i) {
+        const auto expected = frozen.find(probes[i]);
+        BOOST_TEST((found[i] == expected));
+        BOOST_TEST(present[i] == (expected != frozen.end()));
+        expectedHits += expected != frozen.end() ? 1 : 0;
+    }
+    BOOST_TEST(hits == expectedHits);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(FrozenAvlTreeSuite)
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+BOOST_AUTO_TEST_CASE(EmptySnapshot)
+{
+    const AvlTree<int, int> tree;
+    const FrozenAvlTree frozen(tree);
+    BOOST_TEST(frozen.empty());
+    BOOST_TEST(frozen.size() == 0);
+    BOOST_TEST((frozen.begin() == frozen.end()));
+    BOOST_TEST((frozen.find(1) == frozen.end()));
+    BOOST_TEST((frozen.lower_bound(1) == frozen.end()));
+}
+
+BOOST_AUTO_TEST_CASE(MatchesTheTreeItWasFrozenFrom)
+{
+    // Every size up to a few full levels, so both complete and ragged last levels are covered.
+    for(int count = 1; count <= 70; ++count) {
+        AvlTree<int, std::string> tree;
+        for(int key = 0; key < count; ++key) {
+            (void) tree.insert(2 * key, std::to_string(key));
+        }
+        const FrozenAvlTree frozen(tree);
+        BOOST_TEST(frozen.size() == tree.size());
+
+        auto expected = tree.cbegin();
+        for(const auto& [key, value] : frozen) {
+            BOOST_TEST(key == expected->first);
+            BOOST_TEST(value == expected->second);
+            ++expected;
+        }
+        BOOST_TEST((expected == tree.cend()));
+
+        // Standard algorithms take the iterators as they take those of AvlTree, both ways.
+        BOOST_TEST(std::distance(frozen.begin(), frozen.end()) == count);
+        const std::vector<std::pair<int, std::string>> copied(frozen.begin(), frozen.end());
+        BOOST_TEST(std::equal(copied.rbegin(), copied.rend(), std::make_reverse_iterator(frozen.end()),
+                              std::make_reverse_iterator(frozen.begin())));
+
+        for(int key = -1; key <= 2 * count; ++key) {
+            const auto found = frozen.find(key);
+            BOOST_TEST((found == frozen.end()) == (tree.find(key) == tree.end()));
+            const auto lower = frozen.lower_bound(key);
+            const auto treeLower = tree.lower_bound(key);
+            BOOST_TEST((lower == frozen.end()) == (treeLower == tree.end()));
+            if(treeLower != tree.end()) {
+                BOOST_TEST(lower->first == treeLower->first);
+            }
+            const auto upper = frozen.upper_bound(key);
+            const auto treeUpper = tree.upper_bound(key);
+            BOOST_TEST((upper == frozen.end()) == (treeUpper == tree.end()));
+            if(treeUpper != tree.end()) {
+                BOOST_TEST(upper->first == treeUpper->first);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RangesAndEqualRange)
+{
+    const std::map<int, int> source = {{10, 1}, {20, 2}, {30, 3}, {40, 4}, {50, 5}};
+    const FrozenAvlTree<int, int> frozen(source.begin(), source.end());
+
+    std::vector<int> keys;
+    for(const auto& [key, value] : frozen.range(15, 45)) {
+        keys.push_back(key);
+    }
+    BOOST_TEST(keys == std::vector<int>({20, 30, 40}));
+    BOOST_TEST(frozen.range(41, 49).empty());
+
+    const auto [first, last] = frozen.equal_range(30);
+    BOOST_TEST(first->second == 3);
+    BOOST_TEST((++frozen.find(30) == last));
+    const auto [missFirst, missLast] = frozen.equal_range(35);
+    BOOST_TEST((missFirst == missLast));
+    BOOST_TEST(missFirst->first == 40);
+}
+
+BOOST_AUTO_TEST_CASE(RandomizedLookups)
+{
+    std::mt19937 rng(3);
+    AvlTree<int, int> tree;
+    for(int i = 0; i < 5000; ++i) {
+        (void) tree.insert(static_cast<int>(rng() % 20000), i);
+    }
+    const FrozenAvlTree frozen(tree);
+    for(int i = 0; i < 20000; ++i) {
+        const int key = static_cast<int>(rng() % 20000);
+        const auto found = frozen.find(key);
+        const auto expected = tree.find(key);
+        BOOST_TEST((found == frozen.end()) == (expected == tree.end()));
+        if(expected != tree.end()) {
+            BOOST_TEST(found->second == expected->second);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(TransparentLookupAndComparator)
+{
+    AvlTree<std::string, int, std::greater<>> tree;
+    for(const auto* name : {"Alice", "Ben", "Carl", "Dana"}) {
+        (void) tree.insert(name, static_cast<int>(tree.size()));
+    }
+    const FrozenAvlTree frozen(tree);
+    BOOST_TEST(frozen.begin()->first == "Dana");
+    BOOST_TEST(frozen.find(std::string_view("Ben"))->second == 1);
+    BOOST_TEST(frozen.lower_bound(std::string_view("Bz"))->first == "Ben");
+    BOOST_TEST((frozen.find(std::string_view("Eve")) == frozen.end()));
+}
+
+BOOST_AUTO_TEST_CASE(BatchLookups)
+{
+    // Sizes around powers of two exercise both full and ragged last levels, and probe
+    // counts that are not a multiple of the batch group leave a remainder.
+    for(const int count : {0, 1, 2, 7, 8, 9, 100, 1000, 1023, 1024}) {
+        checkBatchLookups<int>(count);
+        checkBatchLookups<std::uint32_t>(count);
+        checkBatchLookups<std::int64_t>(count);
+        checkBatchLookups<double>(count);
+    }
+
+    // Unsigned keys above the largest signed value must still order after the small ones.
+    std::vector<std::pair<std::uint32_t, int>> sorted;
+    for(std::uint32_t i = 0; i < 64; ++i) {
+        sorted.emplace_back(i * 0x0400'0000U, static_cast<int>(i));
+    }
+    const FrozenAvlTree<std::uint32_t, int> frozen(sorted.begin(), sorted.end());
+    std::vector<std::uint32_t> probes;
+    for(const auto& [key, value] : sorted) {
+        probes.push_back(key);
+        probes.push_back(key + 1);
+    }
+    std::vector<FrozenAvlTree<std::uint32_t, int>::const_iterator> found(probes.size());
+    frozen.find_batch(probes, found);
+    for(size_t i = 0; i < probes.size(); ++i) {
+        if(i % 2 == 0) {
+            BOOST_TEST(found[i]->second == static_cast<int>(i / 2));
+        } else {
+            BOOST_TEST((found[i] == frozen.end()));
+        }
+    }
+}
+
+// NOLINTEND(readability-magic-numbers)
+
+BOOST_AUTO_TEST_SUITE_END()
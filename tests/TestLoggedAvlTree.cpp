@@ -0,0 +1,270 @@
+#include <boost/test/unit_test.hpp>
+
+#include "LoggedAvlTree.hpp"
+
+#include <csignal>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace algos;
+
+namespace {
+
+// The path of a tree in the temporary directory, whose snapshot and log are removed once the
+// test is done with them.
+struct TemporaryTree {
+    explicit TemporaryTree(const std::string& name)
+        : path(std::filesystem::temp_directory_path() / ("algos-" + std::to_string(::getpid()) + "-" + name)),
+          log(path.string() + ".log") {
+        remove();
+    }
+    TemporaryTree(const TemporaryTree&) = delete;
+    TemporaryTree& operator=(const TemporaryTree&) = delete;
+    ~TemporaryTree() {
+        remove();
+    }
+    void remove() const {
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+        std::filesystem::remove(log, ignored);
+    }
+    std::filesystem::path path;
+    std::filesystem::path log;
+};
+
+using Logged = LoggedAvlTree<std::int32_t, std::int64_t>;
+
+void checkAgainst(const Logged& tree, const std::map<std::int32_t, std::int64_t>& expected) {
+    BOOST_TEST(tree.size() == expected.size());
+    auto expectedIter = expected.begin();
+    for(const auto& [key, value] : tree.tree()) {
+        BOOST_TEST(key == expectedIter->first);
+        BOOST_TEST(value == expectedIter->second);
+        ++expectedIter;
+    }
+    BOOST_TEST((expectedIter == expected.end()));
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(LoggedAvlTreeSuite)
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+BOOST_AUTO_TEST_CASE(RecoversEveryChangeAcrossRestarts)
+{
+    const TemporaryTree files("recover.avl");
+    std::mt19937 rng(13);
+    std::map<std::int32_t, std::int64_t> expected;
+    for(int restart = 0; restart < 5; ++restart) {
+        Logged tree(files.path, 256);
+        checkAgainst(tree, expected);
+        for(int i = 0; i < 3000; ++i) {
+            const auto key = static_cast<std::int32_t>(rng() % 1000);
+            switch(rng() % 3) {
+            case 0:
+                BOOST_TEST(tree.insert(key, i) == expected.emplace(key, i).second);
+                break;
+            case 1:
+                BOOST_TEST(tree.insert_or_assign(key, i) == expected.insert_or_assign(key, i).second);
+                break;
+            default:
+                BOOST_TEST(tree.erase(key) == (expected.erase(key) == 1));
+                break;
+            }
+        }
+        // Checkpoint now and then, so recovery merges the log with a snapshot as well as replaying it alone.
+        if(restart == 2) {
+            tree.checkpoint();
+        }
+        tree.sync();
+    }
+    checkAgainst(Logged(files.path), expected);
+}
+
+BOOST_AUTO_TEST_CASE(RecordsAreWrittenInBatches)
+{
+    const TemporaryTree files("batches.avl");
+    Logged tree(files.path, 1024);
+    const auto headerSize = std::filesystem::file_size(files.log);
+    // Every put takes a byte for the operation, the key and the value.
+    const size_t putSize = 1 + sizeof(std::int32_t) + sizeof(std::int64_t);
+    for(std::int32_t key = 0; key < 10; ++key) {
+        (void) tree.insert(key, key);
+    }
+    BOOST_TEST(tree.pending() == 10);
+    BOOST_TEST(std::filesystem::file_size(files.log) == headerSize);
+    // Changes that do nothing are not logged.
+    BOOST_TEST(!tree.insert(0, 5));
+    BOOST_TEST(!tree.erase(-1));
+    BOOST_TEST(tree.pending() == 10);
+
+    for(std::int32_t key = 10; static_cast<size_t>(key) * putSize < 1024; ++key) {
+        (void) tree.insert(key, key);
+    }
+    BOOST_TEST(tree.pending() == 0);
+    BOOST_TEST(std::filesystem::file_size(files.log) > headerSize);
+    (void) tree.erase(3);
+    tree.sync();
+    BOOST_TEST(tree.pending() == 0);
+
+    // A checkpoint leaves the log with nothing to replay.
+    tree.checkpoint();
+    BOOST_TEST(std::filesystem::file_size(files.log) == headerSize);
+    BOOST_TEST(std::filesystem::exists(files.path));
+}
+
+BOOST_AUTO_TEST_CASE(TornRecordIsDropped)
+{
+    const TemporaryTree files("torn.avl");
+    {
+        Logged tree(files.path);
+        (void) tree.insert(1, 10);
+        (void) tree.insert(2, 20);
+    }
+    // A crash in the middle of a write leaves part of a record behind.
+    std::ofstream(files.log, std::ios::binary | std::ios::app) << '\x01' << "abc";
+    {
+        Logged tree(files.path);
+        checkAgainst(tree, {{1, 10}, {2, 20}});
+        (void) tree.insert(3, 30);
+    }
+    checkAgainst(Logged(files.path), {{1, 10}, {2, 20}, {3, 30}});
+}
+
+BOOST_AUTO_TEST_CASE(ZeroFilledTailIsDropped)
+{
+    const TemporaryTree files("zeros.avl");
+    {
+        Logged tree(files.path);
+        (void) tree.insert(1, 10);
+    }
+    // A file system may extend a file before the data written to it reaches the disk.
+    const auto logSize = std::filesystem::file_size(files.log);
+    std::filesystem::resize_file(files.log, logSize + 27);
+    {
+        Logged tree(files.path);
+        checkAgainst(tree, {{1, 10}});
+        BOOST_TEST(std::filesystem::file_size(files.log) == logSize);
+        (void) tree.insert(2, 20);
+    }
+    checkAgainst(Logged(files.path), {{1, 10}, {2, 20}});
+}
+
+BOOST_AUTO_TEST_CASE(UnframedRecordIsNotReplayed)
+{
+    const TemporaryTree files("unframed.avl");
+    {
+        Logged tree(files.path);
+        (void) tree.insert(1, 10);
+    }
+    // The garbage starts with the operation and the length of a put, without a valid checksum.
+    std::ofstream(files.log, std::ios::binary | std::ios::app) << '\x01' << std::string(7, '\0') << "garbage bytes";
+    checkAgainst(Logged(files.path), {{1, 10}});
+}
+
+BOOST_AUTO_TEST_CASE(CorruptBatchIsDroppedWithThoseAfterIt)
+{
+    const TemporaryTree files("corrupt.avl");
+    const size_t putSize = 1 + sizeof(std::int32_t) + sizeof(std::int64_t);
+    // Each batch holds ten records, behind its length and checksum.
+    const size_t batchSize = 2 * sizeof(std::uint32_t) + 10 * putSize;
+    size_t headerSize = 0;
+    {
+        Logged tree(files.path, 10 * putSize);
+        headerSize = std::filesystem::file_size(files.log);
+        for(std::int32_t key = 0; key < 30; ++key) {
+            (void) tree.insert(key, key);
+        }
+        BOOST_TEST(tree.pending() == 0);
+    }
+    BOOST_TEST(std::filesystem::file_size(files.log) == headerSize + 3 * batchSize);
+    {
+        std::fstream log(files.log, std::ios::binary | std::ios::in | std::ios::out);
+        log.seekp(static_cast<std::streamoff>(headerSize + batchSize + batchSize / 2));
+        log.put('\x07');
+    }
+    std::map<std::int32_t, std::int64_t> expected;
+    for(std::int32_t key = 0; key < 10; ++key) {
+        expected.emplace(key, key);
+    }
+    {
+        Logged tree(files.path);
+        checkAgainst(tree, expected);
+        BOOST_TEST(std::filesystem::file_size(files.log) == headerSize + batchSize);
+        (void) tree.insert(100, 100);
+    }
+    expected.emplace(100, 100);
+    checkAgainst(Logged(files.path), expected);
+}
+
+BOOST_AUTO_TEST_CASE(FlushResumesAfterAFailedWrite)
+{
+    const TemporaryTree files("resume.avl");
+    const size_t putSize = 1 + sizeof(std::int32_t) + sizeof(std::int64_t);
+    std::map<std::int32_t, std::int64_t> expected;
+    {
+        Logged tree(files.path, 10 * putSize);
+        const auto headerSize = std::filesystem::file_size(files.log);
+        // A file size limit makes the write stop part of the way through the batch.
+        rlimit limit{};
+        BOOST_REQUIRE(::getrlimit(RLIMIT_FSIZE, &limit) == 0);
+        const auto previous = limit;
+        const auto handler = std::signal(SIGXFSZ, SIG_IGN);
+        limit.rlim_cur = headerSize + 5 * putSize;
+        BOOST_REQUIRE(::setrlimit(RLIMIT_FSIZE, &limit) == 0);
+        bool failed = false;
+        for(std::int32_t key = 0; key < 10; ++key) {
+            expected.emplace(key, key);
+            try {
+                (void) tree.insert(key, key);
+            } catch(const std::system_error&) {
+                failed = true;
+            }
+        }
+        BOOST_TEST(failed);
+        BOOST_TEST(std::filesystem::file_size(files.log) == limit.rlim_cur);
+        BOOST_REQUIRE(::setrlimit(RLIMIT_FSIZE, &previous) == 0);
+        (void) std::signal(SIGXFSZ, handler);
+        // Records appended after the failure go in a batch of their own.
+        (void) tree.insert(10, 10);
+        expected.emplace(10, 10);
+        tree.sync();
+    }
+    checkAgainst(Logged(files.path), expected);
+}
+
+BOOST_AUTO_TEST_CASE(Crc32cMatchesTheCheckValue)
+{
+    const std::string_view check("123456789");
+    BOOST_TEST(crc32c(std::as_bytes(std::span(check))) == 0xE3069283U);
+    // Checksumming in pieces gives the same result.
+    const auto bytes = std::as_bytes(std::span(check));
+    BOOST_TEST(crc32c(bytes.subspan(4), crc32c(bytes.first(4))) == 0xE3069283U);
+    BOOST_TEST(crc32c({}) == 0U);
+}
+
+BOOST_AUTO_TEST_CASE(RejectsLogsOfOtherTypes)
+{
+    const TemporaryTree files("rejected.avl");
+    {
+        Logged tree(files.path);
+        (void) tree.insert(1, 10);
+    }
+    BOOST_CHECK_THROW((LoggedAvlTree<std::int64_t, std::int64_t>(files.path)), std::runtime_error);
+}
+
+// NOLINTEND(readability-magic-numbers)
+
+BOOST_AUTO_TEST_SUITE_END()
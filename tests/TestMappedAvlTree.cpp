@@ -0,0 +1,162 @@
+#include <boost/test/unit_test.hpp>
+
+#include "MappedAvlTree.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace algos;
+
+namespace {
+
+// A file in the temporary directory, removed once the test is done with it.
+struct TemporaryFile {
+    explicit TemporaryFile(const std::string& name)
+        : path(std::filesystem::temp_directory_path() / ("algos-" + std::to_string(::getpid()) + "-" + name)) {}
+    TemporaryFile(const TemporaryFile&) = delete;
+    TemporaryFile& operator=(const TemporaryFile&) = delete;
+    ~TemporaryFile() {
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+    }
+    std::filesystem::path path;
+};
+
+struct Point {
+    double x;
+    double y;
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(MappedAvlTreeSuite)
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+BOOST_AUTO_TEST_CASE(MatchesTheTreeItWasSavedFrom)
+{
+    const TemporaryFile file("matches.avl");
+    // Every size up to a few full levels, so both complete and ragged last levels are covered.
+    for(int count = 0; count <= 70; ++count) {
+        AvlTree<int, Point> tree;
+        for(int key = 0; key < count; ++key) {
+            (void) tree.insert(2 * key, Point{key * 0.5, -key * 0.5});
+        }
+        MappedAvlTree<int, Point>::save(tree, file.path);
+        const MappedAvlTree<int, Point> mapped(file.path);
+        BOOST_TEST(mapped.size() == tree.size());
+        BOOST_TEST(mapped.empty() == (count == 0));
+
+        auto expected = tree.cbegin();
+        for(const auto& [key, value] : mapped) {
+            BOOST_TEST(key == expected->first);
+            BOOST_TEST(value.x == expected->second.x);
+            BOOST_TEST(value.y == expected->second.y);
+            ++expected;
+        }
+        BOOST_TEST((expected == tree.cend()));
+
+        for(int key = -1; key <= 2 * count; ++key) {
+            const auto found = mapped.find(key);
+            BOOST_TEST((found == mapped.end()) == (tree.find(key) == tree.cend()));
+            const auto lower = mapped.lower_bound(key);
+            const auto expectedLower = tree.lower_bound(key);
+            BOOST_TEST((lower == mapped.end()) == (expectedLower == tree.cend()));
+            if(lower != mapped.end()) {
+                BOOST_TEST(lower->first == expectedLower->first);
+            }
+            const auto upper = mapped.upper_bound(key);
+            const auto expectedUpper = tree.upper_bound(key);
+            BOOST_TEST((upper == mapped.end()) == (expectedUpper == tree.cend()));
+            if(upper != mapped.end()) {
+                BOOST_TEST(upper->first == expectedUpper->first);
+            }
+            const auto [first, last] = mapped.equal_range(key);
+            BOOST_TEST(std::distance(first, last) == (found == mapped.end() ? 0 : 1));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(RandomizedRangesAgainstStdMap)
+{
+    const TemporaryFile file("ranges.avl");
+    std::mt19937 rng(5);
+    std::map<std::uint64_t, std::int32_t> expected;
+    for(int i = 0; i < 50000; ++i) {
+        expected.emplace(rng() % 1000000, i);
+    }
+    std::vector<std::pair<std::uint64_t, std::int32_t>> sorted(expected.begin(), expected.end());
+    MappedAvlTree<std::uint64_t, std::int32_t>::save(sorted.begin(), sorted.end(), file.path);
+    const MappedAvlTree<std::uint64_t, std::int32_t> mapped(file.path);
+    BOOST_TEST(mapped.size() == expected.size());
+    for(int i = 0; i < 1000; ++i) {
+        const std::uint64_t low = rng() % 1000000;
+        const std::uint64_t high = low + rng() % 1000;
+        std::int64_t sum = 0;
+        for(const auto& [key, value] : mapped.range(low, high)) {
+            sum += value;
+        }
+        std::int64_t expectedSum = 0;
+        for(auto iter = expected.lower_bound(low); iter != expected.lower_bound(high); ++iter) {
+            expectedSum += iter->second;
+        }
+        BOOST_TEST(sum == expectedSum);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MappingsOutliveNewerSaves)
+{
+    const TemporaryFile file("versions.avl");
+    AvlTree<int, int> tree;
+    (void) tree.insert(1, 10);
+    MappedAvlTree<int, int>::save(tree, file.path);
+    MappedAvlTree<int, int> older(file.path);
+
+    // Saving again replaces the file, a mapping of the old one keeps seeing what it held.
+    (void) tree.insert(2, 20);
+    MappedAvlTree<int, int>::save(tree, file.path);
+    const MappedAvlTree<int, int> newer(file.path);
+    BOOST_TEST(older.size() == 1);
+    BOOST_TEST(older.find(1)->second == 10);
+    BOOST_TEST((older.find(2) == older.end()));
+    BOOST_TEST(newer.size() == 2);
+    BOOST_TEST(newer.find(2)->second == 20);
+
+    auto moved = std::move(older);
+    BOOST_TEST(older.empty());
+    BOOST_TEST((older.begin() == older.end()));
+    BOOST_TEST(moved.find(1)->second == 10);
+    older = std::move(moved);
+    BOOST_TEST(older.size() == 1);
+    BOOST_TEST(moved.empty());
+}
+
+BOOST_AUTO_TEST_CASE(RejectsFilesItCannotRead)
+{
+    const TemporaryFile file("rejected.avl");
+    BOOST_CHECK_THROW((MappedAvlTree<int, int>(file.path)), std::system_error);
+
+    AvlTree<int, int> tree;
+    (void) tree.insert(1, 10);
+    MappedAvlTree<int, int>::save(tree, file.path);
+    // The sizes of the keys and values are recorded, so a tree of other types refuses the file.
+    BOOST_CHECK_THROW((MappedAvlTree<std::int64_t, int>(file.path)), std::runtime_error);
+    BOOST_CHECK_THROW((MappedAvlTree<int, Point>(file.path)), std::runtime_error);
+
+    std::ofstream(file.path, std::ios::binary | std::ios::trunc) << "not a tree";
+    BOOST_CHECK_THROW((MappedAvlTree<int, int>(file.path)), std::runtime_error);
+}
+
+// NOLINTEND(readability-magic-numbers)
+
+BOOST_AUTO_TEST_SUITE_END()
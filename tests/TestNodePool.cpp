@@ -0,0 +1,153 @@
+#include <boost/test/unit_test.hpp>
+
+#include "NodePool.hpp"
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace algos;
+
+namespace {
+
+size_t liveChunks{0};
+
+template<typename T>
+struct ChunkCountingAllocator {
+    using value_type = T;
+    ChunkCountingAllocator() = default;
+    template<typename U>
+    ChunkCountingAllocator(const ChunkCountingAllocator<U>& /*unused*/) {}
+    T* allocate(size_t n) {
+        ++liveChunks;
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* ptr, size_t n) {
+        --liveChunks;
+        std::allocator<T>{}.deallocate(ptr, n);
+    }
+    template<typename U>
+    bool operator==(const ChunkCountingAllocator<U>& /*unused*/) const {
+        return true;
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_SUITE(NodePoolSuite)
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+BOOST_AUTO_TEST_CASE(FreedSlotsAreReused)
+{
+    NodePool<std::string> pool;
+    auto* first = pool.create("first");
+    auto* second = pool.create("second");
+    BOOST_TEST(*first == "first");
+    BOOST_TEST(*second == "second");
+    pool.destroy(first);
+    auto* third = pool.create("third");
+    BOOST_TEST(third == first);
+    BOOST_TEST(*third == "third");
+    pool.destroy(second);
+    pool.destroy(third);
+}
+
+BOOST_AUTO_TEST_CASE(SlotsAreDistinctAcrossChunks)
+{
+    NodePool<long> pool;
+    std::set<long*> seen;
+    for(long i = 0; i < 10000; ++i) {
+        auto* ptr = pool.create(i);
+        BOOST_TEST(seen.insert(ptr).second);
+    }
+    long sum = 0;
+    for(auto* ptr : seen) {
+        sum += *ptr;
+    }
+    BOOST_TEST(sum == 10000L * 9999L / 2);
+}
+
+BOOST_AUTO_TEST_CASE(ReleaseReturnsEveryChunk)
+{
+    {
+        NodePool<long, ChunkCountingAllocator<long>> pool;
+        for(long i = 0; i < 5000; ++i) {
+            (void) pool.create(i);
+        }
+        BOOST_TEST(liveChunks > 1);
+        // Chunks grow geometrically, so there are far fewer chunks than elements.
+        BOOST_TEST(liveChunks < 16);
+        pool.release();
+        BOOST_TEST(liveChunks == 0);
+
+        (void) pool.create(1L);
+        BOOST_TEST(liveChunks == 1);
+        NodePool<long, ChunkCountingAllocator<long>> moved(std::move(pool));
+        BOOST_TEST(liveChunks == 1);
+    }
+    BOOST_TEST(liveChunks == 0);
+}
+
+BOOST_AUTO_TEST_CASE(SharedChunksOutliveTheirPool)
+{
+    {
+        NodePool<long, ChunkCountingAllocator<long>> pool;
+        std::vector<long*> created;
+        for(long i = 0; i < 100; ++i) {
+            created.push_back(pool.create(i));
+        }
+        auto sharing = pool.share();
+        pool.release();
+        // The sharing pool keeps the chunks, and can destroy what the other pool created.
+        BOOST_TEST(*created.back() == 99);
+        for(auto* ptr : created) {
+            sharing.destroy(ptr);
+        }
+
+        // Adopting merges the chunks of both, releasing one pool keeps them all.
+        NodePool<long, ChunkCountingAllocator<long>> other;
+        auto* const kept = other.create(7L);
+        auto alsoSharing = sharing.share();
+        sharing.adopt(other);
+        sharing.adopt(alsoSharing);
+        BOOST_TEST(*kept == 7);
+        sharing.destroy(kept);
+        BOOST_TEST(liveChunks > 0);
+        sharing.release();
+        BOOST_TEST(liveChunks == 0);
+    }
+    BOOST_TEST(liveChunks == 0);
+}
+
+BOOST_AUTO_TEST_CASE(PoolsTradingObjectsSettleOnOneGroup)
+{
+    {
+        NodePool<long, ChunkCountingAllocator<long>> first;
+        NodePool<long, ChunkCountingAllocator<long>> second;
+        auto* object = first.create(1L);
+        (void) second.create(2L);
+        // Handing an object over keeps its chunk alive through a share of the pool it came from.
+        const auto handOver = [&](auto& from, auto& to) {
+            auto sharing = from.share();
+            to.adopt(sharing);
+        };
+        handOver(first, second);
+        handOver(second, first);
+        const auto chunksAfterFirstTrips = liveChunks;
+        for(int trip = 0; trip < 100; ++trip) {
+            handOver(first, second);
+            handOver(second, first);
+        }
+        BOOST_TEST(liveChunks == chunksAfterFirstTrips);
+        first.release();
+        BOOST_TEST(*object == 1);
+        second.destroy(object);
+    }
+    BOOST_TEST(liveChunks == 0);
+}
+
+// NOLINTEND(readability-magic-numbers)
+
+BOOST_AUTO_TEST_SUITE_END()
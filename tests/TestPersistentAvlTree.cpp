@@ -0,0 +1,203 @@
+#include <boost/test/unit_test.hpp>
+
+#include "PersistentAvlTree.hpp"
+
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace algos;
+
+namespace {
+
+// Counts the values alive, to tell which nodes copies share.
+struct Counted {
+    static inline int alive{0};
+    explicit Counted(int value) : value(value) {
+        ++alive;
+    }
+    Counted(const Counted& other) : value(other.value) {
+        ++alive;
+    }
+    Counted& operator=(const Counted&) = default;
+    ~Counted() {
+        --alive;
+    }
+    int value;
+};
+
+template<typename Tree>
+void checkAgainst(const Tree& tree, const std::map<int, int>& expected) {
+    BOOST_TEST(tree.size() == expected.size());
+    auto expectedIter = expected.begin();
+    for(const auto& [key, value] : tree) {
+        BOOST_TEST(key == expectedIter->first);
+        BOOST_TEST(value == expectedIter->second);
+        ++expectedIter;
+    }
+    BOOST_TEST((expectedIter == expected.end()));
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(PersistentAvlTreeSuite)
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+BOOST_AUTO_TEST_CASE(RandomizedAgainstStdMap)
+{
+    std::mt19937 rng(17);
+    PersistentAvlTree<int, int> tree;
+    std::map<int, int> expected;
+    // Every version taken along the way must stay as it was.
+    std::vector<std::pair<PersistentAvlTree<int, int>, std::map<int, int>>> versions;
+    for(int i = 0; i < 20000; ++i) {
+        const int key = static_cast<int>(rng() % 1000);
+        switch(rng() % 4) {
+        case 0:
+            BOOST_TEST(tree.insert(key, i) == expected.emplace(key, i).second);
+            break;
+        case 1:
+            BOOST_TEST(tree.insert_or_assign(key, i) == expected.insert_or_assign(key, i).second);
+            break;
+        default:
+            BOOST_TEST(tree.erase(key) == (expected.erase(key) == 1));
+            break;
+        }
+        if(i % 1000 == 0) {
+            versions.emplace_back(tree.snapshot(), expected);
+        }
+    }
+    checkAgainst(tree, expected);
+    for(const auto& [version, versionExpected] : versions) {
+        checkAgainst(version, versionExpected);
+    }
+
+    for(int key = -1; key <= 1000; ++key) {
+        const auto found = tree.find(key);
+        BOOST_TEST((found == tree.end()) == (expected.find(key) == expected.end()));
+        const auto lower = tree.lower_bound(key);
+        const auto expectedLower = expected.lower_bound(key);
+        BOOST_TEST((lower == tree.end()) == (expectedLower == expected.end()));
+        if(expectedLower != expected.end()) {
+            BOOST_TEST(lower->first == expectedLower->first);
+        }
+        const auto upper = tree.upper_bound(key);
+        const auto expectedUpper = expected.upper_bound(key);
+        BOOST_TEST((upper == tree.end()) == (expectedUpper == expected.end()));
+        if(expectedUpper != expected.end()) {
+            BOOST_TEST(upper->first == expectedUpper->first);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CopiesShareTheirNodes)
+{
+    Counted::alive = 0;
+    {
+        PersistentAvlTree<int, Counted> tree;
+        for(int key = 0; key < 1000; ++key) {
+            (void) tree.insert(key, Counted(key));
+        }
+        // Without copies around, writes happen in place.
+        BOOST_TEST(Counted::alive == 1000);
+        for(int key = 0; key < 1000; key += 2) {
+            (void) tree.erase(key);
+        }
+        BOOST_TEST(Counted::alive == 500);
+        BOOST_TEST(std::distance(tree.begin(), tree.end()) == 500);
+
+        auto copy = tree;
+        BOOST_TEST(Counted::alive == 500);
+        // Only the path down to the assigned element is copied.
+        (void) copy.insert_or_assign(501, Counted(-1));
+        BOOST_TEST(Counted::alive > 500);
+        BOOST_TEST(Counted::alive <= 520);
+        BOOST_TEST(tree.find(501)->second.value == 501);
+        BOOST_TEST(copy.find(501)->second.value == -1);
+        // Writes that change nothing do not copy either.
+        const int before = Counted::alive;
+        (void) copy.insert(503, Counted(-1));
+        (void) copy.erase(502);
+        BOOST_TEST(Counted::alive == before);
+
+        copy.clear();
+        BOOST_TEST(copy.empty());
+        BOOST_TEST(Counted::alive == 500);
+        BOOST_TEST(tree.size() == 500);
+    }
+    BOOST_TEST(Counted::alive == 0);
+}
+
+BOOST_AUTO_TEST_CASE(AssignmentMovesAndTransparentLookup)
+{
+    PersistentAvlTree<std::string, int, std::less<>> tree;
+    (void) tree.insert("Alice", 1);
+    (void) tree.insert("Ben", 2);
+    PersistentAvlTree<std::string, int, std::less<>> other;
+    (void) other.insert("Carl", 3);
+
+    other = tree;
+    (void) other.erase(std::string_view("Alice"));
+    BOOST_TEST(tree.find(std::string_view("Alice"))->second == 1);
+    BOOST_TEST((other.find("Alice") == other.end()));
+    BOOST_TEST(other.begin()->first == "Ben");
+
+    auto moved = std::move(other);
+    BOOST_TEST(moved.size() == 1);
+    BOOST_TEST(other.empty());
+    (void) other.insert("Dana", 4);
+    BOOST_TEST(other.size() == 1);
+
+    swap(moved, tree);
+    BOOST_TEST(moved.size() == 2);
+    BOOST_TEST(tree.size() == 1);
+    BOOST_TEST(moved.lower_bound(std::string_view("B"))->first == "Ben");
+    BOOST_TEST((moved.upper_bound(std::string_view("Ben")) == moved.end()));
+}
+
+BOOST_AUTO_TEST_CASE(SnapshotsReadOnOtherThreads)
+{
+    // Even keys are always present, odd keys come and go, and every value is twice its key.
+    PersistentAvlTree<int, int> tree;
+    for(int key = 0; key < 2000; key += 2) {
+        (void) tree.insert(key, 2 * key);
+    }
+    std::atomic<int> failures(0);
+    std::vector<std::thread> readers;
+    std::mt19937 rng(99);
+    for(int round = 0; round < 8; ++round) {
+        readers.emplace_back([&failures, snapshot = tree.snapshot()] {
+            int previous = -1;
+            size_t evens = 0;
+            for(const auto& [key, value] : snapshot) {
+                failures += (key <= previous || value != 2 * key) ? 1 : 0;
+                evens += key % 2 == 0 ? 1 : 0;
+                previous = key;
+            }
+            failures += evens != 1000 ? 1 : 0;
+        });
+        for(int i = 0; i < 2000; ++i) {
+            const int key = 2 * static_cast<int>(rng() % 1000) + 1;
+            if(rng() % 2 == 0) {
+                (void) tree.insert_or_assign(key, 2 * key);
+            } else {
+                (void) tree.erase(key);
+            }
+        }
+    }
+    for(auto& reader : readers) {
+        reader.join();
+    }
+    BOOST_TEST(failures.load() == 0);
+}
+
+// NOLINTEND(readability-magic-numbers)
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,205 @@
+#include <boost/test/unit_test.hpp>
+
+#include "ShardedAvlTree.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace algos;
+
+namespace {
+
+using HashSharded = ShardedAvlTree<int, int, std::less<int>, 8>;
+using RangeSharded = ShardedAvlTree<int, int, std::less<int>, 4, RangeSharding<int>>;
+
+template<typename Sharded>
+void checkOrdered(const Sharded& tree, const std::map<int, int>& expected) {
+    BOOST_TEST(tree.size() == expected.size());
+    const auto view = tree.ordered();
+    BOOST_TEST(view.size() == expected.size());
+    auto expectedIter = expected.begin();
+    for(const auto& [key, value] : view) {
+        BOOST_TEST(key == expectedIter->first);
+        BOOST_TEST(value == expectedIter->second);
+        ++expectedIter;
+    }
+    BOOST_TEST((expectedIter == expected.end()));
+}
+
+template<typename Sharded>
+void randomizedAgainstStdMap(Sharded& tree) {
+    std::mt19937 rng(43);
+    std::map<int, int> expected;
+    for(int i = 0; i < 20000; ++i) {
+        const int key = static_cast<int>(rng() % 2000) - 1000;
+        switch(rng() % 4) {
+        case 0:
+            BOOST_TEST(tree.insert(key, i) == expected.emplace(key, i).second);
+            break;
+        case 1:
+            BOOST_TEST(tree.insert_or_assign(key, i) == expected.insert_or_assign(key, i).second);
+            break;
+        case 2:
+            BOOST_TEST(tree.erase(key) == (expected.erase(key) == 1));
+            break;
+        default: {
+            const auto found = tree.find(key);
+            const auto expectedFound = expected.find(key);
+            BOOST_TEST(found.has_value() == (expectedFound != expected.end()));
+            BOOST_TEST(tree.contains(key) == found.has_value());
+            if(found) {
+                BOOST_TEST(*found == expectedFound->second);
+            }
+            break;
+        }
+        }
+    }
+    checkOrdered(tree, expected);
+    tree.clear();
+    BOOST_TEST(tree.empty());
+    checkOrdered(tree, {});
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(ShardedAvlTreeSuite)
+
+// NOLINTBEGIN(readability-magic-numbers)
+
+BOOST_AUTO_TEST_CASE(HashShardingAgainstStdMap)
+{
+    HashSharded tree;
+    randomizedAgainstStdMap(tree);
+}
+
+BOOST_AUTO_TEST_CASE(RangeShardingAgainstStdMap)
+{
+    RangeSharded tree(RangeSharding<int>{{-500, 0, 500}});
+    BOOST_TEST(tree.shard_index(-501) == 0);
+    BOOST_TEST(tree.shard_index(-500) == 1);
+    BOOST_TEST(tree.shard_index(499) == 2);
+    BOOST_TEST(tree.shard_index(500) == 3);
+    randomizedAgainstStdMap(tree);
+
+    // Bounds that do not split the keys into exactly one run per shard are refused.
+    BOOST_CHECK_THROW((RangeSharded()), std::invalid_argument);
+    BOOST_CHECK_THROW((RangeSharded(RangeSharding<int>{{-500, 0, 500, 1000}})), std::invalid_argument);
+    BOOST_CHECK_THROW((RangeSharded(RangeSharding<int>{{0, -500, 500}})), std::invalid_argument);
+
+    // Shards left empty are skipped on the way through.
+    (void) tree.insert(-1000, 1);
+    (void) tree.insert(1000, 2);
+    checkOrdered(tree, {{-1000, 1}, {1000, 2}});
+}
+
+BOOST_AUTO_TEST_CASE(HashShardingSpreadsKeys)
+{
+    HashSharded tree;
+    std::vector<size_t> perShard(HashSharded::shard_count());
+    for(int key = 0; key < 8000; ++key) {
+        ++perShard[tree.shard_index(key)];
+    }
+    // Consecutive integers, which std::hash maps to themselves, still land in every shard evenly.
+    for(const auto count : perShard) {
+        BOOST_TEST(count > 800);
+        BOOST_TEST(count < 1200);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentWriters)
+{
+    HashSharded tree;
+    constexpr int threads = 4;
+    constexpr int perThread = 5000;
+    std::vector<std::thread> writers;
+    for(int thread = 0; thread < threads; ++thread) {
+        writers.emplace_back([&, thread] {
+            // Every thread writes keys of its own, which are spread over all shards.
+            for(int i = 0; i < perThread; ++i) {
+                (void) tree.insert(i * threads + thread, thread);
+            }
+            for(int i = 0; i < perThread; i += 2) {
+                (void) tree.erase(i * threads + thread);
+            }
+        });
+    }
+    // Boost.Test is not thread safe, so the reader only counts what it finds out of order.
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::thread reader([&] {
+        while(!done.load()) {
+            const auto view = tree.ordered();
+            int previous = -1;
+            for(const auto& [key, value] : view) {
+                if(key <= previous) {
+                    ++failures;
+                }
+                previous = key;
+            }
+        }
+    });
+    for(auto& writer : writers) {
+        writer.join();
+    }
+    done.store(true);
+    reader.join();
+    BOOST_TEST(failures.load() == 0);
+
+    std::map<int, int> expected;
+    for(int thread = 0; thread < threads; ++thread) {
+        for(int i = 1; i < perThread; i += 2) {
+            expected.emplace(i * threads + thread, thread);
+        }
+    }
+    checkOrdered(tree, expected);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelForEach)
+{
+    HashSharded tree;
+    std::map<int, int> expected;
+    for(int key = 0; key < 10000; ++key) {
+        (void) tree.insert(key, key);
+        expected.emplace(key, 2 * key);
+    }
+    for(const unsigned threads : {1U, 4U, 64U}) {
+        tree.for_each([](std::pair<int, int>& element) { element.second = 2 * element.first; }, threads);
+    }
+    checkOrdered(tree, expected);
+
+    std::atomic<std::int64_t> sum(0);
+    std::as_const(tree).for_each([&](const std::pair<int, int>& element) { sum += element.second; });
+    BOOST_TEST(sum.load() == std::int64_t{9999} * 10000);
+
+    BOOST_CHECK_THROW(tree.for_each([](const std::pair<int, int>& element) {
+        if(element.first == 1234) {
+            throw std::runtime_error("visit failed");
+        }
+    }, 4), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(CustomOrderAcrossShards)
+{
+    // Ordered descending, which the merge across shards must follow as well.
+    ShardedAvlTree<std::string, int, std::greater<std::string>, 3> tree;
+    for(const auto* const key : {"delta", "alpha", "charlie", "bravo", "echo"}) {
+        (void) tree.insert(key, 0);
+    }
+    std::vector<std::string> keys;
+    for(const auto& element : tree.ordered()) {
+        keys.push_back(element.first);
+    }
+    BOOST_TEST((keys == std::vector<std::string>{"echo", "delta", "charlie", "bravo", "alpha"}));
+}
+
+// NOLINTEND(readability-magic-numbers)
+
+BOOST_AUTO_TEST_SUITE_END()